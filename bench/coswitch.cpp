@@ -0,0 +1,88 @@
+// coswitch.cpp -- measures coresume() latency against the ring size.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <chrono>
+
+#include "sccorlib.h"
+
+// Each worker yields this many times before it returns.
+const long ROUNDS = 2000 ;
+
+// Ring sizes (coroutines, including the driver) to be measured.
+const long ringSizes[] = { 2, 4, 16, 64, 256, 1024 } ;
+
+HIDE long switches ;
+
+// Yields ROUNDS times from 'depth' calls below the coroutine's entry, so
+// that the saved frame grows with 'depth'.
+HIDE void yielder( long depth )
+{
+   volatile long pad[8] ;              // make each level's frame bigger
+
+   pad[0] = depth ;
+   if ( depth > 0 ) {
+      yielder( depth - 1 ) ;
+   } else {
+      for ( long i = 0; i < ROUNDS; i++ ) {
+         ++switches ;
+         coresume() ;
+      }
+   }
+}
+
+HIDE void worker( long depth )
+{
+   yielder( depth ) ;
+}
+
+// Runs every ring size at frame depths of 0 and 8 calls and prints one
+// "ring,depth,ns_per_switch" line for each.
+HIDE void driver( void )
+{
+   printf( "ring,depth,ns_per_switch\n" ) ;
+   for ( long depth = 0; depth <= 8; depth += 8 ) {
+      for ( long ring : ringSizes ) {
+         switches = 0 ;
+         for ( long i = 1; i < ring; i++ ) {
+            invoke( (COROUTINE)worker, 1, depth ) ;
+         }
+
+         auto start = std::chrono::steady_clock::now() ;
+         while ( getCoroutineCount() > 1 ) {
+            ++switches ;
+            coresume() ;
+         }
+         auto elapsed = std::chrono::steady_clock::now() - start ;
+
+         printf( "%ld,%ld,%.1f\n", ring, depth,
+                 std::chrono::duration<double, std::nano>( elapsed ).count()
+                 / switches ) ;
+      }
+   }
+}
+
+int main( void )
+{
+   cobegin( 1, driver, 0 ) ;
+   return 0 ;
+}
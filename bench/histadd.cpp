@@ -0,0 +1,139 @@
+// histadd.cpp -- measures Histogram::Add and AddN throughput, linear and
+// log-linear.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "histo.h"
+
+// Values added in each measurement.
+const long VALUES = 10000000 ;
+
+// Returns true if two distributions have the same bins and summary.
+static bool sameSummary( const Histogram &a, const Histogram &b )
+{
+   if ( a.NValues() != b.NValues() || a.MinValue() != b.MinValue() 
+        || a.MaxValue() != b.MaxValue() || a.MeanValue() != b.MeanValue() 
+        || a.ValueAtPercentile( 100.0 ) != b.ValueAtPercentile( 100.0 ) ) {
+      return false ;
+   }
+   for ( int i = 0; i <= a.NBins() + 1; i++ ) {
+      if ( a.BinCount( i ) != b.BinCount( i ) ) {
+         return false ;
+      }
+   }
+   return true ;
+}
+
+// Adds VALUES values from a spread, one at a time and (into twin, of the same
+// layout) with AddN, and prints "mode,spread,ns_per_add":  values within the
+// bins, and values of which a quarter are over the range of 400, into the
+// bins of the mode.  Returns false (and says so) if the two ways give
+// different distributions.
+static bool measure( const char *mode, Histogram &histogram, Histogram &twin )
+{
+   const unsigned int spreads[] = { 400, 533 } ;
+   std::vector<unsigned int> values( VALUES ) ;
+   bool same = true ;
+
+   for ( unsigned int spread : spreads ) {
+      unsigned int value = 12345 ;
+
+      for ( long i = 0; i < VALUES; i++ ) {
+         value = value * 1103515245 + 12345 ;   // a cheap pseudo-random spread
+         values[i] = ( value >> 8 ) % spread ;
+      }
+      for ( int batch = 0; batch < 2; batch++ ) {
+         Histogram &into = batch ? twin : histogram ;
+
+         into.Reset() ;
+         auto start = std::chrono::steady_clock::now() ;
+         if ( batch ) {
+            into.AddN( values.data(), VALUES ) ;
+         } else {
+            for ( long i = 0; i < VALUES; i++ ) {
+               into.Add( values[i] ) ;
+            }
+         }
+         auto elapsed = std::chrono::steady_clock::now() - start ;
+
+         printf( "%s%s,%u,%.2f\n", mode, batch ? "-AddN" : "", spread, 
+                 std::chrono::duration<double, std::nano>( elapsed ).count() 
+                 / VALUES ) ;
+         if ( batch && ! sameSummary( histogram, twin ) ) {
+            printf( "%s,%u:  AddN and Add disagree\n", mode, spread ) ;
+            same = false ;
+         }
+      }
+   }
+   return same ;
+}
+
+// Checks that the greatest value, and so p100, follows a descending sequence
+// (each value lowering the least one), added by Add and (into twin) by AddN,
+// returning false if not.
+static bool checkDescending( Histogram &histogram, Histogram &twin )
+{
+   const unsigned int descending[] = { 100, 90, 80, 70, 60 } ;
+
+   histogram.Reset() ;
+   twin.Reset() ;
+   for ( unsigned int value : descending ) {
+      histogram.Add( value ) ;
+   }
+   twin.AddN( descending, sizeof( descending ) / sizeof( *descending ) ) ;
+   if ( histogram.MaxValue() != 100 
+        || histogram.ValueAtPercentile( 100.0 ) != histogram.MaxValue() ) {
+      printf( "Add lost the greatest value:  max %llu, p100 %llu\n",
+              (unsigned long long)histogram.MaxValue(),
+              (unsigned long long)histogram.ValueAtPercentile( 100.0 ) ) ;
+      return false ;
+   }
+   if ( ! sameSummary( histogram, twin ) ) {
+      printf( "AddN and Add disagree on a descending sequence\n" ) ;
+      return false ;
+   }
+   return true ;
+}
+
+int main( void )
+{
+   Histogram linear( 0, 10, 40 ), linearTwin( 0, 10, 40 ) ;  // by reciprocal
+   Histogram shifted( 0, 16, 25 ), shiftedTwin( 0, 16, 25 ) ; // by shift
+   Histogram hdr( logLinear, 3 ), hdrTwin( logLinear, 3 ) ;
+
+   printf( "mode,spread,ns_per_add\n" ) ;
+   if ( ! measure( "linear", linear, linearTwin ) 
+        | ! measure( "linear-pow2", shifted, shiftedTwin ) 
+        | ! measure( "log-linear", hdr, hdrTwin ) ) {
+      return 1 ;
+   }
+   if ( ! checkDescending( linear, linearTwin ) 
+        || ! checkDescending( shifted, shiftedTwin ) 
+        || ! checkDescending( hdr, hdrTwin ) ) {
+      return 1 ;
+   }
+   return linear.NValues() == 0 ;
+}
@@ -0,0 +1,84 @@
+// spawn.cpp -- measures invoke() and invokeN() spawn throughput.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <chrono>
+
+#include "sccorlib.h"
+
+// Coroutines created in each measurement.
+const long SPAWNS = 20000 ;
+
+// Batch sizes:  how many coroutines are invoked before the driver yields.
+const long batches[] = { 1, 16, 256 } ;
+
+HIDE void quitter( long )
+{
+}
+
+// Arguments for a batch spawned with invokeN.
+HIDE long args[256] ;
+
+// Invokes SPAWNS coroutines that return at once, in batches, one at a time or
+// with invokeN, and prints one "api,batch,ns_per_spawn" line for each batch
+// size.  The time includes running and retiring each coroutine.
+HIDE void measure( bool bulk )
+{
+   for ( long batch : batches ) {
+      auto start = std::chrono::steady_clock::now() ;
+
+      for ( long i = 0; i < SPAWNS; i += batch ) {
+         if ( bulk ) {
+            invokeN( (COROUTINE)quitter, batch, 1, args ) ;
+         } else {
+            for ( long j = 0; j < batch; j++ ) {
+               invoke( (COROUTINE)quitter, 1, j ) ;
+            }
+         }
+         while ( getCoroutineCount() > 1 ) {
+            coresume() ;
+         }
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start ;
+
+      printf( "%s,%ld,%.1f\n", bulk ? "invokeN" : "invoke", batch, 
+              std::chrono::duration<double, std::nano>( elapsed ).count() 
+              / SPAWNS ) ;
+   }
+}
+
+HIDE void driver( void )
+{
+   for ( long i = 0; i < 256; i++ ) {
+      args[i] = i ;
+   }
+   printf( "api,batch,ns_per_spawn\n" ) ;
+   measure( false ) ;
+   measure( true ) ;
+}
+
+int main( void )
+{
+   cobegin( 1, driver, 0 ) ;
+   return 0 ;
+}
@@ -0,0 +1,73 @@
+// taskswitch.cpp -- measures task switches among stackless sccor::tasks.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <chrono>
+
+#include "sccortask.h"
+
+// Each task or coroutine yields this many times before it returns.
+const long ROUNDS = 2000 ;
+
+// Ring sizes (tasks, not counting the driver) to be measured.
+const long ringSizes[] = { 1, 3, 15, 63, 255, 1023 } ;
+
+HIDE long switches ;
+
+HIDE sccor::task yielder( void )
+{
+   for ( long i = 0; i < ROUNDS; i++ ) {
+      ++switches ;
+      co_await sccor::yield() ;
+   }
+}
+
+// Prints one "ring,ns_per_switch" line for each ring size:  a classic driver
+// coroutine and ring - 1 tasks, which are resumed without any frame copy.
+HIDE void driver( void )
+{
+   printf( "ring,ns_per_switch\n" ) ;
+   for ( long tasks : ringSizes ) {
+      switches = 0 ;
+      for ( long i = 0; i < tasks; i++ ) {
+         sccor::spawn( yielder() ) ;
+      }
+
+      auto start = std::chrono::steady_clock::now() ;
+      while ( getCoroutineCount() > 1 ) {
+         ++switches ;
+         coresume() ;
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start ;
+
+      printf( "%ld,%.1f\n", tasks + 1, 
+              std::chrono::duration<double, std::nano>( elapsed ).count()
+              / switches ) ;
+   }
+}
+
+int main( void )
+{
+   cobegin( 1, driver, 0 ) ;
+   return 0 ;
+}
@@ -0,0 +1,121 @@
+// timers.cpp -- measures wait() timer accuracy and overhead.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <chrono>
+
+#include "sccorlib.h"
+#include "histospt.h"
+
+// Waits by each sleeper, and the sleepers waiting at once.
+const long WAITS = 200 ;
+const long SLEEPERS = 8 ;
+
+// Task switches measured by the spinner.
+const long ROUNDS = 100000 ;
+
+// Lateness of each wake-up, in us.
+HIDE TimeIntervalHistogram lateness( "wait( 1 ) lateness (us)", 0, 10, 40 ) ;
+HIDE long long latenessSum = 0, latenessMax = 0 ;
+
+HIDE bool  spinning ;
+HIDE EVENT stop ;
+
+// Waits on the timer heap until the spinner is done.
+HIDE void parker( void )
+{
+   waitEx( 60000, &stop ) ;
+}
+
+// Waits 1 ms WAITS times, adding how late each wake-up is to the histogram.
+HIDE void sleeper( void )
+{
+   for ( long i = 0; i < WAITS; i++ ) {
+      auto start = std::chrono::steady_clock::now() ;
+
+      wait( 1 ) ;
+      long long late = std::chrono::duration_cast<std::chrono::microseconds>( 
+                          std::chrono::steady_clock::now() - start ).count() 
+                       - 1000 ;
+      if ( late < 0 ) {
+         late = 0 ;
+      }
+      lateness.add( (unsigned int)late ) ;
+      latenessSum += late ;
+      if ( late > latenessMax ) {
+         latenessMax = late ;
+      }
+   }
+}
+
+// Measures coresume() with no coroutines waiting and with 'parked' waiting on
+// the timer heap.  That a deadline has not yet passed is checked on each task
+// switch, so this is the overhead of the timers on the rest of the ring.
+HIDE void spinner( long parked )
+{
+   for ( long i = 0; i < parked; i++ ) {
+      invoke( (COROUTINE)parker, 0 ) ;
+   }
+   coresume() ;                        // let the parkers park
+
+   auto start = std::chrono::steady_clock::now() ;
+   for ( long i = 0; i < ROUNDS; i++ ) {
+      coresume() ;
+   }
+   auto elapsed = std::chrono::steady_clock::now() - start ;
+   spinning = false ;
+   setEvent( &stop ) ;
+
+   printf( "%ld,%.1f\n", parked, 
+           std::chrono::duration<double, std::nano>( elapsed ).count() / ROUNDS ) ;
+}
+
+// Keeps the spinner's task switches from being no-ops.
+HIDE void partner( void )
+{
+   while ( spinning ) {
+      coresume() ;
+   }
+}
+
+// Runs the sleepers together (so that their deadlines interleave in the timer
+// heap) and prints "sleepers,waits,mean_us,max_us" for the lateness, then the
+// histogram.  Then prints "parked,ns_per_coresume" for a ring of two
+// coroutines with none and with 1000 others waiting.
+int main( void )
+{
+   cobegin( SLEEPERS, sleeper, 0, sleeper, 0, sleeper, 0, sleeper, 0,
+                      sleeper, 0, sleeper, 0, sleeper, 0, sleeper, 0 ) ;
+   printf( "sleepers,waits,mean_us,max_us\n" ) ;
+   printf( "%ld,%ld,%.1f,%lld\n", SLEEPERS, WAITS * SLEEPERS,
+           (double)latenessSum / ( WAITS * SLEEPERS ), latenessMax ) ;
+   lateness.show() ;
+
+   printf( "parked,ns_per_coresume\n" ) ;
+   for ( long parked = 0; parked <= 1000; parked += 1000 ) {
+      spinning = true ;
+      resetEvent( &stop ) ;
+      cobegin( 2, spinner, 1, parked, partner, 0 ) ;
+   }
+   return 0 ;
+}
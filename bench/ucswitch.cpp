@@ -0,0 +1,110 @@
+// ucswitch.cpp -- measures a ucontext(3) ring, for comparison.
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+// For comparison with coswitch:  the same ring of yielders, switched with
+// swapcontext(3) from a scheduler context.  Each switch goes through the
+// scheduler, as each coresume() goes through the ring, and each context has
+// a stack of its own, like the separate-stack backend.
+
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 600    // ucontext is deprecated on macOS, but present
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <chrono>
+
+#include "sccorlib.h"        // HIDE
+
+const long ROUNDS = 2000 ;
+const long STACK_BYTES = 0x10000 ;
+const long ringSizes[] = { 2, 4, 16, 64, 256, 1024 } ;
+
+HIDE ucontext_t scheduler, *contexts ;
+HIDE bool *finished ;
+HIDE long current, switches ;
+
+HIDE void yielder( long depth )
+{
+   volatile long pad[8] ;
+
+   pad[0] = depth ;
+   if ( depth > 0 ) {
+      yielder( depth - 1 ) ;
+   } else {
+      for ( long i = 0; i < ROUNDS; i++ ) {
+         swapcontext( &contexts[current], &scheduler ) ;
+      }
+   }
+}
+
+HIDE void worker( int depth )
+{
+   yielder( depth ) ;
+   finished[current] = true ;
+}
+
+// Prints one "ring,depth,ns_per_switch" line for each ring size at frame
+// depths of 0 and 8 calls.
+int main( void )
+{
+   printf( "ring,depth,ns_per_switch\n" ) ;
+   for ( long depth = 0; depth <= 8; depth += 8 ) {
+      for ( long ring : ringSizes ) {
+         long live = ring - 1 ;
+
+         contexts = new ucontext_t[ring] ;
+         finished = new bool[ring]() ;
+         for ( long i = 0; i < live; i++ ) {
+            getcontext( &contexts[i] ) ;
+            contexts[i].uc_stack.ss_sp = malloc( STACK_BYTES ) ;
+            contexts[i].uc_stack.ss_size = STACK_BYTES ;
+            contexts[i].uc_link = &scheduler ;
+            makecontext( &contexts[i], (void (*)( void ))worker, 1, (int)depth ) ;
+         }
+
+         switches = 0 ;
+         auto start = std::chrono::steady_clock::now() ;
+         while ( live > 0 ) {
+            for ( current = 0; current < ring - 1; current++ ) {
+               if ( ! finished[current] ) {
+                  swapcontext( &scheduler, &contexts[current] ) ;
+                  switches += 2 ;
+                  live -= finished[current] ;
+               }
+            }
+         }
+         auto elapsed = std::chrono::steady_clock::now() - start ;
+
+         printf( "%ld,%ld,%.1f\n", ring, depth,
+                 std::chrono::duration<double, std::nano>( elapsed ).count()
+                 / switches ) ;
+         for ( long i = 0; i < ring - 1; i++ ) {
+            free( contexts[i].uc_stack.ss_sp ) ;
+         }
+         delete [] contexts ;
+         delete [] finished ;
+      }
+   }
+   return 0 ;
+}
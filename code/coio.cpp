@@ -0,0 +1,471 @@
+/*******************************************************************************
+**                                                                            **
+**       FILE:  coio.cpp                                                      **
+**                                                                            **
+**   SYNOPSIS:  File descriptor readiness for coroutines.  A coroutine doing  **
+**              socket or pipe I/O parks on the descriptor's wait queue, off  **
+**              the ring, until the reactor reports the descriptor ready.     **
+**              When no coroutine is runnable, the scheduler blocks in the    **
+**              reactor (until the earliest wait() deadline, if any) instead  **
+**              of sleeping.                                                  **
+**                                                                            **
+**              The reactor is epoll on Linux, kqueue on macOS, and poll()    **
+**              elsewhere (Cygwin).                                           **
+**                                                                            **
+**       N.B.:  - Descriptors given to co_read() and co_write() should be     **
+**                non-blocking, or a call made before the descriptor is ready **
+**                blocks the whole thread.  co_accept() returns non-blocking  **
+**                descriptors.                                                **
+**              - At most one direction (readable or writable) is waited for  **
+**                per call.                                                   **
+**                                                                            **
+**     AUTHOR:  Cary WR Campbell                                              **
+**                                                                            **
+** Copyright 2007 - 2021 Codecraft, Inc.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy 
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+** copies of the Software, and to permit persons to whom the Software is 
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in 
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+** FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+** DEALINGS IN THE SOFTWARE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__) && defined(__MACH__)
+#include <sys/event.h>
+#endif
+
+#include "mtint.h"
+
+/*------------------------------------------------------------
+                         Define Macros
+------------------------------------------------------------*/
+
+#define IO_EVENTS  64      // readiness events taken per reactor call
+
+/*------------------------------------------------------------
+                           Typedefs
+------------------------------------------------------------*/
+
+// The coroutines waiting on one descriptor.  The entries are allocated one
+// by one, since a parked slot points at its queue.
+typedef struct FdWaiters {
+   WAIT_QUEUE readers ;
+   WAIT_QUEUE writers ;
+   bool       added ;      // the descriptor is in the epoll set
+} FdWaiters ;
+
+// Internal prototypes.
+HIDE FdWaiters *fdWaiters( int fd ) ;
+HIDE bool waitFd( int fd, bool writing, unsigned long timeoutMs ) ;
+HIDE void wakeFd( int fd, bool readable, bool writable ) ;
+#if defined(__linux__)
+HIDE bool armFd( int fd, FdWaiters *waiters, bool writing ) ;
+#elif defined(__APPLE__) && defined(__MACH__)
+HIDE bool armFd( int fd, bool writing ) ;
+#endif
+#if ! ( defined(__APPLE__) && defined(__MACH__) )
+HIDE int pollMs( long long timeoutNs ) ;
+#endif
+
+/*******************************************************************************
+*                             Module Variables                                 *
+*******************************************************************************/
+std::atomic<int> ioWaiters( 0 ) ;
+
+HIDE FdWaiters **fdTable = NULL ;       // waiters, indexed by descriptor
+HIDE int         fdCount = 0 ;          // entries in fdTable
+#if defined(__linux__) || ( defined(__APPLE__) && defined(__MACH__) )
+HIDE int         reactor = -1 ;         // the epoll or kqueue descriptor
+#endif
+
+
+/*******************************************************************************
+*                             Private Functions                                *
+*******************************************************************************/
+
+/*******************************************************************************
+* fdWaiters                                                                    *
+*                                                                              *
+* Purpose: Returns the waiters of a descriptor, growing the table as needed.   *
+*******************************************************************************/
+HIDE FdWaiters *fdWaiters( int fd )
+{
+   if ( fd >= fdCount ) {
+      int count = fdCount ? fdCount : 64 ;
+
+      while ( count <= fd ) {
+         count *= 2 ;
+      }
+      fdTable = (FdWaiters **)realloc( fdTable, count * sizeof( FdWaiters * ) ) ;
+      if ( fdTable == NULL ) {
+         printf( "sccor: descriptor table allocation failure\n" ) ;
+         exit( 1 ) ;
+      }
+      memset( fdTable + fdCount, 0, ( count - fdCount ) * sizeof( FdWaiters * ) ) ;
+      fdCount = count ;
+   }
+   if ( fdTable[fd] == NULL ) {
+      fdTable[fd] = (FdWaiters *)calloc( 1, sizeof( FdWaiters ) ) ;
+      if ( fdTable[fd] == NULL ) {
+         printf( "sccor: descriptor table allocation failure\n" ) ;
+         exit( 1 ) ;
+      }
+   }
+   return fdTable[fd] ;
+}
+
+#if defined(__linux__)
+/*******************************************************************************
+* armFd                                                                        *
+*                                                                              *
+* Purpose: Registers (one-shot) interest in a descriptor for its waiters and   *
+*          the coroutine about to wait.  Returns false if the descriptor can't *
+*          be polled (e.g., a regular file), which is then always ready.       *
+*******************************************************************************/
+HIDE bool armFd( int fd, FdWaiters *waiters, bool writing )
+{
+   struct epoll_event event ;
+
+   if ( reactor < 0 ) {
+      reactor = epoll_create1( EPOLL_CLOEXEC ) ;
+      if ( reactor < 0 ) {
+         printf( "sccor: epoll_create1 failure (errno %d)\n", errno ) ;
+         exit( 1 ) ;
+      }
+   }
+   memset( &event, 0, sizeof( event ) ) ;
+   event.events = EPOLLONESHOT ;
+   if ( waiters->readers.head != NULL || ! writing ) {
+      event.events |= EPOLLIN ;
+   }
+   if ( waiters->writers.head != NULL || writing ) {
+      event.events |= EPOLLOUT ;
+   }
+   event.data.fd = fd ;
+   // A descriptor that was closed has left the set, and one that was reused
+   // may still be in it, so try the other operation when one fails.
+   if ( epoll_ctl( reactor, waiters->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, 
+                   fd, &event ) < 0 
+        && epoll_ctl( reactor, waiters->added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, 
+                      fd, &event ) < 0 ) {
+      waiters->added = false ;
+      return false ;
+   }
+   waiters->added = true ;
+   return true ;
+}
+#elif defined(__APPLE__) && defined(__MACH__)
+/*******************************************************************************
+* armFd                                                                        *
+*                                                                              *
+* Purpose: Registers one-shot interest in a descriptor's readiness for the     *
+*          coroutine about to wait.  Returns false if the descriptor can't be  *
+*          polled, which is then treated as always ready.                      *
+*******************************************************************************/
+HIDE bool armFd( int fd, bool writing )
+{
+   struct kevent change ;
+
+   if ( reactor < 0 ) {
+      reactor = kqueue() ;
+      if ( reactor < 0 ) {
+         printf( "sccor: kqueue failure (errno %d)\n", errno ) ;
+         exit( 1 ) ;
+      }
+   }
+   EV_SET( &change, fd, writing ? EVFILT_WRITE : EVFILT_READ, 
+           EV_ADD | EV_ONESHOT, 0, 0, NULL ) ;
+   return kevent( reactor, &change, 1, NULL, 0, NULL ) == 0 ;
+}
+#endif
+
+/*******************************************************************************
+* waitFd                                                                       *
+*                                                                              *
+* Purpose: Parks the running coroutine until a descriptor is ready for reading *
+*          (or writing) or timeoutMs ms pass.  Returns false on timeout or     *
+*          cancel().                                                           *
+*          Outside of the coroutines, the thread itself waits in poll().       *
+*******************************************************************************/
+HIDE bool waitFd( int fd, bool writing, unsigned long timeoutMs )
+{
+   FdWaiters *waiters ;
+   bool       ready ;
+
+   if ( getCoroutineCount() == 0 ) {
+      struct pollfd one = { fd, (short)( writing ? POLLOUT : POLLIN ), 0 } ;
+
+      return poll( &one, 1, timeoutMs == WAIT_FOREVER ? -1 : (int)timeoutMs ) != 0 ;
+   }
+   lockScheduler() ;
+   waiters = fdWaiters( fd ) ;
+#if defined(__linux__)
+   if ( ! armFd( fd, waiters, writing ) ) {
+      unlockScheduler() ;
+      return true ;
+   }
+#elif defined(__APPLE__) && defined(__MACH__)
+   if ( ! armFd( fd, writing ) ) {
+      unlockScheduler() ;
+      return true ;
+   }
+#endif
+   ++ioWaiters ;
+   ready = park( writing ? &waiters->writers : &waiters->readers, timeoutMs ) ;
+   lockScheduler() ;
+   --ioWaiters ;
+   unlockScheduler() ;
+   return ready ;
+}
+
+#if ! ( defined(__APPLE__) && defined(__MACH__) )
+/*******************************************************************************
+* pollMs                                                                       *
+*                                                                              *
+* Purpose: Returns a timeout in ns as the ms argument of epoll_wait or poll,   *
+*          rounded up, clamped to INT_MAX and -1 (forever) if negative.        *
+*******************************************************************************/
+HIDE int pollMs( long long timeoutNs )
+{
+   if ( timeoutNs < 0 ) {
+      return -1 ;
+   }
+   if ( timeoutNs > (long long)INT_MAX * 1000000 - 999999 ) {
+      return INT_MAX ;
+   }
+   return (int)( ( timeoutNs + 999999 ) / 1000000 ) ;
+}
+#endif
+
+/*******************************************************************************
+* wakeFd                                                                       *
+*                                                                              *
+* Purpose: Puts the coroutines waiting on a ready descriptor back on the ring. *
+*          With epoll, interest is re-armed for any still waiting.  Called     *
+*          with the scheduler locked.                                          *
+*******************************************************************************/
+HIDE void wakeFd( int fd, bool readable, bool writable )
+{
+   FdWaiters *waiters ;
+
+   if ( fd < 0 || fd >= fdCount || fdTable[fd] == NULL ) {
+      return ;
+   }
+   waiters = fdTable[fd] ;
+   while ( readable && unpark( &waiters->readers ) ) {
+   }
+   while ( writable && unpark( &waiters->writers ) ) {
+   }
+#if defined(__linux__)
+   if ( waiters->readers.head != NULL ) {
+      armFd( fd, waiters, false ) ;
+   } else if ( waiters->writers.head != NULL ) {
+      armFd( fd, waiters, true ) ;
+   }
+#endif
+}
+
+
+/*******************************************************************************
+*                        Internal Functions (mtint.h)                          *
+*******************************************************************************/
+
+/*******************************************************************************
+* pollIo                                                                       *
+*                                                                              *
+* Purpose: Waits up to timeoutNs ns (forever if negative) for the parked       *
+*          descriptors and puts the coroutines of the ready ones on the ring.  *
+*          The scheduler is not locked while waiting.                          *
+*******************************************************************************/
+void pollIo( long long timeoutNs )
+{
+#if defined(__linux__)
+   struct epoll_event events[IO_EVENTS] ;
+   int n = epoll_wait( reactor, events, IO_EVENTS, pollMs( timeoutNs ) ) ;
+
+   lockScheduler() ;
+   for ( int i = 0; i < n; i++ ) {
+      bool failed = ( events[i].events & ( EPOLLERR | EPOLLHUP ) ) != 0 ;
+
+      wakeFd( events[i].data.fd, failed || ( events[i].events & EPOLLIN ), 
+              failed || ( events[i].events & EPOLLOUT ) ) ;
+   }
+   unlockScheduler() ;
+#elif defined(__APPLE__) && defined(__MACH__)
+   struct kevent   events[IO_EVENTS] ;
+   struct timespec timeout = { (time_t)( timeoutNs / 1000000000 ), 
+                               (long)( timeoutNs % 1000000000 ) } ;
+   int n = kevent( reactor, NULL, 0, events, IO_EVENTS, 
+                   timeoutNs < 0 ? NULL : &timeout ) ;
+
+   lockScheduler() ;
+   for ( int i = 0; i < n; i++ ) {
+      bool failed = ( events[i].flags & ( EV_ERROR | EV_EOF ) ) != 0 ;
+
+      wakeFd( (int)events[i].ident, failed || events[i].filter == EVFILT_READ, 
+              failed || events[i].filter == EVFILT_WRITE ) ;
+   }
+   unlockScheduler() ;
+#else
+   struct pollfd *fds ;
+   int            count = 0 ;
+
+   lockScheduler() ;
+   fds = (struct pollfd *)malloc( ( ioWaiters + 1 ) * sizeof( struct pollfd ) ) ;
+   if ( fds == NULL ) {
+      printf( "sccor: poll allocation failure\n" ) ;
+      exit( 1 ) ;
+   }
+   for ( int fd = 0; fd < fdCount && count < ioWaiters; fd++ ) {
+      FdWaiters *waiters = fdTable[fd] ;
+
+      if ( waiters != NULL 
+           && ( waiters->readers.head != NULL || waiters->writers.head != NULL ) ) {
+         fds[count].fd = fd ;
+         fds[count].events = ( waiters->readers.head ? POLLIN : 0 ) 
+                             | ( waiters->writers.head ? POLLOUT : 0 ) ;
+         fds[count++].revents = 0 ;
+      }
+   }
+   unlockScheduler() ;
+   if ( poll( fds, count, pollMs( timeoutNs ) ) > 0 ) {
+      lockScheduler() ;
+      for ( int i = 0; i < count; i++ ) {
+         bool failed = ( fds[i].revents & ( POLLERR | POLLHUP | POLLNVAL ) ) != 0 ;
+
+         if ( fds[i].revents != 0 ) {
+            wakeFd( fds[i].fd, failed || ( fds[i].revents & POLLIN ), 
+                    failed || ( fds[i].revents & POLLOUT ) ) ;
+         }
+      }
+      unlockScheduler() ;
+   }
+   free( fds ) ;
+#endif
+}
+
+
+/*******************************************************************************
+*                           Public Functions (API)                             *
+*******************************************************************************/
+
+/*******************************************************************************
+* waitReadable                                                                 *
+*                                                                              *
+* Purpose: waits, off the ring, until a descriptor can be read without         *
+*          blocking or timeoutMs ms pass.  Returns false on timeout.           *
+*******************************************************************************/
+bool waitReadable( int fd, unsigned long timeoutMs )
+{
+   return waitFd( fd, false, timeoutMs ) ;
+}
+
+/*******************************************************************************
+* waitWritable                                                                 *
+*                                                                              *
+* Purpose: waits, off the ring, until a descriptor can be written without      *
+*          blocking or timeoutMs ms pass.  Returns false on timeout.           *
+*******************************************************************************/
+bool waitWritable( int fd, unsigned long timeoutMs )
+{
+   return waitFd( fd, true, timeoutMs ) ;
+}
+
+/*******************************************************************************
+* co_read                                                                      *
+*                                                                              *
+* Purpose: read() that continues other coroutines while no data is available. *
+*          Fails with ECANCELED if the coroutine is canceled while waiting.    *
+*******************************************************************************/
+ssize_t co_read( int fd, void *buffer, size_t count )
+{
+   for ( ;; ) {
+      ssize_t n = read( fd, buffer, count ) ;
+
+      if ( n >= 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) ) {
+         return n ;
+      }
+      if ( errno != EINTR && ! waitFd( fd, false, WAIT_FOREVER ) ) {
+         errno = ECANCELED ;
+         return -1 ;
+      }
+   }
+}
+
+/*******************************************************************************
+* co_write                                                                     *
+*                                                                              *
+* Purpose: write() that continues other coroutines while the descriptor is     *
+*          full.  All count bytes are written unless an error occurs, or the   *
+*          coroutine is canceled while waiting (ECANCELED).                    *
+*******************************************************************************/
+ssize_t co_write( int fd, const void *buffer, size_t count )
+{
+   size_t done = 0 ;
+
+   while ( done < count ) {
+      ssize_t n = write( fd, (const char *)buffer + done, count - done ) ;
+
+      if ( n >= 0 ) {
+         done += n ;
+      } else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+         if ( ! waitFd( fd, true, WAIT_FOREVER ) ) {
+            errno = ECANCELED ;
+            return done > 0 ? (ssize_t)done : -1 ;
+         }
+      } else if ( errno != EINTR ) {
+         return done > 0 ? (ssize_t)done : -1 ;
+      }
+   }
+   return done ;
+}
+
+/*******************************************************************************
+* co_accept                                                                    *
+*                                                                              *
+* Purpose: accept() that continues other coroutines while no connection is    *
+*          pending.  The listening descriptor should be non-blocking; the      *
+*          accepted one is made non-blocking.  Fails with ECANCELED if the     *
+*          coroutine is canceled while waiting.                                *
+*******************************************************************************/
+int co_accept( int fd, struct sockaddr *address, socklen_t *length )
+{
+   for ( ;; ) {
+      int client = accept( fd, address, length ) ;
+
+      if ( client >= 0 ) {
+         fcntl( client, F_SETFL, fcntl( client, F_GETFL ) | O_NONBLOCK ) ;
+         return client ;
+      }
+      if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED ) {
+         if ( ! waitFd( fd, false, WAIT_FOREVER ) ) {
+            errno = ECANCELED ;
+            return -1 ;
+         }
+      } else if ( errno != EINTR ) {
+         return -1 ;
+      }
+   }
+}
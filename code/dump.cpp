@@ -20,12 +20,249 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
 // DEALINGS IN THE SOFTWARE.
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 typedef unsigned char byte;
 
-void dump( const void * const pMemory, int size, byte *pShow = 0 ) ;
+void   dump( const void * const pMemory, int size, byte *pShow = 0 ) ;
+size_t dumpToBuffer( const void * const pMemory, int size, char *buffer,
+                     size_t bufferSize, byte *pShow = 0, bool collapse = false ) ;
+bool   dumpToFd( int fd, const void * const pMemory, int size, 
+                 byte *pShow = 0, bool collapse = false ) ;
+
+// The header of a dump, and the longest line (a 16-digit address).
+static const char DUMP_HEADER[] = 
+   "\n               0 1 2 3  4 5 6 7  8 9 a b  c d e f  0123 4567 89ab cdef\n\n" ;
+static const int DUMP_LINE_BYTES = 16 + 2 + 35 + 2 + 19 + 1 ;
+static_assert( sizeof( DUMP_HEADER ) - 1 <= DUMP_LINE_BYTES, 
+               "The header of a dump is formatted as a line" ) ;
+
+// Size of the chunks written to an fd, kept on the stack so that a dump
+// taken on a fault allocates nothing.
+static const int DUMP_CHUNK_BYTES = 16384 ;
+
+// Tables of the two hex digits and the character shown for each byte.
+struct DumpTables
+{
+   char hex[256][2] ;
+   char shown[256] ;
+
+   constexpr DumpTables( ) : hex(), shown()
+   {
+      for ( int i = 0; i < 256; i++ )
+      {
+         hex[i][0] = "0123456789abcdef"[i >> 4] ;
+         hex[i][1] = "0123456789abcdef"[i & 15] ;
+         shown[i] = i < 0x20 ? '.' : (char) i ;
+      }
+   }
+} ;
+static constexpr DumpTables DUMP_TABLES ;
+
+// Collects the text of a dump into a buffer, counting the bytes that didn't
+// fit, or into a chunk that is written to an fd whenever it fills.
+class DumpWriter
+{
+  public:
+   DumpWriter( char *buffer, size_t size ) 
+             : at( buffer ), start( buffer ), end( buffer + size ), fd( -1 ),
+               bytes( 0 ), ok( true ) { }
+   DumpWriter( int fd, char *chunk, size_t size ) 
+             : at( chunk ), start( chunk ), end( chunk + size ), fd( fd ),
+               bytes( 0 ), ok( true ) { }
+
+   // Function returning where to format up to length bytes, which Commit
+   // then counts.  The text goes to scratch if the buffer is full.
+   char *Reserve( int length )
+   {
+      if ( end - at < length && fd >= 0 )
+      {
+         Flush() ;
+      }
+      return end - at >= length ? at : scratch ;
+   }
+   void Commit( char *from, char *to )
+   {
+      bytes += to - from ;
+      if ( from == scratch )
+      {
+         // Keep what fits of a line formatted aside.
+         size_t room = end - at ;
+         size_t length = to - from ;
+
+         length = length < room ? length : room ;
+         memcpy( at, from, length ) ;
+         at += length ;
+      }
+      else
+      {
+         at = to ;
+      }
+   }
+
+   // Function to write the chunk to the fd, returning false if it can't be.
+   bool Flush( )
+   {
+      const char *from = start ;
+
+      while ( ok && from < at )
+      {
+         ssize_t wrote = write( fd, from, at - from ) ;
+
+         if ( wrote < 0 && errno == EINTR )
+         {
+            continue ;
+         }
+         ok = wrote > 0 ;
+         from += ok ? wrote : 0 ;
+      }
+      at = start ;
+      return ok ;
+   }
+
+   char *at, *start, *end ;
+   int fd ;
+   size_t bytes ;
+   bool ok ;
+   char scratch[DUMP_LINE_BYTES + 1] ;
+};
+
+// Function to format the line of the 16 bytes at pMem, shown at address
+// show, of which those from first up to last are dumped, returning its end.
+static char *DumpLine( char *at, const byte *pMem, const byte *first, 
+                       const byte *last, unsigned long show )
+{
+   char address[16] ;
+   int digits = 0 ;
+
+   // The address, as "%12lx  ".
+   do
+   {
+      address[digits++] = "0123456789abcdef"[show & 15] ;
+      show >>= 4 ;
+   } while ( show ) ;
+   for ( int i = digits; i < 12; i++ )
+   {
+      *at++ = ' ' ;
+   }
+   while ( digits > 0 )
+   {
+      *at++ = address[--digits] ;
+   }
+   *at++ = ' ' ;
+   *at++ = ' ' ;
+
+   if ( first == pMem && last == pMem + 16 )
+   {
+      // A whole line:  the hex values and then the characters, in groups of
+      // four.
+      for ( int i = 0; i < 16; i++ )
+      {
+         if ( i && !( i & 3 ) )
+         {
+            *at++ = ' ' ;
+         }
+         at[0] = DUMP_TABLES.hex[pMem[i]][0] ;
+         at[1] = DUMP_TABLES.hex[pMem[i]][1] ;
+         at += 2 ;
+      }
+      *at++ = ' ' ;
+      *at++ = ' ' ;
+      for ( int i = 0; i < 16; i++ )
+      {
+         if ( i && !( i & 3 ) )
+         {
+            *at++ = ' ' ;
+         }
+         *at++ = DUMP_TABLES.shown[pMem[i]] ;
+      }
+   }
+   else
+   {
+      // The first or last line, blank where the bytes aren't dumped.
+      for ( int i = 0; i < 16; i++ )
+      {
+         bool dumped = pMem + i >= first && pMem + i < last ;
+
+         if ( i && !( i & 3 ) )
+         {
+            *at++ = ' ' ;
+         }
+         at[0] = dumped ? DUMP_TABLES.hex[pMem[i]][0] : ' ' ;
+         at[1] = dumped ? DUMP_TABLES.hex[pMem[i]][1] : ' ' ;
+         at += 2 ;
+      }
+      *at++ = ' ' ;
+      *at++ = ' ' ;
+      for ( int i = 0; i < 16; i++ )
+      {
+         if ( i && !( i & 3 ) )
+         {
+            *at++ = ' ' ;
+         }
+         *at++ = pMem + i >= first && pMem + i < last 
+               ? DUMP_TABLES.shown[pMem[i]] : ' ' ;
+      }
+   }
+   *at++ = '\n' ;
+   return at ;
+}
+
+// Routine to format a dump into a writer.  Collapsing, a run of whole lines
+// the same as the line before is shown as one line of "*", as hexdump does.
+static void DumpTo( DumpWriter &out, const void * const pMemory, int size, 
+                    byte *pShow, bool collapse )
+{
+   const byte *first = (const byte *) pMemory ;
+   const byte *last = first + ( size > 0 ? size : 0 ) ;
+   const byte *pMem = (const byte *)( (unsigned long)pMemory & 0xfffffffffffffff0 ) ;
+   const int dataBytesDisplayedPerLine = 16 ;
+   bool starred = false ;
+   char *at ;
+
+   // See if the display start address is different from the actual memory
+   // address.
+   if ( pShow == 0 )
+   {
+      // We'll display the actual memory address.
+      pShow = (byte *) pMem ;
+   }
+   at = out.Reserve( sizeof( DUMP_HEADER ) - 1 ) ;
+   memcpy( at, DUMP_HEADER, sizeof( DUMP_HEADER ) - 1 ) ;
+   out.Commit( at, at + sizeof( DUMP_HEADER ) - 1 ) ;
+   for ( ; pMem < last; pMem += dataBytesDisplayedPerLine,
+                        pShow += dataBytesDisplayedPerLine )
+   {
+      if ( collapse && pMem - first >= dataBytesDisplayedPerLine 
+           && pMem + dataBytesDisplayedPerLine < last
+           && !memcmp( pMem, pMem - dataBytesDisplayedPerLine, 
+                       dataBytesDisplayedPerLine ) )
+      {
+         if ( !starred )
+         {
+            at = out.Reserve( 2 ) ;
+            at[0] = '*' ;
+            at[1] = '\n' ;
+            out.Commit( at, at + 2 ) ;
+            starred = true ;
+         }
+         continue ;
+      }
+      starred = false ;
+      at = out.Reserve( DUMP_LINE_BYTES ) ;
+      out.Commit( at, DumpLine( at, pMem, pMem < first ? first : pMem, 
+                                pMem + 16 > last ? last : pMem + 16,
+                                (unsigned long) pShow ) ) ;
+   }
+
+   // Finish with a blank line.
+   at = out.Reserve( 1 ) ;
+   *at = '\n' ;
+   out.Commit( at, at + 1 ) ;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -47,78 +284,50 @@ void dump( const void * const pMemory, int size, byte *pShow = 0 ) ;
 // the pShow optional parameter, if non-zero, causes a different address
 // (e.g., a device address) to be displayed.
 //
+// The lines are formatted from tables, a chunk at a time, and written to
+// stdout (after anything printf has buffered) in a few large writes.
+//
 
 void dump( const void * const pMemory, int size, byte *pShow )
 {
-   byte *pMem = (byte *)( (unsigned long)pMemory & 0xfffffffffffffff0 ) ;
-   byte *p ;
-   const int dataBytesDisplayedPerLine = 16 ;
-   const int LOG_LINE_SIZE = 133 ;
-   char logline[ LOG_LINE_SIZE ] ;
+   fflush( stdout ) ;
+   dumpToFd( 1, pMemory, size, pShow, false ) ;
+}
 
-   // See if the display start address is different from the actual memory
-   // address.
-   if ( pShow == 0 )
-   {
-      // We'll display the actual memory address.
-      pShow = pMem ;
-   }
-   // Show the header and a blank line.  Then clear out the cout buffer so
-   // printf output will come out at the right time.
-   printf( "\n               0 1 2 3  4 5 6 7  8 9 a b  c d e f  " ) ;
-   printf( "0123 4567 89ab cdef\n\n" );
-   for ( ; pMem < (byte *)pMemory + size; pMem += dataBytesDisplayedPerLine,
-                                         pShow += dataBytesDisplayedPerLine )
-   {
-      // Show the memory address and the hex values.
-      printf( "%12lx  ", (unsigned long)pShow ) ;
-      for ( p = pMem; p < pMem + dataBytesDisplayedPerLine; p++ )
-      {
-         if ( p - pMem == 4 || p - pMem == 8 || p - pMem == 12 )
-         {
-            printf( " " ) ;
-         }
+////////////////////////////////////////////////////////////////////////////////
+//
+// dumpToBuffer
+//
+// Formats the dump of dump() (collapsing repeated lines to "*" if collapse)
+// into buffer, as much as fits, unterminated, and returns the length of the
+// whole dump, as snprintf does.
+//
 
-         if ( ( p >= pMemory ) && ( p < (byte *)pMemory + size ) )
-         {
-            printf( "%02x", *p ) ;
-         }
-         else
-         {
-            printf( "  " ) ;
-         }
-      }
-      printf( "  " ) ;
+size_t dumpToBuffer( const void * const pMemory, int size, char *buffer,
+                     size_t bufferSize, byte *pShow, bool collapse )
+{
+   DumpWriter out( buffer, buffer ? bufferSize : 0 ) ;
 
-      // Show the character values.
-      for ( p = pMem; p < pMem + dataBytesDisplayedPerLine; p++ )
-      {
-         if ( p - pMem == 4 || p - pMem == 8 || p - pMem == 12 )
-         {
-            printf( " " ) ;
-         }
+   DumpTo( out, pMemory, size, pShow, collapse ) ;
+   return out.bytes ;
+}
 
-         if ( ( p >= pMemory ) && ( p < (byte *)pMemory + size ) )
-         {
-            if ( *p < 0x20 )
-            {
-               printf( "." ) ;
-            }
-            else
-            {
-               printf( "%c", *p ) ;
-            }
-         }
-         else
-         {
-            printf( " " ) ;
-         }
-      }
+////////////////////////////////////////////////////////////////////////////////
+//
+// dumpToFd
+//
+// Writes the dump of dump() (collapsing repeated lines to "*" if collapse)
+// to fd, in chunks of 16 KB formatted on the stack, so that it allocates
+// nothing and calls only write(), as when capturing the CSA on a fault.
+// Returns false if a write fails.
+//
 
-      // Go to the next line of the dump.
-      printf( "\n" ) ;
-   }
+bool dumpToFd( int fd, const void * const pMemory, int size, byte *pShow,
+               bool collapse )
+{
+   char chunk[DUMP_CHUNK_BYTES] ;
+   DumpWriter out( fd, chunk, sizeof( chunk ) ) ;
 
-   // Finish with a blank line.
-   printf( "\n" ) ;
+   DumpTo( out, pMemory, size, pShow, collapse ) ;
+   return out.Flush() ;
 }
@@ -20,13 +20,19 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
 // DEALINGS IN THE SOFTWARE.
 
+#include <algorithm>
 #include <iostream>
 #include <stdlib.h>              // for "exit" in Cygwin
-#include "histo.h"
-
-#ifdef THE_TEST_BUILD
-unsigned int RRTGetTime( void ) ;
-#endif // def THE_TEST_BUILD
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#if defined( __SSE4_1__ )
+#include <smmintrin.h>
+#endif
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+#include "histoclk.h"
+#include "histoshm.h"          // includes histo.h
 
 typedef unsigned char byte;
 
@@ -35,19 +41,29 @@ typedef unsigned char byte;
 using namespace std ;
 
 // Standard constructor defining the range and resolution of the distribution.
-Histogram::Histogram( unsigned int min, unsigned int countsPer, int bins )
+template <typename T>
+BasicHistogram<T>::BasicHistogram( T min, T countsPer, int bins )
 {
-   const int extraSpace = 16 ; // ints == 64 bytes surrounding guard region
+   const int extraSpace = 16 ; // counts surrounding guard region
    minBin = min ;
    countsPerBin = countsPer ;
    nBins = bins ;
-   minData = min + countsPer * bins ;
-   maxData = min ;
+   significantDigits = subBucketBits = 0 ;
+   SetReciprocal() ;
+   cumulative = NULL ;
+   cumulativeValid = false ;
+   segment = NULL ;
+   segmentName = NULL ;
+   EmptySummary() ;
    maxFreq = 0 ;
    n = 0 ;
    summation = 0.0 ;
+   largest = NULL ;
+   sample = NULL ;
+   overSeen = 0 ;
+   TrackOutliers( OVERN_TRACE_COUNT ) ;
 
-   binVectorArea = new unsigned int[bins + 2 + extraSpace] ;
+   binVectorArea = new T[bins + 2 + extraSpace] ;
    if ( binVectorArea == NULL )
    {
       std::cout << "Histogram memory allocation failure" << std::endl ;
@@ -61,88 +77,659 @@ Histogram::Histogram( unsigned int min, unsigned int countsPer, int bins )
          binVector[i] = 0 ;
       }
    }
-   for ( int i = 0; i < OVERN_TRACE_COUNT; i++)
+}
+
+// Log-linear constructor for a distribution of the whole range of values.
+template <typename T>
+BasicHistogram<T>::BasicHistogram( LogLinear, int significantDigits )
+{
+   const int extraSpace = 16 ; // counts surrounding guard region
+   unsigned long long range = 2 ;
+
+   if ( significantDigits < 1 || significantDigits > 5 )
+   {
+      std::cout << "Histogram significant digits out of range" << std::endl ;
+      exit( 1 ) ;
+   }
+   this->significantDigits = significantDigits ;
+   cumulative = NULL ;
+   cumulativeValid = false ;
+   segment = NULL ;
+   segmentName = NULL ;
+   for ( int i = 0; i < significantDigits; i++ )
+   {
+      range *= 10 ;
+   }
+   subBucketBits = 1 ;
+   while ( ( 1ULL << subBucketBits ) < range )
+   {
+      ++subBucketBits ;
+   }
+   minBin = 0 ;
+   countsPerBin = 1 ;
+   SetReciprocal() ;
+   nBins = ( 66 - subBucketBits ) << ( subBucketBits - 1 ) ;
+   EmptySummary() ;
+   maxFreq = 0 ;
+   n = 0 ;
+   summation = 0.0 ;
+   largest = NULL ;
+   sample = NULL ;
+   overSeen = 0 ;
+   TrackOutliers( OVERN_TRACE_COUNT ) ;
+
+   binVectorArea = new T[nBins + 2 + extraSpace] ;
+   binVector = binVectorArea + extraSpace / 2 ;
+   for ( unsigned int i = 0; i < nBins + 2; ++i )
    {
-      overN[i] = 0 ;
+      binVector[i] = 0 ;
    }
 }
 
-// Routine to reset a distribution to its empty state.
-void Histogram::Reset()
+// Routine to set the least and greatest values of an empty distribution:  the
+// top and bottom of its range.  Add and AddN update them independently, so
+// the first value lowers the one and raises the other.
+template <typename T>
+void BasicHistogram<T>::EmptySummary( )
 {
-   minData = minBin + countsPerBin * nBins ;
+   minData = subBucketBits ? ~(T) 0 : minBin + countsPerBin * nBins ;
    maxData = minBin ;
+}
+
+// Routine to reset a distribution to its empty state.
+template <typename T>
+void BasicHistogram<T>::Reset()
+{
+   BeginWrite() ;
+   EmptySummary() ;
    maxFreq = 0 ;
    n = 0 ;
    summation = 0.0 ;
+   cumulativeValid = false ;
    for ( unsigned int i = 0; i < nBins + 2; ++i )
    {
       binVector[i] = 0 ;
    }
-   for ( int i = 0; i < OVERN_TRACE_COUNT; i++)
-   {
-      overN[i] = 0 ;
-   }
+   largestCount = 0 ;
+   largestChanged = true ;
+   sampleCount = 0 ;
+   overSeen = 0 ;
+   EndWrite() ;
 }
 
 // (Virtual) destructor to release storage allocated by the instance.
-Histogram::~Histogram()
+template <typename T>
+BasicHistogram<T>::~BasicHistogram()
 {
+   Unexport() ;
    delete[] binVectorArea ;
+   delete[] cumulative ;
+   delete[] largest ;
+   delete[] sample ;
 }
 
-// Routine to add data to the distribution.
-void Histogram::Add( unsigned int data )
+// Routine to set up the division by countsPerBin (see BinOf).
+template <typename T>
+void BasicHistogram<T>::SetReciprocal( )
 {
-   unsigned int targetBin = 0 ;
+   int log2 = 0 ;
 
-   if ( data >= minBin )
+   if ( countsPerBin == 0 )
+   {
+      std::cout << "Histogram counts per bin must be at least 1" << std::endl ;
+      exit( 1 ) ;
+   }
+   while ( log2 < 64 && ( 1ULL << log2 ) < (unsigned long long) countsPerBin )
    {
-      targetBin = ( data - minBin ) / (unsigned int) countsPerBin + 1 ;
+      ++log2 ;
    }
-   if ( targetBin > nBins )
+   binShift = log2 < 64 && ( 1ULL << log2 ) == (unsigned long long) countsPerBin 
+              ? log2 : -1 ;
+   binMultiplier = 0 ;
+   binPostShift = 0 ;
+   if ( binShift < 0 && log2 <= 32 )
    {
-      targetBin = nBins + 1 ;
+      // m = 2^32 * (2^l - d) / d + 1, for l = ceil( log2( d ) ) > 1.
+      binMultiplier = (uint32_t)( ( ( ( 1ULL << log2 ) - countsPerBin ) << 32 ) 
+                                  / countsPerBin + 1 ) ;
+      binPostShift = log2 - 1 ;
+   }
+}
+
+// Function returning the clock outliers are timed by, which is set up on the
+// first use, so a histogram constructed statically may time its outliers.
+static const IntervalClock &OutlierClock( )
+{
+   static const IntervalClock clock ;
+
+   return clock ;
+}
+
+// Function returning the next value of a xorshift generator.
+static unsigned long long NextRandom( unsigned long long &state )
+{
+   state ^= state << 13 ;
+   state ^= state >> 7 ;
+   state ^= state << 17 ;
+   return state ;
+}
+
+// Routine to set how many of the largest values and Over values are kept.
+template <typename T>
+void BasicHistogram<T>::TrackOutliers( int largest, int overSample )
+{
+   delete[] this->largest ;
+   delete[] sample ;
+   largestCapacity = largest > 0 ? largest : 0 ;
+   sampleCapacity = overSample > 0 ? overSample : 0 ;
 
-      // Capture up to 10 indices where values are Over.
-      for ( int i = 0; i < OVERN_TRACE_COUNT; i++ )
+   // With no room, the root stays greater than any value, so IsLargest fails.
+   this->largest = new Outlier[largestCapacity ? largestCapacity : 1] ;
+   this->largest[0].value = ~(T) 0 ;
+   largestCount = 0 ;
+   largestChanged = true ;
+   sample = sampleCapacity ? new Outlier[sampleCapacity] : NULL ;
+   sampleCount = 0 ;
+   sampleRandom = 0x9E3779B97F4A7C15ULL ;
+}
+
+// Routine to keep a value among the largest, replacing the least of them
+// once there are largestCapacity.
+template <typename T>
+void BasicHistogram<T>::NoteLargest( const Outlier &outlier )
+{
+   int at ;
+
+   if ( largestCount < largestCapacity )
+   {
+      // Sift up from the new leaf.
+      at = largestCount++ ;
+      while ( at > 0 && largest[( at - 1 ) / 2].value > outlier.value )
+      {
+         largest[at] = largest[( at - 1 ) / 2] ;
+         at = ( at - 1 ) / 2 ;
+      }
+   }
+   else
+   {
+      // Sift down from the root, which is replaced.
+      at = 0 ;
+      for ( ;; )
       {
-         if ( !overN[i] )
+         int child = 2 * at + 1 ;
+
+         if ( child >= largestCount )
+         {
+            break ;
+         }
+         if ( child + 1 < largestCount 
+              && largest[child + 1].value < largest[child].value )
+         {
+            ++child ;
+         }
+         if ( largest[child].value >= outlier.value )
          {
-            overN[i]      = n + 1 ; /* n hasn't been updated yet */
-            overValueN[i] = data ;
-            #ifdef THE_TEST_BUILD
-            overTSN[i]    = RRTGetTime() ;
-            #else
-            overTSN[i]    = 0 ;
-            #endif // def THE_TEST_BUILD
             break ;
          }
+         largest[at] = largest[child] ;
+         at = child ;
+      }
+   }
+   largest[at] = outlier ;
+   largestChanged = true ;
+}
+
+// Routine to count an Over value, keeping each of them in the sample with
+// equal probability (Vitter's algorithm R).
+template <typename T>
+void BasicHistogram<T>::NoteOver( T index, T data )
+{
+   int at = sampleCount ;
+
+   ++overSeen ;
+   if ( sampleCapacity == 0 )
+   {
+      return ;
+   }
+   if ( sampleCount < sampleCapacity )
+   {
+      ++sampleCount ;
+   }
+   else
+   {
+      unsigned long long pick = NextRandom( sampleRandom ) % overSeen ;
+
+      if ( pick >= (unsigned long long) sampleCapacity )
+      {
+         return ;
+      }
+      at = (int) pick ;
+   }
+   sample[at].index = index ;
+   sample[at].value = data ;
+   sample[at].timeNs = OutlierClock().Ns() ;
+}
+
+// Routine to note a point, with its bin, as an outlier if it is one.
+template <typename T>
+inline void BasicHistogram<T>::NoteOutliers( T index, T data, unsigned int bin )
+{
+   if ( IsLargest( data ) )
+   {
+      Outlier outlier = { index, data, OutlierClock().Ns() } ;
+
+      NoteLargest( outlier ) ;
+   }
+   if ( bin > nBins )
+   {
+      NoteOver( index, data ) ;
+   }
+}
+
+// Function storing the largest values, greatest first.
+template <typename T>
+int BasicHistogram<T>::Outliers( Outlier *out, int max ) const
+{
+   int count = 0 ;
+
+   // Insert each into out, which holds the greatest so far, in order.
+   for ( int i = 0; i < largestCount; i++ )
+   {
+      int at ;
+
+      if ( count < max )
+      {
+         at = count++ ;
+      }
+      else if ( max > 0 && largest[i].value > out[max - 1].value )
+      {
+         at = max - 1 ;
+      }
+      else
+      {
+         continue ;
+      }
+      while ( at > 0 && out[at - 1].value < largest[i].value )
+      {
+         out[at] = out[at - 1] ;
+         --at ;
       }
+      out[at] = largest[i] ;
+   }
+   return count ;
+}
+
+// Function storing the sample of Over values.
+template <typename T>
+int BasicHistogram<T>::OverSample( Outlier *out, int max ) const
+{
+   int count = sampleCount < max ? sampleCount : max ;
+
+   for ( int i = 0; i < count; i++ )
+   {
+      out[i] = sample[i] ;
+   }
+   return count < 0 ? 0 : count ;
+}
+
+// Routines to bracket changes with the sequence of the segment, if exported.
+template <typename T>
+void BasicHistogram<T>::BeginWrite( )
+{
+   if ( segment != NULL )
+   {
+      segment->BeginWrite() ;
    }
-   if ( ++binVector[targetBin] > maxFreq )
+}
+
+template <typename T>
+void BasicHistogram<T>::EndWrite( )
+{
+   if ( segment != NULL )
    {
-      maxFreq = binVector[targetBin] ;
+      segment->n = n ;
+      segment->minData = minData ;
+      segment->maxData = maxData ;
+      segment->summation = summation ;
+      segment->overSeen = overSeen ;
+      if ( largestChanged )
+      {
+         Outlier greatest[HISTOGRAM_SEGMENT_OUTLIERS] ;
+         int count = Outliers( greatest, HISTOGRAM_SEGMENT_OUTLIERS ) ;
+
+         for ( int i = 0; i < count; i++ )
+         {
+            segment->largest[i].index = greatest[i].index ;
+            segment->largest[i].value = greatest[i].value ;
+            segment->largest[i].timeNs = greatest[i].timeNs ;
+         }
+         segment->largestCount = count ;
+         largestChanged = false ;
+      }
+      segment->EndWrite() ;
    }
+}
+
+// Routine to add data to the distribution.
+template <typename T>
+void BasicHistogram<T>::Add( T data )
+{
+   unsigned int targetBin = BinOf( data ) ;
+
+   BeginWrite() ;
+   NoteOutliers( n + 1, data, targetBin ) ; /* n hasn't been updated yet */
+   ++binVector[targetBin] ;
    summation += double( data ) ;
    ++n ;
+   cumulativeValid = false ;
 
    if ( data < minData )
    {
       minData = data ;
    }
-   else if ( data > maxData )
+   if ( data > maxData )
    {
       maxData = data ;
    }
+   EndWrite() ;
+}
+
+// Routine to add many data points:  any width, or a log-linear distribution.
+template <typename T>
+void BasicHistogram<T>::AddN( const T *data, size_t count )
+{
+   for ( size_t i = 0; i < count; i++ )
+   {
+      Add( data[i] ) ;
+   }
+}
+
+// Routine to add many data points to a linear Histogram, four at a time.
+template <>
+void BasicHistogram<uint32_t>::AddN( const uint32_t *data, size_t count )
+{
+   const size_t chunk = 1 << 20 ;      // points summed before the sum may wrap
+   uint32_t least = minData, greatest = maxData ;
+   size_t i = 0 ;
+
+   if ( subBucketBits || nBins == 0 )
+   {
+      for ( ; i < count; i++ )
+      {
+         Add( data[i] ) ;
+      }
+      return ;
+   }
+   while ( i < count )
+   {
+      size_t end = count - i > chunk ? i + chunk : count ;
+      uint64_t sum = 0 ;
+
+      BeginWrite() ;
+
+      #if defined( __SSE2__ )
+      alignas( 16 ) uint32_t bins[4], lanes[4] ;
+      // Unsigned compares are signed compares of values biased by 2^31.
+      const __m128i bias = _mm_set1_epi32( (int) 0x80000000u ) ;
+      const __m128i base = _mm_set1_epi32( (int) minBin ) ;
+      const __m128i biasedBase = _mm_xor_si128( base, bias ) ;
+      const __m128i last = _mm_set1_epi32( (int)( nBins - 1 ) ^ (int) 0x80000000u ) ;
+      const __m128i multiplier = _mm_set1_epi32( (int) binMultiplier ) ;
+      const __m128i pre = _mm_cvtsi32_si128( binShift < 0 ? 1 : 0 ) ;
+      const __m128i post = _mm_cvtsi32_si128( binShift < 0 ? binPostShift 
+                                                           : binShift ) ;
+      const __m128i one = _mm_set1_epi32( 1 ) ;
+      __m128i low = _mm_xor_si128( _mm_set1_epi32( (int) least ), bias ) ;
+      __m128i high = _mm_xor_si128( _mm_set1_epi32( (int) greatest ), bias ) ;
+      __m128i sums = _mm_setzero_si128() ;
+
+      for ( ; i + 4 <= end; i += 4 )
+      {
+         __m128i x = _mm_loadu_si128( (const __m128i *)( data + i ) ) ;
+         __m128i biased = _mm_xor_si128( x, bias ) ;
+         __m128i offset = _mm_sub_epi32( x, base ) ;
+         __m128i q = offset ;
+
+         #if defined( __SSE4_1__ )
+         low = _mm_min_epi32( low, biased ) ;
+         high = _mm_max_epi32( high, biased ) ;
+         #else
+         __m128i below = _mm_cmplt_epi32( biased, low ) ;
+         __m128i above = _mm_cmpgt_epi32( biased, high ) ;
+
+         low = _mm_or_si128( _mm_and_si128( below, biased ), 
+                             _mm_andnot_si128( below, low ) ) ;
+         high = _mm_or_si128( _mm_and_si128( above, biased ), 
+                              _mm_andnot_si128( above, high ) ) ;
+         #endif
+         sums = _mm_add_epi64( sums, _mm_unpacklo_epi32( x, _mm_setzero_si128() ) ) ;
+         sums = _mm_add_epi64( sums, _mm_unpackhi_epi32( x, _mm_setzero_si128() ) ) ;
+
+         // q = offset / countsPerBin, by the shift or the reciprocal.
+         if ( binShift < 0 )
+         {
+            __m128i even = _mm_srli_epi64( _mm_mul_epu32( offset, multiplier ), 32 ) ;
+            __m128i odd = _mm_mul_epu32( _mm_srli_epi64( offset, 32 ), multiplier ) ;
+            __m128i t = _mm_or_si128( even, 
+                           _mm_and_si128( odd, _mm_set_epi32( -1, 0, -1, 0 ) ) ) ;
+
+            q = _mm_add_epi32( t, _mm_srl_epi32( _mm_sub_epi32( offset, t ), pre ) ) ;
+         }
+         q = _mm_srl_epi32( q, post ) ;
+
+         // Bin q + 1, or Over beyond nBins, or Under below minBin.
+         __m128i biasedQ = _mm_xor_si128( q, bias ) ;
+         __m128i over = _mm_cmpgt_epi32( biasedQ, last ) ;
+         __m128i under = _mm_cmplt_epi32( biased, biasedBase ) ;
+         __m128i bin = _mm_or_si128( _mm_andnot_si128( over, _mm_add_epi32( q, one ) ),
+                          _mm_and_si128( over, _mm_set1_epi32( (int)( nBins + 1 ) ) ) ) ;
+
+         _mm_store_si128( (__m128i *) bins, _mm_andnot_si128( under, bin ) ) ;
+         for ( int j = 0; j < 4; j++ )
+         {
+            NoteOutliers( n + j + 1, data[i + j], bins[j] ) ;
+            ++binVector[bins[j]] ;
+         }
+         n += 4 ;
+      }
+      _mm_store_si128( (__m128i *) lanes, low ) ;
+      for ( int j = 0; j < 4; j++ )
+      {
+         least = ( lanes[j] ^ 0x80000000u ) < least ? lanes[j] ^ 0x80000000u 
+                                                    : least ;
+      }
+      _mm_store_si128( (__m128i *) lanes, high ) ;
+      for ( int j = 0; j < 4; j++ )
+      {
+         greatest = ( lanes[j] ^ 0x80000000u ) > greatest ? lanes[j] ^ 0x80000000u 
+                                                          : greatest ;
+      }
+      _mm_store_si128( (__m128i *) lanes, sums ) ;
+      sum += (uint64_t) lanes[0] | (uint64_t) lanes[1] << 32 ;
+      sum += (uint64_t) lanes[2] | (uint64_t) lanes[3] << 32 ;
+      #elif defined( __ARM_NEON ) && defined( __aarch64__ )
+      alignas( 16 ) uint32_t bins[4] ;
+      const uint32x4_t base = vdupq_n_u32( minBin ) ;
+      const uint32x4_t last = vdupq_n_u32( nBins - 1 ) ;
+      const uint32x4_t multiplier = vdupq_n_u32( binMultiplier ) ;
+      const int32x4_t pre = vdupq_n_s32( binShift < 0 ? -1 : 0 ) ;
+      const int32x4_t post = vdupq_n_s32( binShift < 0 ? -binPostShift 
+                                                       : -binShift ) ;
+      uint32x4_t low = vdupq_n_u32( least ) ;
+      uint32x4_t high = vdupq_n_u32( greatest ) ;
+      uint64x2_t sums = vdupq_n_u64( 0 ) ;
+
+      for ( ; i + 4 <= end; i += 4 )
+      {
+         uint32x4_t x = vld1q_u32( data + i ) ;
+         uint32x4_t offset = vsubq_u32( x, base ) ;
+         uint32x4_t q = offset ;
+
+         low = vminq_u32( low, x ) ;
+         high = vmaxq_u32( high, x ) ;
+         sums = vpadalq_u32( sums, x ) ;
+
+         // q = offset / countsPerBin, by the shift or the reciprocal.
+         if ( binShift < 0 )
+         {
+            uint32x4_t t = vcombine_u32( 
+               vshrn_n_u64( vmull_u32( vget_low_u32( offset ), 
+                                       vget_low_u32( multiplier ) ), 32 ),
+               vshrn_n_u64( vmull_u32( vget_high_u32( offset ), 
+                                       vget_high_u32( multiplier ) ), 32 ) ) ;
+
+            q = vaddq_u32( t, vshlq_u32( vsubq_u32( offset, t ), pre ) ) ;
+         }
+         q = vshlq_u32( q, post ) ;
+
+         // Bin q + 1, or Over beyond nBins, or Under below minBin.
+         uint32x4_t bin = vbslq_u32( vcgtq_u32( q, last ), vdupq_n_u32( nBins + 1 ),
+                                     vaddq_u32( q, vdupq_n_u32( 1 ) ) ) ;
+
+         vst1q_u32( bins, vbicq_u32( bin, vcltq_u32( x, base ) ) ) ;
+         for ( int j = 0; j < 4; j++ )
+         {
+            NoteOutliers( n + j + 1, data[i + j], bins[j] ) ;
+            ++binVector[bins[j]] ;
+         }
+         n += 4 ;
+      }
+      least = vminvq_u32( low ) ;
+      greatest = vmaxvq_u32( high ) ;
+      sum += vgetq_lane_u64( sums, 0 ) + vgetq_lane_u64( sums, 1 ) ;
+      #endif
+
+      // The rest, one at a time.
+      for ( ; i < end; i++ )
+      {
+         unsigned int targetBin = BinOf( data[i] ) ;
+
+         NoteOutliers( n + 1, data[i], targetBin ) ;
+         ++binVector[targetBin] ;
+         ++n ;
+         sum += data[i] ;
+         least = data[i] < least ? data[i] : least ;
+         greatest = data[i] > greatest ? data[i] : greatest ;
+      }
+      summation += double( sum ) ;
+      minData = least ;
+      maxData = greatest ;
+      EndWrite() ;
+   }
+   cumulativeValid = false ;
+}
+
+// Routine to add the data points of another distribution.
+template <typename T>
+void BasicHistogram<T>::Merge( const BasicHistogram &other )
+{
+   if ( other.n == 0 )
+   {
+      return ;
+   }
+   BeginWrite() ;
+   for ( unsigned int i = 0; i < other.nBins + 2; ++i )
+   {
+      T count = other.binVector[i] ;
+      unsigned int targetBin = i ;
+
+      if ( !count )
+      {
+         continue ;
+      }
+      if ( !SameLayout( other ) )
+      {
+         targetBin = BinOf( i == 0 ? other.minData
+                            : i > other.nBins ? other.maxData
+                            : (T) other.BinValue( i ) ) ;
+      }
+      binVector[targetBin] += count ;
+   }
+   MergeSummary( other.n, other.minData, other.maxData, other.summation,
+                 other.largest, other.largestCount, 
+                 other.sample, other.sampleCount, other.overSeen ) ;
+   EndWrite() ;
+}
+
+// Routine to add the summary of another distribution, whose bins are added.
+template <typename T>
+void BasicHistogram<T>::MergeSummary( T otherN, T otherMin, T otherMax,
+                                      double otherSummation,
+                                      const Outlier *otherLargest,
+                                      int otherLargestCount,
+                                      const Outlier *otherSample,
+                                      int otherSampleCount,
+                                      T otherOverSeen )
+{
+   // The other's points are numbered after these.
+   for ( int i = 0; i < otherLargestCount; i++ )
+   {
+      Outlier outlier = otherLargest[i] ;
+
+      outlier.index += n ;
+      if ( IsLargest( outlier.value ) )
+      {
+         NoteLargest( outlier ) ;
+      }
+   }
+
+   // Draw the merged sample from the two, each of whose entries stands for
+   // overSeen / sampleCount Over values of its own.
+   if ( sampleCapacity && otherSampleCount )
+   {
+      Outlier *pool = new Outlier[sampleCount + otherSampleCount] ;
+      int left[2] = { sampleCount, otherSampleCount } ;
+      int first[2] = { 0, sampleCount } ;
+      double weight[2] = { sampleCount ? double( overSeen ) / sampleCount : 0.0,
+                           double( otherOverSeen ) / otherSampleCount } ;
+      double unseen[2] = { double( overSeen ), double( otherOverSeen ) } ;
+      int count = 0 ;
+
+      std::copy( sample, sample + sampleCount, pool ) ;
+      for ( int i = 0; i < otherSampleCount; i++ )
+      {
+         pool[sampleCount + i] = otherSample[i] ;
+         pool[sampleCount + i].index += n ;
+      }
+      while ( count < sampleCapacity && ( left[0] || left[1] ) )
+      {
+         double draw = ( NextRandom( sampleRandom ) >> 11 ) * 0x1.0p-53 
+                       * ( unseen[0] + unseen[1] ) ;
+         int from = !left[0] || ( left[1] && draw >= unseen[0] ) ;
+
+         // Take a random one of the rest of that sample.
+         int pick = first[from] 
+                    + (int)( NextRandom( sampleRandom ) % left[from] ) ;
+
+         sample[count++] = pool[pick] ;
+         pool[pick] = pool[first[from]++] ;
+         --left[from] ;
+         unseen[from] -= weight[from] ;
+      }
+      delete[] pool ;
+      sampleCount = count ;
+   }
+   overSeen += otherOverSeen ;
+   if ( n == 0 || otherMin < minData )
+   {
+      minData = otherMin ;
+   }
+   if ( n == 0 || otherMax > maxData )
+   {
+      maxData = otherMax ;
+   }
+   summation += otherSummation ;
+   n += otherN ;
+   cumulativeValid = false ;
 }
 
 // Accessor function to return the current mean (average) value.
-double Histogram::MeanValue( ) const
+template <typename T>
+double BasicHistogram<T>::MeanValue( ) const
 {
    if ( n > 0 )
    {
-      return summation / int( n ) ;
+      return summation / double( n ) ;
    }
    else
    {
@@ -152,7 +739,8 @@ double Histogram::MeanValue( ) const
 
 // Accessor function to return the number of data points that have accumulated
 // in the specified bin.
-unsigned int Histogram::BinCount( int binNumber ) const
+template <typename T>
+T BasicHistogram<T>::BinCount( int binNumber ) const
 {
    if ( (binNumber >= 0) && ((unsigned int) binNumber <= nBins + 1) )
    {
@@ -164,6 +752,126 @@ unsigned int Histogram::BinCount( int binNumber ) const
    }
 }
 
+// Accessor function to return the lowest value going into the specified bin.
+template <typename T>
+unsigned long long BasicHistogram<T>::BinValue( int binNumber ) const
+{
+   if ( binNumber <= 0 )
+   {
+      return 0 ;
+   }
+   if ( subBucketBits )
+   {
+      // Undo LogBin:  the bins after the first 2^b come in runs of 2^(b - 1).
+      int half = subBucketBits - 1 ;
+      int bucket = ( ( binNumber - 1 ) >> half ) - 1 ;
+      unsigned long long subBucket = ( ( binNumber - 1 ) & ( ( 1 << half ) - 1 ) ) 
+                                     + ( 1ULL << half ) ;
+
+      if ( bucket < 0 )
+      {
+         bucket = 0 ;
+         subBucket -= 1ULL << half ;
+      }
+      return subBucket << bucket ;
+   }
+   return minBin + (unsigned long long)countsPerBin * ( binNumber - 1 ) ;
+}
+
+// Routine to rebuild the cumulative counts and the largest bin count, if an Add
+// has outdated them.
+template <typename T>
+void BasicHistogram<T>::IndexCounts( ) const
+{
+   T sum = 0 ;
+
+   if ( cumulativeValid )
+   {
+      return ;
+   }
+   if ( cumulative == NULL )
+   {
+      cumulative = new T[nBins + 2] ;
+   }
+   maxFreq = 0 ;
+   for ( unsigned int i = 0; i < nBins + 2; ++i )
+   {
+      sum += binVector[i] ;
+      cumulative[i] = sum ;
+      maxFreq = binVector[i] > maxFreq ? binVector[i] : maxFreq ;
+   }
+   cumulativeValid = true ;
+}
+
+// Accessor function to return the value at a percentile of the data points.
+template <typename T>
+unsigned long long BasicHistogram<T>::ValueAtPercentile( double percentile ) const
+{
+   unsigned long long value ;
+   T rank ;
+   int low = 0, high = nBins + 1 ;
+
+   if ( n == 0 )
+   {
+      return 0 ;
+   }
+   IndexCounts() ;
+
+   // The rank of the data point at the percentile, counting from 1.
+   rank = percentile <= 0.0 ? 1
+        : percentile >= 100.0 ? n
+        : (T)( percentile / 100.0 * n + 0.999999 ) ;
+   if ( rank < 1 )
+   {
+      rank = 1 ;
+   }
+
+   // Find the first bin whose cumulative count reaches the rank.
+   while ( low < high )
+   {
+      int middle = ( low + high ) / 2 ;
+
+      if ( cumulative[middle] >= rank )
+      {
+         high = middle ;
+      }
+      else
+      {
+         low = middle + 1 ;
+      }
+   }
+   if ( low == 0 )
+   {
+      return minData ;
+   }
+   if ( (unsigned int) low > nBins )
+   {
+      return maxData ;
+   }
+   value = BinValue( low + 1 ) - 1 ;
+   if ( value > maxData )
+   {
+      value = maxData ;
+   }
+   if ( value < minData )
+   {
+      value = minData ;
+   }
+   return value ;
+}
+
+// Routine to find the values at several percentiles, with one index.
+template <typename T>
+void BasicHistogram<T>::ValuesAtPercentiles( const double *percentiles,
+                                             unsigned long long *values,
+                                             int count ) const
+{
+   for ( int i = 0; i < count; i++ )
+   {
+      values[i] = ValueAtPercentile( percentiles[i] ) ;
+   }
+}
+
 // Routine to display the current status of each bin in the distribution to
 // an output stream.
 //void Histogram::Display( ostream &os ) const {
@@ -175,4 +883,8 @@ unsigned int Histogram::BinCount( int binNumber ) const
 //    thisBin += countsPerBin ;
 // }
 // os << "over," << binVector[ nBins + 1 ] << endl ;
-//}
\ No newline at end of file
+//}
+
+// The widths provided.
+template class BasicHistogram<uint32_t> ;
+template class BasicHistogram<uint64_t> ;
@@ -0,0 +1,103 @@
+// histoclk.cpp -- interval clock
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#endif
+#include "histoclk.h"
+
+unsigned long long IntervalClock::virtualNs = 0 ;
+
+// Standard constructor choosing the source, and its factor.
+IntervalClock::IntervalClock( ClockSource clockSource )
+{
+   source = monotonicClock ;
+   nsPerTick = MonotonicScale() ;
+   if ( clockSource == tscClock && TscScale() )
+   {
+      source = tscClock ;
+      nsPerTick = TscScale() ;
+   }
+   else if ( clockSource == virtualClock )
+   {
+      source = virtualClock ;
+      nsPerTick = 1ULL << 32 ;
+   }
+}
+
+// Function returning the factor of the monotonic clock.
+unsigned long long IntervalClock::MonotonicScale( )
+{
+   #if defined( __APPLE__ ) && defined( __MACH__ )
+   static const unsigned long long scale = []
+   {
+      mach_timebase_info_data_t timebase ;
+
+      mach_timebase_info( &timebase ) ;
+      return ( (unsigned long long) timebase.numer << 32 ) / timebase.denom ;
+   }() ;
+
+   return scale ;
+   #else
+   return 1ULL << 32 ;
+   #endif
+}
+
+// Function returning the factor of the time-stamp counter, measured once
+// against the monotonic clock; 0 if there is no invariant counter.
+unsigned long long IntervalClock::TscScale( )
+{
+   #if defined( __x86_64__ ) || defined( __i386__ )
+   static const unsigned long long scale = []
+   {
+      unsigned int eax, ebx, ecx, edx ;
+
+      // CPUID leaf 0x80000007 reports an invariant counter in bit 8 of EDX.
+      if ( !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) 
+           || !( edx & ( 1u << 8 ) ) )
+      {
+         return 0ULL ;
+      }
+      IntervalClock monotonic ;
+      unsigned long long ns0 = monotonic.Ns() ;
+      unsigned long long tsc0 = __rdtsc() ;
+      unsigned long long ns1, tsc1 ;
+
+      do
+      {
+         ns1 = monotonic.Ns() ;
+         tsc1 = __rdtsc() ;
+      } while ( ns1 - ns0 < 10000000ULL ) ;
+      if ( tsc1 <= tsc0 )
+      {
+         return 0ULL ;
+      }
+      return (unsigned long long)( (long double)( ns1 - ns0 ) * 4294967296.0L 
+                                   / ( tsc1 - tsc0 ) ) ;
+   }() ;
+
+   return scale ;
+   #else
+   return 0 ;
+   #endif
+}
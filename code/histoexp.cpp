@@ -0,0 +1,360 @@
+// histoexp.cpp -- Histogram text exporters
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "histo.h"
+
+// Size of the chunks written to an fd.
+static const size_t EXPORT_CHUNK_BYTES = 8192 ;
+
+// Appends text to a buffer, counting the bytes that didn't fit, or to a chunk
+// that is written to an fd whenever it fills.
+class TextWriter
+{
+  public:
+   TextWriter( char *buffer, size_t size ) 
+             : at( buffer ), start( buffer ), end( buffer + size ), fd( -1 ), 
+               bytes( 0 ), ok( true ) { }
+   TextWriter( int fd ) 
+             : at( chunk ), start( chunk ), end( chunk + sizeof( chunk ) ), 
+               fd( fd ), bytes( 0 ), ok( true ) { }
+
+   void Text( const char *text, size_t length )
+   {
+      bytes += length ;
+      if ( length && length <= (size_t)( end - at ) )
+      {
+         memcpy( at, text, length ) ;
+         at += length ;
+         return ;
+      }
+      while ( length > 0 )
+      {
+         size_t room = end - at ;
+
+         if ( room == 0 )
+         {
+            if ( fd < 0 || !Flush() )
+            {
+               return ;
+            }
+            room = end - at ;
+         }
+         room = room < length ? room : length ;
+         memcpy( at, text, room ) ;
+         at += room ;
+         text += room ;
+         length -= room ;
+      }
+   }
+
+   void Text( const char *text ) { Text( text, strlen( text ) ) ; }
+
+   // Decimal digits are converted two at a time.
+   void Unsigned( unsigned long long value )
+   {
+      static const char pairs[] = 
+         "0001020304050607080910111213141516171819202122232425262728293031323334"
+         "3536373839404142434445464748495051525354555657585960616263646566676869"
+         "707172737475767778798081828384858687888990919293949596979899" ;
+      char digits[24] ;
+      char *first = digits + sizeof( digits ) ;
+
+      while ( value >= 100 )
+      {
+         const char *pair = &pairs[2 * ( value % 100 )] ;
+
+         value /= 100 ;
+         *--first = pair[1] ;
+         *--first = pair[0] ;
+      }
+      if ( value >= 10 )
+      {
+         *--first = pairs[2 * value + 1] ;
+         *--first = pairs[2 * value] ;
+      }
+      else
+      {
+         *--first = (char)( '0' + value ) ;
+      }
+      Text( first, digits + sizeof( digits ) - first ) ;
+   }
+
+   // Integral sums (the usual ones) are written as integers.
+   void Double( double value )
+   {
+      char text[32] ;
+
+      if ( value >= 0.0 && value < 9007199254740992.0 
+           && value == (double)(unsigned long long) value )
+      {
+         Unsigned( (unsigned long long) value ) ;
+         return ;
+      }
+      snprintf( text, sizeof( text ), "%.17g", value ) ;
+      Text( text ) ;
+   }
+
+   // Function to write the text an fd's chunk holds, returning false (and
+   // stopping the writer) if it can't be.
+   bool Flush( )
+   {
+      const char *from = start ;
+
+      while ( ok && from < at )
+      {
+         ssize_t wrote = write( fd, from, at - from ) ;
+
+         if ( wrote < 0 && errno == EINTR )
+         {
+            continue ;
+         }
+         ok = wrote > 0 ;
+         from += ok ? wrote : 0 ;
+      }
+      at = start ;
+      return ok ;
+   }
+
+   char *at, *start, *end ;
+   int fd ;
+   size_t bytes ;
+   bool ok ;
+   char chunk[EXPORT_CHUNK_BYTES] ;
+};
+
+// Function to write a name as a JSON or CSV string, quoted, with the
+// characters that need it escaped.
+static void QuotedName( TextWriter &out, const char *name, bool json )
+{
+   const char *from = name ;
+
+   out.Text( "\"", 1 ) ;
+   for ( const char *c = name; *c; c++ )
+   {
+      if ( *c == '"' || ( json && ( *c == '\\' || (unsigned char) *c < 0x20 ) ) )
+      {
+         out.Text( from, c - from ) ;
+         if ( !json )
+         {
+            out.Text( "\"\"", 2 ) ;       // CSV doubles a quote
+         }
+         else if ( (unsigned char) *c < 0x20 )
+         {
+            char escape[8] ;
+
+            snprintf( escape, sizeof( escape ), "\\u%04x", (unsigned char) *c ) ;
+            out.Text( escape, 6 ) ;
+         }
+         else
+         {
+            out.Text( "\\", 1 ) ;
+            out.Text( c, 1 ) ;
+         }
+         from = c + 1 ;
+      }
+   }
+   out.Text( from, strlen( from ) ) ;
+   out.Text( "\"", 1 ) ;
+}
+
+// Routine to write the distribution as text, in one pass over the bins.
+template <typename T>
+void BasicHistogram<T>::WriteTextTo( TextFormat format, const char *name,
+                                     TextWriter &out ) const
+{
+   const char *labels = strchr( name, '{' ) ;
+   size_t baseLength = labels ? labels - name : strlen( name ) ;
+   size_t labelsLength = 0 ;
+   unsigned long long cumulative = 0 ;
+   bool first = true ;
+
+   // A Prometheus name may carry labels, as in name{worker="3"}, which are
+   // put before le on each bucket.
+   if ( labels != NULL )
+   {
+      labels++ ;
+      labelsLength = strlen( labels ) ;
+      labelsLength -= labelsLength && labels[labelsLength - 1] == '}' ;
+   }
+   switch ( format )
+   {
+   case prometheusText :
+      out.Text( "# TYPE " ) ;
+      out.Text( name, baseLength ) ;
+      out.Text( " histogram\n" ) ;
+      break ;
+   case jsonText :
+      out.Text( "{\"name\":" ) ;
+      QuotedName( out, name, true ) ;
+      out.Text( ",\"n\":" ) ;
+      out.Unsigned( n ) ;
+      out.Text( ",\"min\":" ) ;
+      out.Unsigned( n ? minData : 0 ) ;
+      out.Text( ",\"max\":" ) ;
+      out.Unsigned( n ? maxData : 0 ) ;
+      out.Text( ",\"sum\":" ) ;
+      out.Double( summation ) ;
+      out.Text( ",\"bins\":[" ) ;
+      break ;
+   case csvText :
+      out.Text( "name,lower,upper,count,cumulative\n" ) ;
+      break ;
+   }
+
+   // Each bin that isn't empty, with its least and greatest values.  A linear
+   // distribution has every bin up to Over (and Under, unless minBin is 0),
+   // so that its buckets are the same from one scrape to the next.
+   for ( unsigned int i = 0; i <= nBins + 1; i++ )
+   {
+      unsigned long long count = binVector[i] ;
+      unsigned long long lower = BinValue( i ) ;
+      unsigned long long upper = i == 0 ? (unsigned long long) minBin - 1
+                               : i > nBins ? (unsigned long long) maxData
+                               : i == nBins && subBucketBits ? ~0ULL
+                               : BinValue( i + 1 ) - 1 ;
+
+      cumulative += count ;
+      if ( count == 0 
+           && ( subBucketBits || ( i == 0 && minBin == 0 ) || i > nBins ) )
+      {
+         continue ;
+      }
+      switch ( format )
+      {
+      case prometheusText :
+         if ( i > nBins )
+         {
+            break ;                     // counted by +Inf
+         }
+         out.Text( name, baseLength ) ;
+         out.Text( "_bucket{" ) ;
+         if ( labelsLength )
+         {
+            out.Text( labels, labelsLength ) ;
+            out.Text( ",", 1 ) ;
+         }
+         out.Text( "le=\"" ) ;
+         out.Unsigned( upper ) ;
+         out.Text( "\"} " ) ;
+         out.Unsigned( cumulative ) ;
+         out.Text( "\n", 1 ) ;
+         break ;
+      case jsonText :
+         out.Text( first ? "[" : ",[", first ? 1 : 2 ) ;
+         out.Unsigned( lower ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( upper ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( count ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( cumulative ) ;
+         out.Text( "]", 1 ) ;
+         break ;
+      case csvText :
+         QuotedName( out, name, false ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( lower ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( upper ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( count ) ;
+         out.Text( ",", 1 ) ;
+         out.Unsigned( cumulative ) ;
+         out.Text( "\n", 1 ) ;
+         break ;
+      }
+      first = false ;
+   }
+   switch ( format )
+   {
+   case prometheusText :
+      out.Text( name, baseLength ) ;
+      out.Text( "_bucket{" ) ;
+      if ( labelsLength )
+      {
+         out.Text( labels, labelsLength ) ;
+         out.Text( ",", 1 ) ;
+      }
+      out.Text( "le=\"+Inf\"} " ) ;
+      out.Unsigned( cumulative ) ;
+      out.Text( "\n", 1 ) ;
+      out.Text( name, baseLength ) ;
+      out.Text( "_sum" ) ;
+      if ( labelsLength )
+      {
+         out.Text( labels - 1, labelsLength + 2 ) ;
+      }
+      out.Text( " ", 1 ) ;
+      out.Double( summation ) ;
+      out.Text( "\n", 1 ) ;
+      out.Text( name, baseLength ) ;
+      out.Text( "_count" ) ;
+      if ( labelsLength )
+      {
+         out.Text( labels - 1, labelsLength + 2 ) ;
+      }
+      out.Text( " ", 1 ) ;
+      out.Unsigned( n ) ;
+      out.Text( "\n", 1 ) ;
+      break ;
+   case jsonText :
+      out.Text( "]}\n" ) ;
+      break ;
+   case csvText :
+      break ;
+   }
+}
+
+// Routine to write the text into a buffer.
+template <typename T>
+size_t BasicHistogram<T>::WriteText( TextFormat format, const char *name,
+                                     char *buffer, size_t size ) const
+{
+   TextWriter out( buffer, buffer != NULL ? size : 0 ) ;
+
+   WriteTextTo( format, name, out ) ;
+   return out.bytes ;
+}
+
+// Routine to write the text to an fd.
+template <typename T>
+bool BasicHistogram<T>::WriteText( TextFormat format, const char *name, 
+                                   int fd ) const
+{
+   TextWriter out( fd ) ;
+
+   WriteTextTo( format, name, out ) ;
+   return out.Flush() ;
+}
+
+template size_t BasicHistogram<uint32_t>::WriteText( TextFormat, const char *,
+                                                     char *, size_t ) const ;
+template size_t BasicHistogram<uint64_t>::WriteText( TextFormat, const char *,
+                                                     char *, size_t ) const ;
+template bool BasicHistogram<uint32_t>::WriteText( TextFormat, const char *,
+                                                   int ) const ;
+template bool BasicHistogram<uint64_t>::WriteText( TextFormat, const char *,
+                                                   int ) const ;
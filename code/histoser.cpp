@@ -0,0 +1,432 @@
+// histoser.cpp -- Histogram binary snapshots
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <string.h>
+#include <vector>
+#include "histoshm.h"            // includes histo.h, for BeginWrite/EndWrite
+
+// A snapshot:  "SCH" and the version, then as varints the significant digits,
+// minBin, countsPerBin, nBins, n, minData and maxData, the summation as the 8
+// little-endian bytes of the double, the number of Over values, the capacity
+// and count of the largest values and each one's index, value and time, the
+// same for the sample of Over values, the number of bins that aren't empty,
+// and each one's gap after the previous one and its zigzag-encoded change of
+// count.
+static const unsigned char SNAPSHOT_MAGIC[4] = { 'S', 'C', 'H', 2 } ;
+
+// Limits on the bins and outliers of a snapshot, against malformed input.
+static const unsigned long long SNAPSHOT_MAX_BINS = 1ULL << 26 ;
+static const unsigned long long SNAPSHOT_MAX_OUTLIERS = 1ULL << 16 ;
+
+// Appends to a buffer, counting the bytes that didn't fit.
+class SnapshotEncoder
+{
+  public:
+   SnapshotEncoder( unsigned char *buffer, size_t size ) 
+                  : at( buffer ), end( buffer + size ), bytes( 0 ) { }
+
+   void Byte( unsigned char value )
+   {
+      if ( at != NULL && at < end )
+      {
+         *at++ = value ;
+      }
+      ++bytes ;
+   }
+
+   void Varint( unsigned long long value )
+   {
+      while ( value >= 0x80 )
+      {
+         Byte( (unsigned char)( value | 0x80 ) ) ;
+         value >>= 7 ;
+      }
+      Byte( (unsigned char) value ) ;
+   }
+
+   void Double( double value )
+   {
+      unsigned long long bits ;
+
+      memcpy( &bits, &value, sizeof( bits ) ) ;
+      for ( int i = 0; i < 8; i++ )
+      {
+         Byte( (unsigned char)( bits >> ( 8 * i ) ) ) ;
+      }
+   }
+
+   unsigned char *at, *end ;
+   size_t bytes ;
+};
+
+// Reads from a buffer, noting any overrun.
+class SnapshotDecoder
+{
+  public:
+   SnapshotDecoder( const unsigned char *buffer, size_t size ) 
+                  : at( buffer ), end( buffer + size ), ok( true ) { }
+
+   unsigned long long Varint( )
+   {
+      unsigned long long value = 0 ;
+
+      for ( int shift = 0; shift < 64; shift += 7 )
+      {
+         if ( at == end )
+         {
+            break ;
+         }
+         value |= (unsigned long long)( *at & 0x7F ) << shift ;
+         if ( !( *at++ & 0x80 ) )
+         {
+            return value ;
+         }
+      }
+      ok = false ;
+      return 0 ;
+   }
+
+   double Double( )
+   {
+      unsigned long long bits = 0 ;
+      double value ;
+
+      if ( end - at < 8 )
+      {
+         ok = false ;
+         return 0.0 ;
+      }
+      for ( int i = 0; i < 8; i++ )
+      {
+         bits |= (unsigned long long) *at++ << ( 8 * i ) ;
+      }
+      memcpy( &value, &bits, sizeof( value ) ) ;
+      return value ;
+   }
+
+   const unsigned char *at, *end ;
+   bool ok ;
+};
+
+// The fields of a snapshot before its bins.
+struct SnapshotHeader
+{
+   unsigned long long significantDigits, minBin, countsPerBin, nBins ;
+   unsigned long long n, minData, maxData ;
+   double summation ;
+   unsigned long long overSeen ;
+   struct Outliers
+   {
+      int capacity ;
+      std::vector<unsigned long long> fields ;  // index, value, time of each
+   } largest, sample ;
+   unsigned long long occupied ;
+};
+
+// Function to decode a capacity, count and list of outliers.
+static bool DecodeOutliers( SnapshotDecoder &decoder, 
+                            SnapshotHeader::Outliers &outliers,
+                            unsigned long long limit )
+{
+   unsigned long long capacity = decoder.Varint() ;
+   unsigned long long count = decoder.Varint() ;
+
+   if ( !decoder.ok || capacity > SNAPSHOT_MAX_OUTLIERS || count > capacity )
+   {
+      return false ;
+   }
+   outliers.capacity = (int) capacity ;
+   outliers.fields.resize( 3 * count ) ;
+   for ( unsigned long long i = 0; i < 3 * count; i += 3 )
+   {
+      outliers.fields[i] = decoder.Varint() ;
+      outliers.fields[i + 1] = decoder.Varint() ;
+      outliers.fields[i + 2] = decoder.Varint() ;
+      if ( !decoder.ok || outliers.fields[i] == 0 || outliers.fields[i] > limit 
+           || outliers.fields[i + 1] > limit )
+      {
+         return false ;
+      }
+   }
+   return true ;
+}
+
+// Function to make outliers of a distribution from decoded ones.
+template <typename T>
+static std::vector<typename BasicHistogram<T>::Outlier> 
+MakeOutliers( const SnapshotHeader::Outliers &outliers )
+{
+   std::vector<typename BasicHistogram<T>::Outlier> made( outliers.fields.size() / 3 ) ;
+
+   for ( size_t i = 0; i < made.size(); i++ )
+   {
+      made[i].index = (T) outliers.fields[3 * i] ;
+      made[i].value = (T) outliers.fields[3 * i + 1] ;
+      made[i].timeNs = outliers.fields[3 * i + 2] ;
+   }
+   return made ;
+}
+
+// Function to decode the fields before the bins, checking them against the
+// largest count and value, limit.
+static bool DecodeHeader( SnapshotDecoder &decoder, SnapshotHeader &header,
+                          unsigned long long limit )
+{
+   if ( decoder.end - decoder.at < 4 
+        || memcmp( decoder.at, SNAPSHOT_MAGIC, 4 ) )
+   {
+      return false ;
+   }
+   decoder.at += 4 ;
+   header.significantDigits = decoder.Varint() ;
+   header.minBin = decoder.Varint() ;
+   header.countsPerBin = decoder.Varint() ;
+   header.nBins = decoder.Varint() ;
+   header.n = decoder.Varint() ;
+   header.minData = decoder.Varint() ;
+   header.maxData = decoder.Varint() ;
+   header.summation = decoder.Double() ;
+   header.overSeen = decoder.Varint() ;
+   if ( !decoder.ok || header.significantDigits > 5
+        || header.countsPerBin == 0 || header.nBins > SNAPSHOT_MAX_BINS
+        || header.minBin > limit || header.countsPerBin > limit 
+        || header.n > limit || header.minData > limit || header.maxData > limit 
+        || header.overSeen > limit 
+        || !DecodeOutliers( decoder, header.largest, limit )
+        || !DecodeOutliers( decoder, header.sample, limit ) )
+   {
+      return false ;
+   }
+   header.occupied = decoder.Varint() ;
+   return decoder.ok && header.occupied <= header.nBins + 2 ;
+}
+
+// Function to decode the bins, calling add( bin, count ) for each that isn't
+// empty.  Returns false if they are malformed, when some may have been added.
+template <typename Add>
+static bool DecodeBins( SnapshotDecoder &decoder, const SnapshotHeader &header,
+                        unsigned long long limit, Add add )
+{
+   unsigned long long bin = 0, count = 0 ;
+
+   for ( unsigned long long i = 0; i < header.occupied; i++ )
+   {
+      unsigned long long zigzag ;
+
+      bin += decoder.Varint() ;
+      zigzag = decoder.Varint() ;
+      count += ( zigzag >> 1 ) ^ ( 0 - ( zigzag & 1 ) ) ;
+      if ( !decoder.ok || bin > header.nBins + 1 || count == 0 || count > limit )
+      {
+         return false ;
+      }
+      add( (unsigned int) bin++, count ) ;
+   }
+   return true ;
+}
+
+// Routine to write a snapshot.
+template <typename T>
+size_t BasicHistogram<T>::Serialize( unsigned char *buffer, size_t size ) const
+{
+   SnapshotEncoder encoder( buffer, size ) ;
+   unsigned long long occupied = 0, previous = 0 ;
+   int last = -1 ;
+
+   // Measure first, so that nothing is written if there isn't room.
+   if ( buffer != NULL )
+   {
+      size_t needed = Serialize( NULL, 0 ) ;
+
+      if ( needed > size )
+      {
+         return needed ;
+      }
+   }
+   for ( int i = 0; i < 4; i++ )
+   {
+      encoder.Byte( SNAPSHOT_MAGIC[i] ) ;
+   }
+   for ( unsigned int i = 0; i < nBins + 2; i++ )
+   {
+      occupied += binVector[i] != 0 ;
+   }
+   encoder.Varint( significantDigits ) ;
+   encoder.Varint( minBin ) ;
+   encoder.Varint( countsPerBin ) ;
+   encoder.Varint( nBins ) ;
+   encoder.Varint( n ) ;
+   encoder.Varint( minData ) ;
+   encoder.Varint( maxData ) ;
+   encoder.Double( summation ) ;
+   encoder.Varint( overSeen ) ;
+   encoder.Varint( largestCapacity ) ;
+   encoder.Varint( largestCount ) ;
+   for ( int i = 0; i < largestCount; i++ )
+   {
+      encoder.Varint( largest[i].index ) ;
+      encoder.Varint( largest[i].value ) ;
+      encoder.Varint( largest[i].timeNs ) ;
+   }
+   encoder.Varint( sampleCapacity ) ;
+   encoder.Varint( sampleCount ) ;
+   for ( int i = 0; i < sampleCount; i++ )
+   {
+      encoder.Varint( sample[i].index ) ;
+      encoder.Varint( sample[i].value ) ;
+      encoder.Varint( sample[i].timeNs ) ;
+   }
+   encoder.Varint( occupied ) ;
+   for ( unsigned int i = 0; i < nBins + 2; i++ )
+   {
+      if ( binVector[i] )
+      {
+         long long change = (long long)( binVector[i] - previous ) ;
+
+         encoder.Varint( i - last - 1 ) ;
+         encoder.Varint( ( (unsigned long long) change << 1 ) 
+                         ^ (unsigned long long)( change >> 63 ) ) ;
+         previous = binVector[i] ;
+         last = i ;
+      }
+   }
+   return encoder.bytes ;
+}
+
+// Routine to make a distribution from a snapshot.
+template <typename T>
+BasicHistogram<T> *BasicHistogram<T>::Deserialize( const unsigned char *buffer,
+                                                   size_t size, size_t *used )
+{
+   SnapshotDecoder decoder( buffer, size ) ;
+   SnapshotHeader header ;
+   BasicHistogram *made ;
+
+   if ( !DecodeHeader( decoder, header, (T) ~(T) 0 ) )
+   {
+      return NULL ;
+   }
+   made = header.significantDigits 
+        ? new BasicHistogram( logLinear, (int) header.significantDigits )
+        : new BasicHistogram( (T) header.minBin, (T) header.countsPerBin,
+                              (int) header.nBins ) ;
+   if ( made->nBins != header.nBins
+        || !DecodeBins( decoder, header, (T) ~(T) 0,
+                        [made]( unsigned int bin, unsigned long long count )
+                        {
+                           made->binVector[bin] = (T) count ;
+                        } ) )
+   {
+      delete made ;
+      return NULL ;
+   }
+   made->n = (T) header.n ;
+   made->minData = (T) header.minData ;
+   made->maxData = (T) header.maxData ;
+   made->summation = header.summation ;
+   made->TrackOutliers( header.largest.capacity, header.sample.capacity ) ;
+   for ( const Outlier &outlier : MakeOutliers<T>( header.largest ) )
+   {
+      made->NoteLargest( outlier ) ;
+   }
+   for ( const Outlier &outlier : MakeOutliers<T>( header.sample ) )
+   {
+      made->sample[made->sampleCount++] = outlier ;
+   }
+   made->overSeen = (T) header.overSeen ;
+   if ( used != NULL )
+   {
+      *used = decoder.at - buffer ;
+   }
+   return made ;
+}
+
+// Routine to add a snapshot.
+template <typename T>
+bool BasicHistogram<T>::MergeSerialized( const unsigned char *buffer, 
+                                         size_t size, size_t *used )
+{
+   SnapshotDecoder decoder( buffer, size ) ;
+   SnapshotHeader header ;
+
+   if ( !DecodeHeader( decoder, header, (T) ~(T) 0 ) )
+   {
+      return false ;
+   }
+   if ( header.significantDigits != (unsigned long long) significantDigits
+        || header.minBin != minBin || header.countsPerBin != countsPerBin
+        || header.nBins != nBins )
+   {
+      BasicHistogram *other = Deserialize( buffer, size, used ) ;
+
+      if ( other == NULL )
+      {
+         return false ;
+      }
+      Merge( *other ) ;
+      delete other ;
+      return true ;
+   }
+
+   // Check the bins before adding them.
+   SnapshotDecoder bins = decoder ;
+
+   if ( !DecodeBins( bins, header, (T) ~(T) 0,
+                     []( unsigned int, unsigned long long ) { } ) )
+   {
+      return false ;
+   }
+   if ( header.n )
+   {
+      BeginWrite() ;
+      DecodeBins( decoder, header, (T) ~(T) 0,
+                  [this]( unsigned int bin, unsigned long long count )
+                  {
+                     binVector[bin] += (T) count ;
+                  } ) ;
+      std::vector<Outlier> otherLargest = MakeOutliers<T>( header.largest ) ;
+      std::vector<Outlier> otherSample = MakeOutliers<T>( header.sample ) ;
+
+      MergeSummary( (T) header.n, (T) header.minData, (T) header.maxData,
+                    header.summation, otherLargest.data(), 
+                    (int) otherLargest.size(), otherSample.data(), 
+                    (int) otherSample.size(), (T) header.overSeen ) ;
+      EndWrite() ;
+   }
+   if ( used != NULL )
+   {
+      *used = bins.at - buffer ;
+   }
+   return true ;
+}
+
+template size_t BasicHistogram<uint32_t>::Serialize( unsigned char *, size_t ) const ;
+template size_t BasicHistogram<uint64_t>::Serialize( unsigned char *, size_t ) const ;
+template BasicHistogram<uint32_t> *
+BasicHistogram<uint32_t>::Deserialize( const unsigned char *, size_t, size_t * ) ;
+template BasicHistogram<uint64_t> *
+BasicHistogram<uint64_t>::Deserialize( const unsigned char *, size_t, size_t * ) ;
+template bool BasicHistogram<uint32_t>::MergeSerialized( const unsigned char *,
+                                                         size_t, size_t * ) ;
+template bool BasicHistogram<uint64_t>::MergeSerialized( const unsigned char *,
+                                                         size_t, size_t * ) ;
@@ -0,0 +1,184 @@
+// histoshard.cpp -- thread-sharded Histogram recorder
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <iostream>
+#include <new>
+#include <thread>
+#include <stdlib.h>              // for "exit" in Cygwin
+#include "histoshard.h"
+
+using namespace std ;
+
+// Ticket of the thread, which picks its shard:  the threads are numbered in
+// the order in which they first add to any ShardedHistogram.
+static atomic<unsigned int> nextTicket( 0 ) ;
+static thread_local unsigned int ticket = nextTicket++ ;
+
+// Bytes in a cache line, to which each shard's bins are aligned and padded,
+// so that no two shards' bins share a line.
+static const size_t CACHE_LINE = 64 ;
+
+// Standard constructor defining the range and resolution of the distribution.
+ShardedHistogram::ShardedHistogram( unsigned int min, unsigned int countsPer,
+                                    int bins, int shards )
+                : layout( min, countsPer, bins )
+{
+   MakeShards( shards ) ;
+}
+
+// Log-linear constructor for a distribution of the whole range of values.
+ShardedHistogram::ShardedHistogram( LogLinear, int significantDigits, 
+                                    int shards )
+                : layout( logLinear, significantDigits )
+{
+   MakeShards( shards ) ;
+}
+
+// Routine to allocate the shards, with empty bins.
+void ShardedHistogram::MakeShards( int shards )
+{
+   unsigned int count = 1 ;
+
+   if ( shards <= 0 )
+   {
+      shards = thread::hardware_concurrency() ;
+   }
+   while ( count < (unsigned int) shards )
+   {
+      count <<= 1 ;
+   }
+   shardMask = count - 1 ;
+   this->shards = new Shard[count] ;
+   for ( unsigned int i = 0; i < count; i++ )
+   {
+      void *area = ::operator new( BinBytes(), align_val_t( CACHE_LINE ) ) ;
+
+      this->shards[i].bins = (atomic<unsigned int> *) area ;
+      for ( unsigned int j = 0; j < layout.nBins + 2; j++ )
+      {
+         new ( &this->shards[i].bins[j] ) atomic<unsigned int>( 0 ) ;
+      }
+   }
+   Reset() ;
+}
+
+// Function returning the size of a shard's bins, in whole cache lines.
+size_t ShardedHistogram::BinBytes( ) const
+{
+   size_t bytes = ( layout.nBins + 2 ) * sizeof( atomic<unsigned int> ) ;
+
+   return ( bytes + CACHE_LINE - 1 ) / CACHE_LINE * CACHE_LINE ;
+}
+
+// Destructor to release storage allocated by the instance.
+ShardedHistogram::~ShardedHistogram()
+{
+   for ( unsigned int i = 0; i <= shardMask; i++ )
+   {
+      ::operator delete( shards[i].bins, align_val_t( CACHE_LINE ) ) ;
+   }
+   delete[] shards ;
+}
+
+// Routine to reset the recorder to its empty state.
+void ShardedHistogram::Reset()
+{
+   for ( unsigned int i = 0; i <= shardMask; i++ )
+   {
+      shards[i].summation.store( 0, memory_order_relaxed ) ;
+      shards[i].minData.store( ~0u, memory_order_relaxed ) ;
+      shards[i].maxData.store( 0, memory_order_relaxed ) ;
+      for ( unsigned int j = 0; j < layout.nBins + 2; j++ )
+      {
+         shards[i].bins[j].store( 0, memory_order_relaxed ) ;
+      }
+   }
+}
+
+// Routine to add data to the shard of the calling thread.  The least and
+// greatest values are only contended until they settle.
+void ShardedHistogram::Add( unsigned int data )
+{
+   Shard &shard = shards[ticket & shardMask] ;
+   unsigned int seen ;
+
+   shard.bins[layout.BinOf( data )].fetch_add( 1, memory_order_relaxed ) ;
+   shard.summation.fetch_add( data, memory_order_relaxed ) ;
+   seen = shard.minData.load( memory_order_relaxed ) ;
+   while ( data < seen &&
+           !shard.minData.compare_exchange_weak( seen, data, 
+                                                 memory_order_relaxed ) )
+   {
+   }
+   seen = shard.maxData.load( memory_order_relaxed ) ;
+   while ( data > seen &&
+           !shard.maxData.compare_exchange_weak( seen, data, 
+                                                 memory_order_relaxed ) )
+   {
+   }
+}
+
+// Routine to merge the shards into a Histogram of the same layout.  The
+// number of values is the sum of the bins, so the two always agree.
+void ShardedHistogram::Snapshot( Histogram &into ) const
+{
+   if ( !layout.SameLayout( into ) )
+   {
+      std::cout << "ShardedHistogram snapshot into a different layout" 
+                << std::endl ;
+      exit( 1 ) ;
+   }
+   into.Reset() ;
+   into.BeginWrite() ;
+   for ( unsigned int i = 0; i <= shardMask; i++ )
+   {
+      const Shard &shard = shards[i] ;
+      unsigned int count = 0 ;
+
+      for ( unsigned int j = 0; j < layout.nBins + 2; j++ )
+      {
+         unsigned int binCount = shard.bins[j].load( memory_order_relaxed ) ;
+
+         into.binVector[j] += binCount ;
+         count += binCount ;
+      }
+      if ( count )
+      {
+         unsigned int least = shard.minData.load( memory_order_relaxed ),
+                      greatest = shard.maxData.load( memory_order_relaxed ) ;
+
+         if ( into.n == 0 || least < into.minData )
+         {
+            into.minData = least ;
+         }
+         if ( into.n == 0 || greatest > into.maxData )
+         {
+            into.maxData = greatest ;
+         }
+         into.n += count ;
+         into.summation += 
+            double( shard.summation.load( memory_order_relaxed ) ) ;
+      }
+   }
+   into.EndWrite() ;
+}
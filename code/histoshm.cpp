@@ -0,0 +1,294 @@
+// histoshm.cpp -- shared-memory Histogram export
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#include <new>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "histoshm.h"
+
+// Attempts by a reader to find the segment between writes.
+static const int SNAPSHOT_ATTEMPTS = 10000 ;
+
+// Routine returning true if the named segment was left by an exporter that
+// has since ended, so that its name may be taken over.  A segment still
+// being made (with no magic yet) or of another kind is never abandoned.
+static bool AbandonedSegment( const char *name )
+{
+   struct stat status ;
+   bool abandoned = false ;
+   int fd = shm_open( name, O_RDONLY, 0 ) ;
+
+   if ( fd < 0 )
+   {
+      return false ;
+   }
+   if ( !fstat( fd, &status ) 
+        && (size_t) status.st_size >= sizeof( HistogramSegment ) )
+   {
+      const HistogramSegment *found = 
+         (const HistogramSegment *) mmap( NULL, sizeof( HistogramSegment ), 
+                                          PROT_READ, MAP_SHARED, fd, 0 ) ;
+
+      if ( found != MAP_FAILED )
+      {
+         abandoned = !memcmp( found->magic, HISTOGRAM_SEGMENT_MAGIC, 
+                              sizeof( found->magic ) )
+                     && kill( (pid_t) found->pid, 0 ) && errno == ESRCH ;
+         munmap( (void *) found, sizeof( HistogramSegment ) ) ;
+      }
+   }
+   close( fd ) ;
+   return abandoned ;
+}
+
+// Routine to move the bins and summary to a new named segment.
+template <typename T>
+bool BasicHistogram<T>::Export( const char *name, const char *title )
+{
+   size_t size = sizeof( HistogramSegment ) + ( nBins + 2 ) * sizeof( T ) ;
+   HistogramSegment *created ;
+   int fd ;
+
+   if ( segment != NULL )
+   {
+      return false ;
+   }
+   fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0644 ) ;
+   if ( fd < 0 && errno == EEXIST && AbandonedSegment( name ) )
+   {
+      shm_unlink( name ) ;
+      fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0644 ) ;
+   }
+   if ( fd < 0 )
+   {
+      return false ;
+   }
+   if ( ftruncate( fd, size ) )
+   {
+      close( fd ) ;
+      shm_unlink( name ) ;
+      return false ;
+   }
+   created = (HistogramSegment *) mmap( NULL, size, PROT_READ | PROT_WRITE, 
+                                        MAP_SHARED, fd, 0 ) ;
+   close( fd ) ;
+   if ( created == MAP_FAILED )
+   {
+      shm_unlink( name ) ;
+      return false ;
+   }
+
+   // The header is written before the magic, which readers check first.
+   new ( &created->sequence ) std::atomic<uint64_t>( 0 ) ;
+   created->version = HISTOGRAM_SEGMENT_VERSION ;
+   created->countBytes = sizeof( T ) ;
+   created->bytes = size ;
+   created->pid = getpid() ;
+   created->minBin = minBin ;
+   created->countsPerBin = countsPerBin ;
+   created->nBins = nBins ;
+   created->significantDigits = significantDigits ;
+   strncpy( created->title, title ? title : name, sizeof( created->title ) - 1 ) ;
+   created->title[sizeof( created->title ) - 1] = '\0' ;
+   memcpy( created->Bins(), binVector, ( nBins + 2 ) * sizeof( T ) ) ;
+   segment = created ;
+   segmentName = strdup( name ) ;
+   binVector = (T *) created->Bins() ;
+   largestChanged = true ;
+   BeginWrite() ;
+   EndWrite() ;
+   std::atomic_thread_fence( std::memory_order_release ) ;
+   memcpy( created->magic, HISTOGRAM_SEGMENT_MAGIC, sizeof( created->magic ) ) ;
+   return true ;
+}
+
+// Routine to move the bins back from the segment, and remove it.
+template <typename T>
+void BasicHistogram<T>::Unexport( )
+{
+   if ( segment == NULL )
+   {
+      return ;
+   }
+   binVector = binVectorArea + 8 ; // extraSpace / 2 (see the constructors)
+   memcpy( binVector, segment->Bins(), ( nBins + 2 ) * sizeof( T ) ) ;
+   munmap( segment, segment->bytes ) ;
+   shm_unlink( segmentName ) ;
+   free( segmentName ) ;
+   segment = NULL ;
+   segmentName = NULL ;
+}
+
+template bool BasicHistogram<uint32_t>::Export( const char *, const char * ) ;
+template bool BasicHistogram<uint64_t>::Export( const char *, const char * ) ;
+template void BasicHistogram<uint32_t>::Unexport( ) ;
+template void BasicHistogram<uint64_t>::Unexport( ) ;
+
+// Destructor unmaps the segment.
+HistogramSegmentReader::~HistogramSegmentReader( )
+{
+   Close() ;
+}
+
+// Routine to map a segment read-only and check its identification.
+bool HistogramSegmentReader::Open( const char *name )
+{
+   struct stat status ;
+   void *mapped ;
+   int fd ;
+
+   Close() ;
+   fd = shm_open( name, O_RDONLY, 0 ) ;
+   if ( fd < 0 )
+   {
+      return false ;
+   }
+   if ( fstat( fd, &status ) 
+        || (size_t) status.st_size < sizeof( HistogramSegment ) )
+   {
+      close( fd ) ;
+      return false ;
+   }
+   mapped = mmap( NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0 ) ;
+   close( fd ) ;
+   if ( mapped == MAP_FAILED )
+   {
+      return false ;
+   }
+   segment = (const HistogramSegment *) mapped ;
+   bytes = status.st_size ;
+   std::atomic_thread_fence( std::memory_order_acquire ) ;
+   if ( memcmp( segment->magic, HISTOGRAM_SEGMENT_MAGIC, sizeof( segment->magic ) )
+        || segment->version != HISTOGRAM_SEGMENT_VERSION 
+        || ( segment->countBytes != 4 && segment->countBytes != 8 )
+        || sizeof( HistogramSegment ) 
+           + ( segment->nBins + 2 ) * (size_t) segment->countBytes > bytes )
+   {
+      Close() ;
+      return false ;
+   }
+   return true ;
+}
+
+// Routine to unmap the segment.
+void HistogramSegmentReader::Close( )
+{
+   if ( segment != NULL )
+   {
+      munmap( (void *) segment, bytes ) ;
+      segment = NULL ;
+      bytes = 0 ;
+   }
+}
+
+// Routine to make a Histogram64 of the segment's layout.
+Histogram64 *HistogramSegmentReader::NewHistogram( ) const
+{
+   if ( segment == NULL )
+   {
+      return NULL ;
+   }
+   if ( segment->significantDigits )
+   {
+      return new Histogram64( logLinear, segment->significantDigits ) ;
+   }
+   return new Histogram64( segment->minBin, segment->countsPerBin, 
+                           segment->nBins ) ;
+}
+
+// Routine to copy the segment between writes of the exporter.
+bool HistogramSegmentReader::Snapshot( Histogram64 &into ) const
+{
+   Histogram64::Outlier greatest[HISTOGRAM_SEGMENT_OUTLIERS] ;
+   unsigned int count ;
+
+   if ( segment == NULL 
+        || into.significantDigits != segment->significantDigits 
+        || into.minBin != segment->minBin 
+        || into.countsPerBin != segment->countsPerBin 
+        || into.nBins != segment->nBins )
+   {
+      return false ;
+   }
+   for ( int attempt = 0; attempt < SNAPSHOT_ATTEMPTS; attempt++ )
+   {
+      uint64_t before = segment->sequence.load( std::memory_order_acquire ) ;
+
+      if ( before & 1 )
+      {
+         sched_yield() ;
+         continue ;
+      }
+      if ( segment->countBytes == sizeof( uint64_t ) )
+      {
+         memcpy( into.binVector, segment->Bins(), 
+                 ( into.nBins + 2 ) * sizeof( uint64_t ) ) ;
+      }
+      else
+      {
+         const uint32_t *bins = (const uint32_t *) segment->Bins() ;
+
+         for ( unsigned int i = 0; i < into.nBins + 2; i++ )
+         {
+            into.binVector[i] = bins[i] ;
+         }
+      }
+      into.n = segment->n ;
+      into.minData = segment->minData ;
+      into.maxData = segment->maxData ;
+      into.summation = segment->summation ;
+      into.overSeen = segment->overSeen ;
+      count = segment->largestCount < HISTOGRAM_SEGMENT_OUTLIERS 
+            ? segment->largestCount : HISTOGRAM_SEGMENT_OUTLIERS ;
+      for ( unsigned int i = 0; i < count; i++ )
+      {
+         greatest[i].index = segment->largest[i].index ;
+         greatest[i].value = segment->largest[i].value ;
+         greatest[i].timeNs = segment->largest[i].timeNs ;
+      }
+      std::atomic_thread_fence( std::memory_order_acquire ) ;
+      if ( segment->sequence.load( std::memory_order_relaxed ) == before )
+      {
+         into.cumulativeValid = false ;
+         into.largestCount = 0 ;
+         into.largestChanged = true ;
+         into.sampleCount = 0 ;
+         for ( unsigned int i = 0; i < count; i++ )
+         {
+            if ( into.IsLargest( greatest[i].value ) )
+            {
+               into.NoteLargest( greatest[i] ) ;
+            }
+         }
+         return true ;
+      }
+   }
+   return false ;
+}
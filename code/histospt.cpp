@@ -26,8 +26,10 @@
 #include <ctype.h>      // toupper macro
 #include <stdlib.h>     // system() function
 #include <errno.h>
+#include <unistd.h>     // write() function
 
 #include "histospt.h"   // includes histo.h
+#include "sccorlib.h"   // coresume() function
 
 #ifdef THE_TEST_BUILD
 void   RRTLog( const char *message ) ;
@@ -38,58 +40,54 @@ void   ShowStatus( const char *msg ) ;
 void   DisplayHistBins( TimeIntervalHistogram &dataSet, int radix ) ;
 void   DisplayHistGraph( TimeIntervalHistogram &dataSet ) ;
 double Roundf( double val, int nDigits ) ;
+static char *PutUnsigned( char *at, unsigned long long value, int width = 0,
+                          int radix = base10 ) ;
+static char *PutText( char *at, const char *text, size_t length ) ;
+static bool WriteAll( int fd, const char *text, size_t length ) ;
+
+// Rule above and below the histogram.
+static const char RULE[] = 
+   "-------------------------------------------------------------------"
+   "------------" ;
 
 using namespace std ;
 
 void TimeIntervalHistogram::tally( void )
 {
+   // Get the current counter value (the clock cannot fail).
+   unsigned long long nextTicks = clock.Ticks() ;
+
    if ( firstTime )
    {
-      // Prime the pump.
-      if ( gettimeofday( &tvPrevTimeValue, NULL ) )
-      {
-         char str[ 80 ] ; // ample
-         sprintf( str, "gettimeofday failed: errno is %i", errno ) ;
-         printf( "%s\n", str ) ;
-         #ifdef THE_TEST_BUILD
-         RRTLog( str ) ;
-         #endif // def THE_TEST_BUILD
-      }
-
-      // Do this only once.
+      // Prime the pump; do this only once.
       firstTime = false ;
    }
    else
    {
-      // Get the current counter value.
-      if ( gettimeofday( &tvNextTimeValue, NULL ) )
-      {
-         char str[ 80 ] ; // ample
-         sprintf( str, "gettimeofday failed: errno is %i", errno ) ;
-         printf( "%s\n", str ) ;
-         #ifdef THE_TEST_BUILD
-         RRTLog( str ) ;
-         #endif // def THE_TEST_BUILD
-      }
-
-      // Add the interval to the histogram (in microseconds).
-      long uDelta = ( tvNextTimeValue.tv_sec - tvPrevTimeValue.tv_sec ) * 1000000
-                     + tvNextTimeValue.tv_usec - tvPrevTimeValue.tv_usec ;
+      // Add the interval to the histogram (in nanoseconds or microseconds).
+      unsigned long long nDelta = clock.ToNs( nextTicks - prevTicks ) ;
 
-      Add( (unsigned int)( uDelta ) ) ;
-
-      // Save the counter value for next time
-      tvPrevTimeValue = tvNextTimeValue ;
+      Add( nanoseconds ? nDelta : nDelta / 1000 ) ;
    }
+
+   // Save the counter value for next time
+   prevTicks = nextTicks ;
 }
 
 void TimeIntervalHistogram::restartTimer( void )
 {
    // Update the timer, without adding to the histogram.
-   gettimeofday( &tvPrevTimeValue, NULL ) ;
+   prevTicks = clock.Ticks() ;
+}
+
+bool TimeIntervalHistogram::useClock( ClockSource source )
+{
+   clock = IntervalClock( source ) ;
+   restartTimer() ;
+   return clock.Source() == source ;
 }
 
-void TimeIntervalHistogram::add( unsigned int data )
+void TimeIntervalHistogram::add( unsigned long long data )
 {
    // Call the base class to add an arbitrary point
    // (i.e., not a time interval) to the histogram.
@@ -99,21 +97,40 @@ void TimeIntervalHistogram::add( unsigned int data )
 void TimeIntervalHistogram::reset( void )
 {
    // Call the base class to reset the histogram.
-   Histogram::Reset() ;
+   Histogram64::Reset() ;
 }
 
-void TimeIntervalHistogram::show( bool logToo )
+int TimeIntervalHistogram::Compose( bool yielding )
 {
    char str[128] ; // ample
 
    // Clear the canvass.
    for ( int i = 0; i < height; i++ )
    {
-      for ( int j = 0; j < width; j++ )
+      memset( window[ i ], ' ', width ) ;   // blank canvass
+      window[ i ][ width ] = '\0' ;         // null-terminated lines
+   }
+
+   // Choose the bins to show:  from the first, or for a log-linear histogram
+   // those from the least value to the greatest, several to a row if need be.
+   firstBin = 1 ;
+   binsPerRow = 1 ;
+   rows = min( height - 10, NBins() ) ;
+   if ( SignificantDigits() )
+   {
+      int lastBin = NBins() ;
+      int maxRows = bottom - top - 1 ;
+
+      while ( firstBin < lastBin && !BinCount( firstBin ) )
       {
-         window[ i ][ j ] = ' ' ;    // blank canvass
+         firstBin++ ;
       }
-      window[ i ][ width ] = '\0' ;  // null-terminated lines
+      while ( lastBin > firstBin && !BinCount( lastBin ) )
+      {
+         lastBin-- ;
+      }
+      binsPerRow = ( lastBin - firstBin + maxRows ) / maxRows ;
+      rows = ( lastBin - firstBin + binsPerRow ) / binsPerRow ;
    }
 
    // Label the histogram.
@@ -124,53 +141,60 @@ void TimeIntervalHistogram::show( bool logToo )
    strncpy( &window[ 0 ][ ( 80 - strlen( m_banner )) / 2 ], str,
             strlen( str ) ) ;
 
+   if ( yielding )
+   {
+      coresume() ;
+   }
+
    // Show the histogram values.
    DisplayHistGraph( *this ) ;
+   if ( yielding )
+   {
+      coresume() ;
+   }
 
    // Show the sample count and mean.
    mean = Roundf( MeanValue(), 1 ) ;
 //   sprintf( str, "N = %-5ld;  mean = %2.1lf", NValues(), mean ) ;
-   sprintf( str, "N = %-5d;  mean = %2.1lf", NValues(), mean ) ;
+   sprintf( str, "N = %-5llu;  mean = %2.1lf", 
+            (unsigned long long) NValues(), mean ) ;
    strncpy( &window[ height - 12 ][ col_b ], str, strlen( str ) ) ;
 
+   // Show the standard percentiles below them.
+   if ( NValues() )
+   {
+      const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 } ;
+      unsigned long long values[4] ;
+
+      ValuesAtPercentiles( percentiles, values, 4 ) ;
+      sprintf( str, "p50 = %llu;  p90 = %llu;  p99 = %llu;  p99.9 = %llu",
+               values[0], values[1], values[2], values[3] ) ;
+      strncpy( &window[ height - 11 ][ col_b ], str,
+               min( strlen( str ), (size_t)( width - col_b ) ) ) ;
+   }
+
    // Show data about any "Over" values.
-   overCount = BinCount( NBins() + 1 ) ;
+   overCount = RowCount( rows + 1 ) ;
    int line = height - 10 ;
    if ( overCount )
    {
       int offset = col_b ;
       if ( displayMode == graph )
       {
-         sprintf( str, "Number of 'Over' values = %u. ", overCount ) ;
+         sprintf( str, "Number of 'Over' values = %llu. ", overCount ) ;
          strncpy( &window[ line ][ col_b ], str, strlen( str ) ) ;
          offset += strlen( str ) ;
       }
-      sprintf( str, "Greatest delay = %u.", MaxValue() ) ;
-      strncpy( &window[ line ][ offset ], str, strlen( str ) ) ;
-      offset += strlen( str ) ;
-      sprintf( str, !overN[1] ? "  Over index =" : "  Over indices =" ) ;
+      sprintf( str, "Greatest delay = %llu.", 
+               (unsigned long long) MaxValue() ) ;
       strncpy( &window[ line ][ offset ], str, strlen( str ) ) ;
       offset += strlen( str ) ;
-      int indicesOffset = offset ;
-      for ( int i = 0; i < OVERN_TRACE_COUNT; i++ )
+      if ( OverSampled() )
       {
-         if ( !overN[i] )
-         {
-            break ;
-         }
-         sprintf( str, " %6u (%6u) @ %6u",
-                  overN[i], overValueN[i], overTSN[i] ) ;
-         strncpy( &window[ line ][ offset ], str, strlen( str ) ) ;
-         offset += strlen( str ) ;
-         if ( line == height )
-         {
-            break ;
-         }
-         else
-         {
-            offset = indicesOffset ;
-            line++ ;
-         }
+         sprintf( str, "  Sampled = %d of %llu.", OverSampled(),
+                  (unsigned long long) OverCount() ) ;
+         strncpy( &window[ line ][ offset ], str, 
+                  min( strlen( str ), (size_t)( width - offset ) ) ) ;
       }
    }
    else
@@ -178,11 +202,56 @@ void TimeIntervalHistogram::show( bool logToo )
       sprintf( str, "There are no 'Over' values." ) ;
       strncpy( &window[ line ][ col_b ], str, strlen( str ) ) ;
    }
+   line++ ;
+
+   // The largest values tracked (in range or not), one per line, with their
+   // indices and the us on the monotonic clock they were added at.
+   Outlier greatest[OVERN_TRACE_COUNT] ;
+   int count = Outliers( greatest, min( OVERN_TRACE_COUNT, height - line ) ) ;
+   if ( count )
+   {
+      int offset = col_b ;
+
+      sprintf( str, count == 1 ? "Largest index =" : "Largest indices =" ) ;
+      strncpy( &window[ line ][ offset ], str, strlen( str ) ) ;
+      offset += strlen( str ) ;
+      for ( int i = 0; i < count; i++, line++ )
+      {
+         sprintf( str, " %6llu (%6llu) @ %llu",
+                  (unsigned long long) greatest[i].index, 
+                  (unsigned long long) greatest[i].value, 
+                  greatest[i].timeNs / 1000 ) ;
+         strncpy( &window[ line ][ offset ], str, 
+                  min( strlen( str ), (size_t)( width - offset ) ) ) ;
+      }
+   }
+
+   return line ;
+}
 
-   // Put the window array on the console (and, optionally, in the log).
-   printf( "\r\n" ) ;
-   printf( "-------------------------------------------------------------------"
-           "------------\r\n" ) ;
+void TimeIntervalHistogram::show( bool logToo )
+{
+   int line = Compose( false ) ;
+   char *at ;
+
+   // Put the window array on the console in one write (and, optionally, in
+   // the log), after anything printed before.
+   if ( output == NULL )
+   {
+      output = new char[outputBytes] ;
+   }
+   at = PutText( output, "\r\n", 2 ) ;
+   at = PutText( at, RULE, sizeof( RULE ) - 1 ) ;
+   at = PutText( at, "\r\n", 2 ) ;
+   for ( int i = 0; i < line; i++ )
+   {
+      at = PutText( at, window[ i ], width ) ;
+      at = PutText( at, "\r\n", 2 ) ;
+   }
+   at = PutText( at, RULE, sizeof( RULE ) - 1 ) ;
+   at = PutText( at, "\r\n\r\n", 4 ) ;
+   fflush( stdout ) ;
+   WriteAll( 1, output, at - output ) ;
    if ( logToo )
    {
       #ifdef THE_TEST_BUILD
@@ -193,7 +262,6 @@ void TimeIntervalHistogram::show( bool logToo )
    }
    for ( int i = 0; i < line; i++ )
    {
-      printf( "%s\r\n", &window[ i ][ 0 ] ) ;
       if ( logToo )
       {
          #ifdef THE_TEST_BUILD
@@ -201,9 +269,6 @@ void TimeIntervalHistogram::show( bool logToo )
          #endif // def THE_TEST_BUILD
       }
    }
-   printf( "-------------------------------------------------------------------"
-           "------------\r\n" ) ;
-   printf( "\r\n" ) ;
    if ( logToo )
    {
       #ifdef THE_TEST_BUILD
@@ -217,6 +282,311 @@ void TimeIntervalHistogram::show( bool logToo )
 //   pause();
 }
 
+bool TimeIntervalHistogram::render( int fd, bool live, bool yielding )
+{
+   int line = Compose( yielding ) ;
+   char *at ;
+
+   if ( output == NULL )
+   {
+      output = new char[outputBytes] ;
+   }
+   if ( !live )
+   {
+      // The frame of show(), less the blank lines around it.
+      at = PutText( output, RULE, sizeof( RULE ) - 1 ) ;
+      at = PutText( at, "\r\n", 2 ) ;
+      for ( int i = 0; i < line; i++ )
+      {
+         at = PutText( at, window[ i ], width ) ;
+         at = PutText( at, "\r\n", 2 ) ;
+      }
+      at = PutText( at, RULE, sizeof( RULE ) - 1 ) ;
+      at = PutText( at, "\r\n", 2 ) ;
+   }
+   else
+   {
+      // Redraw only the lines changed since the last live render, each at
+      // its row of the screen, which the first render clears.
+      int lines = max( line, shownLines ) ;
+
+      at = output ;
+      if ( shown == NULL )
+      {
+         shown = new char[height][width + 1] ;
+         at = PutText( at, "\x1b[H\x1b[2J", 7 ) ;
+      }
+      for ( int i = 0; i < lines; i++ )
+      {
+         if ( i < shownLines && !memcmp( shown[ i ], window[ i ], width ) )
+         {
+            continue ;
+         }
+         at = PutText( at, "\x1b[", 2 ) ;
+         at = PutUnsigned( at, i + 1 ) ;
+         at = PutText( at, ";1H", 3 ) ;
+         at = PutText( at, window[ i ], width ) ;
+         memcpy( shown[ i ], window[ i ], width + 1 ) ;
+      }
+      shownLines = line ;
+
+      // Leave the cursor below the histogram.
+      at = PutText( at, "\x1b[", 2 ) ;
+      at = PutUnsigned( at, lines + 1 ) ;
+      at = PutText( at, ";1H", 3 ) ;
+   }
+   if ( yielding )
+   {
+      coresume() ;
+   }
+   return WriteAll( fd, output, at - output ) ;
+}
+
+unsigned long long TimeIntervalHistogram::RowCount( int row ) const
+{
+   unsigned long long count = 0 ;
+
+   if ( !SignificantDigits() )
+   {
+      if ( row <= rows )
+      {
+         return BinCount( row ) ;
+      }
+      // The Over row also holds the bins the window has no room for.
+      for ( int i = rows + 1; i <= NBins() + 1; i++ )
+      {
+         count += BinCount( i ) ;
+      }
+      return count ;
+   }
+   if ( row == 0 )
+   {
+      for ( int i = 0; i < firstBin; i++ )
+      {
+         count += BinCount( i ) ;
+      }
+   }
+   else if ( row <= rows )
+   {
+      for ( int i = 0; i < binsPerRow; i++ )
+      {
+         count += BinCount( firstBin + ( row - 1 ) * binsPerRow + i ) ;
+      }
+   }
+   else
+   {
+      for ( int i = firstBin + rows * binsPerRow; i <= NBins() + 1; i++ )
+      {
+         count += BinCount( i ) ;
+      }
+   }
+   return count ;
+}
+
+WindowedIntervalHistogram::WindowedIntervalHistogram( const char* banner,
+                                                      int slices,
+                                                      unsigned long sliceMs,
+                                                      unsigned long long min,
+                                                      unsigned long long countsPer,
+                                                      int bins )
+                          : merged( banner, min, countsPer, bins ),
+                            sliceNs( sliceMs * 1000000ULL )
+{
+   MakeSlices( slices ) ;
+}
+
+WindowedIntervalHistogram::WindowedIntervalHistogram( const char* banner,
+                                                      int slices,
+                                                      unsigned long sliceMs,
+                                                      LogLinear,
+                                                      int significantDigits )
+                          : merged( banner, logLinear, significantDigits ),
+                            sliceNs( sliceMs * 1000000ULL )
+{
+   MakeSlices( slices ) ;
+}
+
+void WindowedIntervalHistogram::MakeSlices( int slices )
+{
+   if ( slices < 1 )
+   {
+      std::cout << "Histogram window needs at least one slice" << std::endl ;
+      exit( 1 ) ;
+   }
+   sliceCount = slices ;
+   this->slices = new Histogram64 *[slices] ;
+   for ( int i = 0; i < slices; i++ )
+   {
+      this->slices[i] = merged.SignificantDigits() 
+                      ? new Histogram64( logLinear, merged.SignificantDigits() )
+                      : new Histogram64( merged.MinBin(), merged.CountsPerBin(),
+                                         merged.NBins() ) ;
+   }
+   current = 0 ;
+   mergedValid = false ;
+   sliceEndNs = merged.clock.Ns() + sliceNs ;
+}
+
+WindowedIntervalHistogram::~WindowedIntervalHistogram()
+{
+   for ( int i = 0; i < sliceCount; i++ )
+   {
+      delete slices[i] ;
+   }
+   delete[] slices ;
+}
+
+void WindowedIntervalHistogram::Advance( unsigned long long nowNs )
+{
+   // Clear the slices passed over, at most the whole ring.
+   unsigned long long passed = ( nowNs - sliceEndNs ) / sliceNs + 1 ;
+
+   for ( unsigned long long i = 0; i < passed && i < (unsigned) sliceCount; i++ )
+   {
+      current = ( current + 1 ) % sliceCount ;
+      slices[current]->Reset() ;
+   }
+   sliceEndNs += passed * sliceNs ;
+   mergedValid = false ;
+}
+
+void WindowedIntervalHistogram::tally( void )
+{
+   // As TimeIntervalHistogram::tally, with the same clock reading rotating
+   // the window.
+   TimeIntervalHistogram &timer = merged ;
+   unsigned long long nextTicks = timer.clock.Ticks() ;
+
+   if ( sliceNs && timer.clock.ToNs( nextTicks ) >= sliceEndNs )
+   {
+      Advance( timer.clock.ToNs( nextTicks ) ) ;
+   }
+   if ( timer.firstTime )
+   {
+      timer.firstTime = false ;
+   }
+   else
+   {
+      unsigned long long nDelta = timer.clock.ToNs( nextTicks - timer.prevTicks ) ;
+
+      slices[current]->Add( timer.nanoseconds ? nDelta : nDelta / 1000 ) ;
+      mergedValid = false ;
+   }
+   timer.prevTicks = nextTicks ;
+}
+
+void WindowedIntervalHistogram::restartTimer( void )
+{
+   merged.restartTimer() ;
+}
+
+void WindowedIntervalHistogram::add( unsigned long long data )
+{
+   if ( sliceNs && merged.clock.Ns() >= sliceEndNs )
+   {
+      Advance( merged.clock.Ns() ) ;
+   }
+   slices[current]->Add( data ) ;
+   mergedValid = false ;
+}
+
+void WindowedIntervalHistogram::rotate( void )
+{
+   current = ( current + 1 ) % sliceCount ;
+   slices[current]->Reset() ;
+   sliceEndNs = merged.clock.Ns() + sliceNs ;
+   mergedValid = false ;
+}
+
+void WindowedIntervalHistogram::reset( void )
+{
+   for ( int i = 0; i < sliceCount; i++ )
+   {
+      slices[i]->Reset() ;
+   }
+   sliceEndNs = merged.clock.Ns() + sliceNs ;
+   mergedValid = false ;
+}
+
+bool WindowedIntervalHistogram::useClock( ClockSource source )
+{
+   bool available = merged.useClock( source ) ;
+
+   sliceEndNs = merged.clock.Ns() + sliceNs ;
+   return available ;
+}
+
+void WindowedIntervalHistogram::Merge( void )
+{
+   // Let a quiet window move on before it is shown.
+   if ( sliceNs && merged.clock.Ns() >= sliceEndNs )
+   {
+      Advance( merged.clock.Ns() ) ;
+   }
+   if ( mergedValid )
+   {
+      return ;
+   }
+   merged.Reset() ;
+   for ( int i = 1; i <= sliceCount; i++ )
+   {
+      merged.Histogram64::Merge( *slices[( current + i ) % sliceCount] ) ;
+   }
+   mergedValid = true ;
+}
+
+void WindowedIntervalHistogram::show( bool logToo )
+{
+   Merge() ;
+   merged.show( logToo ) ;
+}
+
+bool WindowedIntervalHistogram::render( int fd, bool live, bool yielding )
+{
+   Merge() ;
+   return merged.render( fd, live, yielding ) ;
+}
+
+unsigned long long WindowedIntervalHistogram::ValueAtPercentile( double percentile )
+{
+   Merge() ;
+   return merged.ValueAtPercentile( percentile ) ;
+}
+
+void WindowedIntervalHistogram::ValuesAtPercentiles( const double *percentiles,
+                                                     unsigned long long *values,
+                                                     int count )
+{
+   Merge() ;
+   merged.ValuesAtPercentiles( percentiles, values, count ) ;
+}
+
+double WindowedIntervalHistogram::MeanValue( void )
+{
+   Merge() ;
+   return merged.MeanValue() ;
+}
+
+unsigned long long WindowedIntervalHistogram::NValues( void )
+{
+   Merge() ;
+   return merged.NValues() ;
+}
+
+size_t WindowedIntervalHistogram::WriteText( TextFormat format, const char *name,
+                                             char *buffer, size_t size )
+{
+   Merge() ;
+   return merged.WriteText( format, name, buffer, size ) ;
+}
+
+bool WindowedIntervalHistogram::WriteText( TextFormat format, const char *name,
+                                           int fd )
+{
+   Merge() ;
+   return merged.WriteText( format, name, fd ) ;
+}
+
 //======================= SUPPORT CODE STARTS HERE ============================
 
 // Function to pause and wait for a keystroke.
@@ -241,10 +611,9 @@ void ShowStatus( const char *msg )
 // Function to label a frequency distribution in our window array.
 void DisplayHistBins( TimeIntervalHistogram &dataSet, int radix )
 {
-   unsigned int thisBin = dataSet.MinBin() ;
-   unsigned int countsPerBin = (unsigned int) dataSet.CountsPerBin() ;
-   int nBins = min( dataSet.height - 10, dataSet.NBins() ) ;
-   char str[16] ; // ample
+   unsigned long long thisBin ;
+   int nBins = dataSet.rows ;
+   char str[24] ; // ample
    for ( int i = 0; i <= nBins + 1; ++i )
    {
       if ( i == 0 )
@@ -254,21 +623,14 @@ void DisplayHistBins( TimeIntervalHistogram &dataSet, int radix )
       }
       else if ( i < nBins + 1 )
       {
-         if ( radix == base10 )
-         {
-//            sprintf( str, "%6lu ", thisBin );
-            sprintf( str, "%6u ", thisBin ) ;
-            strncpy( &dataSet.window[ i + dataSet.top ][ dataSet.col ], str,
-                     strlen( str ) ) ;
-         }
-         else
-         {
-//            sprintf( str, "%6lX ", thisBin ) ;
-            sprintf( str, "%6X ", thisBin ) ;
-            strncpy( &dataSet.window[ i + dataSet.top ][ dataSet.col ], str,
-                     strlen( str ) ) ;
-         }
-         thisBin += countsPerBin ;
+         thisBin = dataSet.BinValue( dataSet.firstBin 
+                                     + ( i - 1 ) * dataSet.binsPerRow ) ;
+         // "%6llu " (or "%6llX "), without the formatting of printf.
+         char *end = PutUnsigned( str, thisBin, 6, radix ) ;
+
+         *end++ = ' ' ;
+         memcpy( &dataSet.window[ i + dataSet.top ][ dataSet.col ], str,
+                 end - str ) ;
       }
       else
       {
@@ -281,20 +643,25 @@ void DisplayHistBins( TimeIntervalHistogram &dataSet, int radix )
 // Function to graph a frequency distribution in text mode.
 void DisplayHistGraph( TimeIntervalHistogram &dataSet )
 {
-   int nBins = min( dataSet.height - 10, dataSet.NBins() ) ;
-   unsigned int count ;
+   int nBins = dataSet.rows ;
+   unsigned long long count ;
    double maxFreq = (double) dataSet.MaxBinCount() ;
    double barIP, barFP ;
    char countStr[ dataSet.width + 1 ] ;
-   char str[128] ; // ample
    int strSize, barSize ;
    int i, j ;
 
+   // The rows of a log-linear histogram may sum several bins, as may the
+   // Over row of a linear one with more bins than rows.
    for ( i = 0; i <= nBins + 1; ++i )
    {
-      count = dataSet.BinCount(i);
-//      sprintf( countStr, "%lu", count );
-      sprintf( countStr, "%u", count );
+      maxFreq = max( maxFreq, (double) dataSet.RowCount( i ) ) ;
+   }
+   for ( i = 0; i <= nBins + 1; ++i )
+   {
+      count = dataSet.RowCount(i);
+      strSize = PutUnsigned( countStr, count ) - countStr ;
+      countStr[ strSize ] = '\0' ;
       if ( dataSet.displayMode == graph )
       {
          if ( count > 0L )
@@ -302,12 +669,10 @@ void DisplayHistGraph( TimeIntervalHistogram &dataSet )
             barFP = modf( double(count) / maxFreq * dataSet.maxBarSize,
                           &barIP ) ;
             barSize = int( barIP ) ;
-            strSize = strlen( countStr ) ;
             if ( barSize >= strSize + 1 )
             {
-               sprintf( str, "%s", countStr ) ;
-               strncpy( &dataSet.window[ i + dataSet.top ][ dataSet.col_b ],
-                        str, strlen( str ) ) ;
+               memcpy( &dataSet.window[ i + dataSet.top ][ dataSet.col_b ],
+                       countStr, strSize ) ;
                barSize -= strSize;
             }
             for ( j = 0; j < barSize; ++j )
@@ -331,12 +696,89 @@ void DisplayHistGraph( TimeIntervalHistogram &dataSet )
       {
          if ( count > 0L )
          {
-            sprintf( str, "%s", countStr ) ;
-            strncpy( &dataSet.window[ i + dataSet.top ][ dataSet.col_b ],
-                     str, strlen( str ) ) ;
+            memcpy( &dataSet.window[ i + dataSet.top ][ dataSet.col_b ],
+                    countStr, strSize ) ;
+         }
+      }
+   }
+}
+
+// Function to put value in decimal (or hexadecimal), right-aligned in a field
+// of at least width characters, returning the end of the text.  Decimal digits
+// are converted two at a time.
+static char *PutUnsigned( char *at, unsigned long long value, int width,
+                          int radix )
+{
+   static const char pairs[] = 
+      "00010203040506070809101112131415161718192021222324252627282930313233343536"
+      "37383940414243444546474849505152535455565758596061626364656667686970717273"
+      "7475767778798081828384858687888990919293949596979899" ;
+   char digits[24] ;
+   char *first = digits + sizeof( digits ) ;
+   int length ;
+
+   if ( radix == base16 )
+   {
+      do
+      {
+         *--first = "0123456789ABCDEF"[ value & 15 ] ;
+         value >>= 4 ;
+      } while ( value ) ;
+   }
+   else
+   {
+      while ( value >= 100 )
+      {
+         const char *pair = &pairs[ 2 * ( value % 100 ) ] ;
+
+         value /= 100 ;
+         *--first = pair[ 1 ] ;
+         *--first = pair[ 0 ] ;
+      }
+      if ( value >= 10 )
+      {
+         *--first = pairs[ 2 * value + 1 ] ;
+         *--first = pairs[ 2 * value ] ;
+      }
+      else
+      {
+         *--first = (char)( '0' + value ) ;
+      }
+   }
+   length = (int)( digits + sizeof( digits ) - first ) ;
+   for ( ; width > length; width-- )
+   {
+      *at++ = ' ' ;
+   }
+   return PutText( at, first, length ) ;
+}
+
+// Function to put text, returning its end.
+static char *PutText( char *at, const char *text, size_t length )
+{
+   memcpy( at, text, length ) ;
+   return at + length ;
+}
+
+// Function to write all of a text, returning false if it can't be.
+static bool WriteAll( int fd, const char *text, size_t length )
+{
+   while ( length > 0 )
+   {
+      ssize_t wrote = write( fd, text, length ) ;
+
+      if ( wrote < 0 )
+      {
+         if ( errno == EINTR )
+         {
+            continue ;
          }
+         return false ;
       }
+      text += wrote ;
+      length -= wrote ;
    }
+   return true ;
 }
 
 // Function to round floating point numbers to the specified number of digits.
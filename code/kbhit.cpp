@@ -22,8 +22,8 @@
 
 #include <sys/select.h>
 
-// In Cygwin, NULL is already defined. We'll define it for OS X.
-#if defined(__APPLE__) && defined(__MACH__)
+// In Cygwin, NULL is already defined. We'll define it for OS X and Linux.
+#if ! defined(CYGWIN)
    #define NULL 0
 #endif
 
@@ -4,6 +4,10 @@
 **                                                                            **
 **   SYNOPSIS:  Coroutines as lightweight cooperative multitasking for Clang. **
 **              The coroutines run non-preemptively in a single macOS thread. **
+**              By default the running coroutine's stack frame is copied to   **
+**              and from the CSA on each task switch.  Defining               **
+**              SCCOR_SEPARATE_STACKS selects a backend in which each         **
+**              coroutine has a stack of its own instead (see below).         **
 **                                                                            **
 ** TARGET O/S:  Mac macOS Big Sur (11.0), or later:                           **
 **                Compile with Clang:                                         **
@@ -19,10 +23,55 @@
 **       N.B.:  - This implementation supports 64-bit architectures only.     **
 **              - There is no maximum to number of longs as parameters        **
 **                per coroutine start in invoke() and cobegin().              **
-**              - The CSA is static and has a fixed size of 720,000 bytes.    **
-**                This will be made dynamic in a future release.              **
+**              - wait() takes the coroutine off the ring until its deadline, **
+**                kept in a heap of timers.  When every coroutine is waiting, **
+**                the thread sleeps until the earliest deadline.  In virtual  **
+**                time (setVirtualTime), the clock jumps to that deadline     **
+**                instead, so simulations run as fast as they can, and on a   **
+**                single worker, so that they repeat exactly.                 **
+**              - Events, semaphores and condition variables park a blocked   **
+**                coroutine off the ring on the object's wait queue until it  **
+**                is signaled (or its timeout passes), so only coroutines     **
+**                that can make progress are resumed.                         **
+**              - Coroutines waiting for I/O readiness (coio.cpp) park the    **
+**                same way; with nothing runnable, the thread blocks in the   **
+**                reactor rather than sleeping.                               **
+**              - setPolicy() selects how the next coroutine is chosen:       **
+**                round robin (the default), by setPriority() level, or       **
+**                earliest setDeadline() first and then by level.  Each level **
+**                has a run queue of its own, so a coroutine released at a    **
+**                high level runs at the next task switch, ahead of the rest. **
+**              - invokeStep() puts a stackless coroutine (see sccortask.h) on **
+**                the ring.  When its turn comes, it is run on the stack of   **
+**                the coroutine (or worker) switching away, up to its next    **
+**                suspension, with no frame copied and no stack switched.     **
+**              - Defining SCCOR_STATS (make STATS=on) counts, per coroutine,  **
+**                its resumes, the frame bytes copied for it and its running  **
+**                time (see getCoroutineStats), optionally with histograms of **
+**                its run slices and resume latencies.  Otherwise the hooks   **
+**                compile to nothing.                                         **
+**              - With separate stacks, setWorkerCount() runs the coroutines  **
+**                of a cobegin on several threads, each with a ring of its    **
+**                own.  New coroutines are spread across the workers, an idle **
+**                worker steals from the others, and pinCoroutine() keeps a   **
+**                coroutine on one worker.  Sharing data between coroutines   **
+**                then needs the sccor primitives (or locks), as it would     **
+**                between threads.  A frame copied by the default backend     **
+**                belongs to its thread's stack, so that backend has a single **
+**                worker.                                                     **
+**              - The CSA grows in chunks of CSA_CHUNK_SIZE longs as needed,  **
+**                up to setCsaLimit() bytes (64 MiB by default).  Exceeding   **
+**                the limit is reported and ends the program.  Its blocks     **
+**                start on cache lines, and setCsaPages() maps the chunks on  **
+**                hugepages or binds them to a NUMA node.  The frame of the   **
+**                coroutine to run next is prefetched at each task switch.    **
 **              - Some magic numbers require checking with changes to mt.cpp. **
 **                This will be automated in a future release.                 **
+**              - The separate-stack backend has no magic numbers.  A task    **
+**                switch saves the callee-saved registers and swaps rsp, so   **
+**                no frame is copied, but every coroutine needs a stack of    **
+**                setStackSize() bytes (64 KiB by default) plus a guard page. **
+**                It also runs on x86_64 Linux (with Clang or GCC).           **
 **                                                                            **
 **     AUTHOR:  Cary WR Campbell                                              **
 **                                                                            **
@@ -53,14 +102,59 @@
 #include <wchar.h>
 #include <string.h>
 #include <thread> 
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(SCCOR_SEPARATE_STACKS)
+#include <stdarg.h>
+#include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#endif
 
 #include "sccorlib.h"
+#include "mtint.h"
+#include "histoclk.h"
+#if defined(SCCOR_STATS)
+#include "histospt.h"
+#endif
+
+// CSA_CHUNK_SIZE defines the size (in 8-byte longs) of each chunk by which the 
+// coroutine storage area (CSA) grows.  The CSA stores stack contents for
+// coroutines not currently running.  A frame too large for a chunk gets a
+// chunk of its own.  SCCOR_CSA_LIMIT is the default limit (in bytes) on the
+// total size of the chunks.
+const long CSA_CHUNK_SIZE = 8192 ;
+#if ! defined(SCCOR_CSA_LIMIT)
+   #define SCCOR_CSA_LIMIT 0x4000000
+#endif
 
-// CSA_SIZE defines the size (in 8-byte longs) of the coroutine storage area (CSA).
-// The CSA stores stack contents for coroutines not currently running.
-// The 90000 8-byte entries = 720,000 bytes reserved for the CSA.
-const int CSA_SIZE = 90000 ;
+#if defined(SCCOR_SEPARATE_STACKS)
+// SCCOR_STACK_SIZE is the default size (in bytes) of each coroutine's stack.
+#if ! defined(SCCOR_STACK_SIZE)
+   #define SCCOR_STACK_SIZE 0x10000
+#endif
 
+// Environment-dependent ABI constants.
+#if defined(CYGWIN)
+   #define IN_REGISTERS_COUNT 4  // Cygwin uses the X64 ABI
+   #define SHADOW_SPACE_COUNT 4  // longs of shadow space above a return address
+   #define SAVED_LONGS       28  // longs pushed by switchStacks (xmm6-15 too)
+   #define SAVED_R12_INDEX   23  // where switchStacks keeps r12
+   #define SAVED_R13_INDEX   22  // where switchStacks keeps r13
+#elif defined(__x86_64__)
+   #define IN_REGISTERS_COUNT 6  // macOS and Linux use the x86_64 ABI
+   #define SHADOW_SPACE_COUNT 0
+   #define SAVED_LONGS        6  // longs pushed by switchStacks
+   #define SAVED_R12_INDEX    3  // where switchStacks keeps r12
+   #define SAVED_R13_INDEX    2  // where switchStacks keeps r13
+#else
+   #pragma GCC error "Only 64-bit x86 is supported."
+#endif
+#else
 //#define EXTRA_STACK    40    // longs for calling memcpy and memcpy's locals
 #define EXTRA_STACK    60    // longs for calling memcpy and memcpy's locals
 #define FILLER_VALUE 0xffffffffffffffff  // in csa 
@@ -73,6 +167,7 @@ const int CSA_SIZE = 90000 ;
    #define CLEANUP_OFFSET 9  // bytes into cleanup, to keep same ebp, esp
    #define CLEANUP_RSP_ADJUST 0x18 // Clang moves stack back by this amount
                              //   in cleanup's epilogue
+   #define ENTRY_INDEX 2     // longs ahead of the coroutine in a new frame
 #elif defined(CYGWIN)
    #define SHADOW_SPACE_VALUE 0x5555555555555555  // in csa 
    #define IN_REGISTERS_COUNT 4 // Cygwin uses the X64 ABI
@@ -82,14 +177,214 @@ const int CSA_SIZE = 90000 ;
    #define CLEANUP_STACK_ADJUST 0x38 // Clang moves stack back by this amount
                                      //   in cleanup's epilogue
    #define COBEGIN_STACK_ADJUST 0x58 // cobegin adjusts stack by this amount
+   #define ENTRY_INDEX 4     // longs ahead of the coroutine in a new frame
 #else
    #pragma GCC error "Only 64-bit macOS or Windows Cygwin with Clang supported."
 #endif
+#endif // defined(SCCOR_SEPARATE_STACKS)
+
+// The csa is carved into blocks whose sizes are powers of two, starting at
+// MIN_BLOCK longs.  Freed blocks are kept on one free list per size class.
+#define MIN_BLOCK      8     // longs in the smallest csa block
+#define BLOCK_CLASSES  11    // MIN_BLOCK << 10 longs == CSA_CHUNK_SIZE
+#define FRAME_HEADER  16     // longs ahead of the arguments in a new frame
+#define SIZE_MASK    0x00ffffffffffffff  // omits the mark of a size word
+#define CACHE_LINE     64    // bytes in a cache line
+#define PREFETCH_LINES 8     // most lines prefetched of the next frame or stack
+#define HUGE_PAGE      0x200000  // bytes in a (2 MiB) hugepage
+#define MPOL_BIND_MODE 2     // MPOL_BIND, for binding chunks to a NUMA node
+#define IO_POLL_INTERVAL 64  // task switches between polls of the I/O reactor
+#if defined(SCCOR_SEPARATE_STACKS)
+#define PER_WORKER thread_local  // a variable of each worker thread
+#define IDLE_POLL_NS 1000000     // longest wait in the reactor with several
+                                 //   workers, which can't interrupt it
+#else
+#define PER_WORKER
+#endif
+
+// Instrumentation hooks, which compile to nothing without SCCOR_STATS.
+#if defined(SCCOR_STATS)
+#define STATS_CREATED( slot )           noteCreated( slot )
+#define STATS_ENTRY( slot, coroutine )  ( (slot)->stats.entry = (coroutine) )
+#define STATS_QUEUED( slot )            ( (slot)->queuedNs = wallNs() )
+#define STATS_RESUMED( slot, bytes )    noteResumed( slot, bytes )
+#define STATS_SUSPENDED( slot, bytes )  noteSuspended( slot, bytes )
+#define STATS_RETIRED( slot )           noteRetired( slot )
+#else
+#define STATS_CREATED( slot )
+#define STATS_ENTRY( slot, coroutine )
+#define STATS_QUEUED( slot )
+#define STATS_RESUMED( slot, bytes )
+#define STATS_SUSPENDED( slot, bytes )
+#define STATS_RETIRED( slot )
+#endif
+
+// Each chunk of the csa starts with this header.  The chunks are linked so
+// that they can be released.  The header fills a cache line, and chunks are
+// aligned to cache lines, so every block (a power of two of at least
+// MIN_BLOCK longs) starts on one.
+typedef struct alignas( CACHE_LINE ) Chunk {
+   struct Chunk *next ;    // next chunk of the csa
+   struct Chunk *prev ;    // previous chunk of the csa
+   long          longs ;   // number of longs following the header
+   unsigned long bytes ;   // size of the chunk, header included
+   bool          mapped ;  // by mmap (see setCsaPages), else by posix_memalign
+} Chunk ;
+
+// A slot describes one coroutine instance.  The slot keeps the block of the
+// csa holding the coroutine's saved stack frame (followed by the frame's size
+// word) for the life of the instance.  The slots of the suspended coroutines
+// are linked into the ring, so a task switch copies only the frames of the
+// coroutine being suspended and of the coroutine being resumed.
+//
+// With separate stacks, the slot keeps the coroutine's stack instead, which
+// stays with the slot when the coroutine finishes, for reuse by the next
+// coroutine instance given the slot.
+typedef struct Slot {
+#if defined(SCCOR_SEPARATE_STACKS)
+   long        *sp ;        // saved stack pointer
+   byte        *stack ;     // lowest usable address of the stack
+   long         stackSize ; // bytes in the stack, not counting the guard page
+#else
+   long        *frame ;     // saved stack frame and its size word
+   long         capacity ;  // number of longs in the frame's block
+   long         size ;      // size word (with mark) of the saved frame
+   long        *closure ;   // block holding invokeClosure's storage, or NULL
+   long         closureCapacity ; // number of longs in that block
+#endif
+   struct Slot *next ;      // next slot on the ring (or on a wait queue)
+   bool       (*step)( void * ) ; // of a stackless coroutine, or NULL
+   void        *stepContext ; //   and its argument
+   int          priority ;  // PRIORITY_LOW .. PRIORITY_CRITICAL
+   long long    deadline ;  // setDeadline() (clockNs), or -1
+   long long    wake ;      // deadline (clockNs) of a timed wait
+   int          timerIndex ; // place in the timer heap, or -1
+   WAIT_QUEUE  *queue ;     // wait queue the coroutine is parked on, or NULL
+   bool         signaled ;  // the last park ended by a signal, not a timeout
+   bool         parked ;    // off the ring, until unparked or timed out
+   bool         shielded ;  //   in a wait that cancel() does not end
+   bool         canceled ;  // cancel() has been called for the instance
+   bool         cancelPending ; // the next park is to return at once
+   unsigned long generation ; // instances in the slot that have finished
+   WAIT_QUEUE   joiners ;   // coroutines in join() for the instance
+#if defined(SCCOR_SEPARATE_STACKS)
+   int          home ;      // worker the coroutine is pinned to, or -1
+#endif
+#if defined(SCCOR_STATS)
+   COROUTINE_STATS stats ;  // see getCoroutineStats
+   long long    resumedNs ; // wallNs when last resumed
+   long long    queuedNs ;  // wallNs when last put on the ring
+   struct Slot *statsPrev,  // neighbours on the list of live instances
+               *statsNext ;
+#endif
+} Slot ;
+
+// SLOT_LONGS is the size (in longs) a new slot takes in the csa:  whole cache
+// lines, so the blocks carved after it stay aligned to them.
+const long SLOT_LONGS = ( sizeof( Slot ) + CACHE_LINE - 1 ) / CACHE_LINE 
+                        * ( CACHE_LINE / sizeof( long ) ) ;
+
+// The ring of runnable coroutines, as a FIFO run queue per priority level,
+// and (for POLICY_DEADLINE) a list of those with deadlines, earliest first.
+// The deadline list is kept sorted on insertion:  the coroutines declaring
+// deadlines are expected to be few.  Under POLICY_ROUND_ROBIN everything is
+// queued at PRIORITY_NORMAL, which makes a single ring.
+typedef struct RunQueue {
+   Slot *head[PRIORITY_LEVELS] ;   // next coroutine of each level to resume
+   Slot *tail[PRIORITY_LEVELS] ;   // most recently queued of each level
+   Slot *deadlines ;               // coroutines with deadlines
+} RunQueue ;
+
+#if defined(SCCOR_SEPARATE_STACKS)
+// Actions a worker leaves for just after a task switch, when the stack of the
+// coroutine switched away from is no longer in use.
+enum { PENDING_NONE, PENDING_REQUEUE, PENDING_RETIRE, PENDING_UNLOCK } ;
+
+// With several workers each worker thread has its own ring, guarded by a lock
+// so that other workers can steal from it.  Everything else shared by the
+// workers (the csa, the timers, and the wait queues) is guarded by the
+// scheduler lock.
+typedef struct Worker {
+   std::mutex   lock ;        // guards the ring
+   RunQueue     ring ;        // the worker's runnable coroutines
+   long        *mainSp ;      // stack pointer of the worker thread itself
+   int          index ;       // place in workers
+   int          pending ;     // action for after the next task switch
+   Slot        *pendingSlot ; //   and the coroutine it applies to
+   unsigned     ticks ;       // task switches, for servicing the waits
+   std::thread  thread ;
+} Worker ;
+#endif
 
 // Internal prototypes.
+HIDE void addTimer( Slot *slot ) ;
+HIDE long long clockNs( void ) ;
+HIDE void ensureRoom( long longs, long keep ) ;
+HIDE void freeBlock( long *block, long capacity ) ;
+HIDE COROUTINE_HANDLE handleOf( Slot *slot ) ;
+HIDE Slot *liveSlot( COROUTINE_HANDLE handle ) ;
+HIDE Chunk *mapChunk( unsigned long bytes, bool pooled ) ;
+HIDE Chunk *newChunk( long longs, bool pooled ) ;
+HIDE void prefetchSlot( const Slot *slot ) ;
+HIDE void releaseChunk( Chunk *chunk ) ;
+HIDE Slot *newSlot( void ) ;
+HIDE void putFirst( Slot *slot ) ;
+HIDE void putLast( Slot *slot ) ;
+HIDE Slot *rqPeek( const RunQueue *ring ) ;
+HIDE Slot *rqPop( RunQueue *ring, bool stealing ) ;
+HIDE void rqPush( RunQueue *ring, Slot *slot, bool first ) ;
+HIDE void parkSlot( Slot *slot, WAIT_QUEUE *queue, unsigned long waitMs ) ;
+HIDE void releaseJoiners( Slot *slot ) ;
+HIDE void releaseTimers( void ) ;
+HIDE void removeTimer( Slot *slot ) ;
+HIDE void requeueRunning( void ) ;
+HIDE void resetCsa( void ) ;
+HIDE void resumeNext( void ) ;
+HIDE void retireRunning( void ) ;
+HIDE void runStep( Slot *slot ) ;
+HIDE void unlinkWaiter( Slot *slot ) ;
+#if defined(SCCOR_STATS)
+HIDE void noteCreated( Slot *slot ) ;
+HIDE void noteResumed( Slot *slot, long bytes ) ;
+HIDE void noteRetired( Slot *slot ) ;
+HIDE void noteSuspended( Slot *slot, long bytes ) ;
+HIDE long long wallNs( void ) ;
+#endif
+#if defined(SCCOR_SEPARATE_STACKS)
+HIDE void exitCoroutine( void ) ;
+HIDE void finishCoroutine( void ) ;
+HIDE void layoutClosure( Slot *slot, long *top, COROUTINE coroutine, 
+                         int argCount, ... ) ;
+HIDE void layoutStack( Slot *slot, COROUTINE coroutine, int argCount, 
+                       va_list *arg, const long *array, long *top ) ;
+HIDE Slot *newCoroutine( void ) ;
+HIDE void newStack( Slot *slot ) ;
+HIDE COROUTINE_HANDLE spawn( COROUTINE coroutine, int argCount, va_list *arg ) ;
+HIDE void startSlot( Slot *slot ) ;
+HIDE void startCoroutine( void ) ;
+HIDE void switchStacks( long **saveSp, long *loadSp ) ;
+HIDE Slot *findWork( void ) ;
+HIDE void finishSwitch( void ) ;
+HIDE Slot *popWorker( Worker *worker, bool stealing ) ;
+HIDE void pushWorker( Worker *worker, Slot *slot, bool first ) ;
+HIDE void runWorkers( void ) ;
+HIDE long long serviceWaits( long long pollNs ) ;
+HIDE void switchAway( Slot *suspended, int action, Slot *next ) ;
+HIDE Slot *takeWork( bool service, bool locked = false ) ;
+HIDE Worker *thisWorker( void ) ;
+HIDE void wakeIdle( bool all ) ;
+HIDE void workerLoop( void ) ;
+HIDE void workerMain( int index ) ;
+#else
+HIDE long *allocBlock( long longs, long *capacity ) ;
 HIDE void cleanup( void ) ;
+HIDE void commitFrame( void ) ;
+HIDE void openFrame( void ) ;
 HIDE void popCoroutine( void ) ;
+HIDE void reserveFrame( int argCount ) ;
 HIDE void setBase( void ) ;
+HIDE void suspendRunning( void ) ;
+#endif
 
 // Utility prototype.
 //#define DEBUG_OUTPUT
@@ -100,8 +395,15 @@ HIDE void setBase( void ) ;
 /*******************************************************************************
 *                             Module Variables                                 *
 *******************************************************************************/
-/*HIDE*/ long csa[CSA_SIZE],  // coroutine storage area
-          *csavail = csa, // points to free space in csa
+/*HIDE*/ long *csatop = NULL, // points to the never-allocated space in the 
+                             //   current chunk of the csa
+          *csaend = NULL, // points to the end of the current chunk
+#if defined(SCCOR_SEPARATE_STACKS)
+          *mainSp ;       // cobegin's stack pointer while coroutines run
+#else
+          *csavail = NULL, // points to free space in csa while an instance
+                          //   is created, or past the size word of the
+                          //   frame popCoroutine is to load
 #if defined(CYGWIN)
           *COBEGIN_EPILOG,
 #else 
@@ -111,522 +413,3131 @@ HIDE void setBase( void ) ;
           *_RSP,
           *baseMinusSize, // addr for inserting stack for popped coroutine
           *base ;         // base of multi-tasker stack
+#endif
 
+#if defined(SCCOR_SEPARATE_STACKS)
+HIDE std::atomic<int> coroutineCount( 0 ) ;
+HIDE long stackSize = SCCOR_STACK_SIZE ;  // bytes in each new stack
+HIDE long pageSize ;                      // bytes in a (guard) page
+
+HIDE int      workerCount = 1 ;           // worker threads for a cobegin
+HIDE std::atomic<unsigned> nextWorker( 0 ) ; // worker given the next new
+                                          //   coroutine
+HIDE bool     pinThreads = false,         // bind worker i to processor i
+              threaded = false,           // several workers are running
+              allDone = false,            // the last coroutine has finished
+              ioPolling = false ;         // a worker is in the I/O reactor
+HIDE Worker  *workers = NULL ;
+HIDE thread_local Worker *self = NULL ;   // the worker of this thread
+HIDE std::mutex schedLock ;               // the scheduler lock
+HIDE std::mutex idleLock ;                // guards wakeSeq, for idleWake
+HIDE std::condition_variable &idleWake = // idle workers wait on this; never
+         *new std::condition_variable ;  //   destroyed, so exit() from a worker
+                                         //   doesn't wait for the idle ones
+HIDE std::atomic<int> idleCount( 0 ) ;    // workers waiting for work
+HIDE unsigned wakeSeq = 0 ;               // bumped when work is added while
+                                          //   some worker is idle
+#else
 HIDE int  coroutineCount = 0 ;
+#endif
+
+HIDE Chunk *chunks = NULL ;             // all the chunks of the csa
+HIDE unsigned long csaBytes = 0,        // total size of the chunks
+                   csaLimit = SCCOR_CSA_LIMIT ; // limit on csaBytes
+HIDE int csaPages = CSA_PAGES_NORMAL,   // backing of the chunks (setCsaPages)
+         csaNode = -1 ;                 // NUMA node of the chunks, or -1
+HIDE bool virtualTime = false ;         // clockNs reads the virtual clock
+HIDE long *freeBlocks[BLOCK_CLASSES] ;  // free lists, one per size class
+HIDE Slot *freeSlots = NULL ;           // slots of finished coroutines
+HIDE RunQueue ring ;                    // the runnable coroutines
+HIDE int   policy = POLICY_ROUND_ROBIN ; // how rqPush orders them
+HIDE Slot *spawned = NULL ;             // coroutine instance being (or last)
+                                        //   created
+HIDE PER_WORKER Slot *running = NULL ;  // coroutine currently executing
+HIDE PER_WORKER bool parking = false ;  // the running coroutine is to be kept
+                                        //   off the ring when it is suspended
+HIDE PER_WORKER bool stepParked = false ; // the step being run has parked, with
+                                        //   the scheduler locked
+HIDE int  stepCount = 0 ;               // stackless coroutines not finished
+HIDE bool draining = false ;            // running the stackless coroutines
+                                        //   left after the last classic one
+
+HIDE Slot **timers = NULL ;             // heap of waiting coroutines, the 
+                                        //   earliest deadline first
+HIDE int   timerCount = 0,
+           timerCapacity = 0 ;
+HIDE unsigned ioPollTick = 0 ;          // task switches since the reactor was
+                                        //   last polled
+#if defined(SCCOR_STATS)
+HIDE Slot *liveSlots = NULL ;           // instances not yet finished
+HIDE unsigned long lastId = 0 ;         // id of the latest instance
+HIDE bool  statsHistograms = false ;    // give new instances histograms
+HIDE void (*statsReport)( const COROUTINE_STATS * ) = NULL ;
+#endif
 
 
 /*******************************************************************************
 *                         Private Function Definitions                         *
 *******************************************************************************/
 
+#if ! defined(SCCOR_SEPARATE_STACKS)
 /*******************************************************************************
-* setBase                                                                      *
+* allocBlock                                                                   *
 *                                                                              *
-* Purpose: Determines the base of the coresume stack frame (i.e., rbp of each  *
-*          coroutine during its execution. The 'base' value is determined from *
-*          within this setBase function after it has been called by cobegin.   *
-*          The top of a coroutine's stack frame is popCoroutine's saved        *
-*          register area.                                                      *
+* Purpose: Returns a block of the csa holding at least 'longs' longs, reusing  *
+*          a freed block of the same size class when there is one.  The size   *
+*          of the block is returned through 'capacity'.  A block of            *
+*          CSA_CHUNK_SIZE longs or more has a chunk of its own.                *
 *******************************************************************************/
-HIDE void setBase( void )
+HIDE long *allocBlock( long longs, long *capacity )
 {
-   asm ( "movq %%rbp, %0" : "=rm" (base) : /* no inputs */ ) ;
+   long *block ;
+   int  sizeClass = 0 ;
 
-#if defined(__APPLE__) && defined(__MACH__)
-   coRBP = *base ;
+   *capacity = MIN_BLOCK ;
+   while ( *capacity < longs ) {
+      *capacity <<= 1 ;
+      ++sizeClass ;
+   }
+   if ( *capacity >= CSA_CHUNK_SIZE ) {
+      block = (long *)( newChunk( *capacity, false ) + 1 ) ;
+   } else if ( freeBlocks[sizeClass] != NULL ) {
+      block = freeBlocks[sizeClass] ;
+      freeBlocks[sizeClass] = (long *)*block ;
+   } else {
+      ensureRoom( *capacity, 0 ) ;
+      block = csatop ;
+      csatop += *capacity ;        // note pointer arithmetic
+   }
+   return block ;
+}
 #endif
-}     
 
 /*******************************************************************************
-* popCoroutine                                                                 *
-*                                                                              *
-* Purpose: (Re)starts a coroutine from the coroutine storage area.             *
-*                                                                              *
-* Prerequisite: The rsp has already been moved so that popCoroutine's stack    *
-*               frame will be out of the way of next coroutine's stack frame.  *
+* newChunk                                                                     *
 *                                                                              *
+* Purpose: Adds a chunk of at least 'longs' longs to the csa.  A 'pooled'      *
+*          chunk (one carved into blocks, rather than the block of a single    *
+*          large frame) is mapped on hugepages if setCsaPages asked for them,  *
+*          and then grows to fill them.  The program ends with a message if    *
+*          the chunk would take the csa beyond its limit.                      *
 *******************************************************************************/
-HIDE void popCoroutine( void )                                               
+HIDE Chunk *newChunk( long longs, bool pooled )
 {
-   // Tell Clang to save rbx (and rdi and rsi in Cygwin), as required by the
-   // x86_64 ABI, so we'll have a  repeatable (if redundant) behavior in this 
-   // routine's prologue (since it doesn't seem possible to get Clang to treat 
-   // a C routine as a _declspec( naked ) routine). Clang will pop the rbx 
-   // (and rdi and rsi in Cygwin) register(s) here and again in the caller.
-#if defined(CYGWIN)
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
-                                                                 "%rdi", 
-                                                                 "%rbx" ) ;
-#else
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
-#endif
-   _size = *--csavail ;       // number of 64-bit entries in coroutine instance
+   Chunk *chunk = NULL ;
+   unsigned long bytes = sizeof( Chunk ) + longs * sizeof( long ) ;
+   bool  mapped = csaPages != CSA_PAGES_NORMAL || csaNode >= 0 ;
 
-   // The high-order byte of _size is marked for coroutine instances which 
-   // have not yet been loaded. This allows us to load the appropriate 
-   // x86_64 (macOS) or X64 (Cygwin) ABI registers for a simulated call to 
-   // the instance.  Subsequently, the high-order byte of _size will be 
-   // 0x00 and no registers need be loaded.
-   int8_t mark = 0 ;
-   long *p = csavail - 1 ;          // temp pointer to first parameter
-   if ( _size < 0 ) {
-      // This is a virgin coroutine instance, so we'll simulate a call 
-      // by loading the appropriate registers. 
-      mark = ( (int8_t)(_size >> 56) ) & 0x7F ;
-      _size &= 0x00ffffffffffffff ; // omit mark for below
-   }
-   baseMinusSize = base - _size - 2 ; // note pointer arithmetic
-   csavail -= _size ;               // note pointer arithmetic
+   if ( mapped ) {
+      unsigned long granule = pooled && csaPages != CSA_PAGES_NORMAL 
+                              ? HUGE_PAGE : sysconf( _SC_PAGESIZE ) ;
 
-   // Fetch coroutine from csavail to (base - _size - 2) for _size longs.
-   _RSP = baseMinusSize - MAGIC_OFFSET / sizeof( long ) ;
-   memcpy( baseMinusSize, csavail, _size * sizeof( long ) ) ;
-   if ( mark > 0) {
-      if ( mark % 2 ) {
-         --p ; // skip filler
-      }      
-      long *first_p = p ;           // pointer to first parameter
-      int8_t excessCount = mark - IN_REGISTERS_COUNT ;
-      if ( mark > IN_REGISTERS_COUNT ) {
-         // We'll leave excess parameters (more than the IN_REGISTERS_COUNT, 
-         // which go in registers) on the stack.
-         mark = IN_REGISTERS_COUNT ;
-         p -= excessCount ;         // point to IN_REGISTERS_COUNTth parameter
-      } 
-      if ( excessCount > 0 ) {
-         // Move non-register parameters to their place on the stack.
-#if defined(__APPLE__) && defined(__MACH__)
-         memmove( baseMinusSize + 4, first_p - excessCount + 1, 
-                  excessCount * sizeof( long ) ) ;
-#elif defined(CYGWIN)
-         // The excess parameters go on top of the shadow space (32-byte
-         // area reserved for the callee's use).
-         memmove( baseMinusSize + 6 + 4, first_p - excessCount + 1, 
-                  excessCount * sizeof( long ) ) ;
-#else
-   #pragma GCC error "Only 64-bit macOS or Windows Cygwin with Clang supported."
-#endif
+      bytes = ( bytes + granule - 1 ) / granule * granule ;
+   }
+   if ( csaBytes + bytes <= csaLimit ) {
+      if ( mapped ) {
+         chunk = mapChunk( bytes, pooled ) ;
+      } else if ( posix_memalign( (void **)&chunk, CACHE_LINE, bytes ) != 0 ) {
+         chunk = NULL ;
       }
-      switch ( mark ) {
-#if defined(__APPLE__) && defined(__MACH__)
-         case 6:
-            asm ( "movq %0, %%r9" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 5:
-            asm ( "movq %0, %%r8" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 4:
-            asm ( "movq %0, %%rcx" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 3:
-            asm ( "movq %0, %%rdx" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 2:
-            asm ( "movq %0, %%rsi" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 1:       
-            asm ( "movq %0, %%rdi" : /* no outputs */ : "rm" (*p) ) ;
-#elif defined(CYGWIN)
-         case 4:
-            asm ( "movq %0, %%r9" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
-
-         case 3:
-            asm ( "movq %0, %%r8" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
+   }
+   if ( chunk == NULL ) {
+      printf( "sccor: the CSA cannot grow beyond its limit of %lu bytes\n",
+              csaLimit ) ;
+      exit( 1 ) ;
+   }
+   csaBytes += bytes ;
+   chunk->longs = ( bytes - sizeof( Chunk ) ) / sizeof( long ) ;
+   chunk->bytes = bytes ;
+   chunk->mapped = mapped ;
+   chunk->prev = NULL ;
+   chunk->next = chunks ;
+   if ( chunks != NULL ) {
+      chunks->prev = chunk ;
+   }
+   chunks = chunk ;
+   return chunk ;
+}
 
-         case 2:
-            asm ( "movq %0, %%rdx" : /* no outputs */ : "rm" (*p) ) ;
-            --p ;                   // contine to next case
+/*******************************************************************************
+* mapChunk                                                                     *
+*                                                                              *
+* Purpose: Maps 'bytes' (a multiple of the page size) for a chunk of the csa,  *
+*          returning NULL if it cannot.  A pooled chunk is mapped on hugepages *
+*          when setCsaPages asked for them:  from the hugetlb pool, falling    *
+*          back to transparent hugepages, for which the area is aligned to a   *
+*          hugepage.  On Linux the area is then bound to the NUMA node, if     *
+*          one was chosen, before its pages are first touched.                 *
+*******************************************************************************/
+HIDE Chunk *mapChunk( unsigned long bytes, bool pooled )
+{
+   byte *area = (byte *)MAP_FAILED ;
+   bool  huge = pooled && csaPages != CSA_PAGES_NORMAL ;
 
-         case 1:       
-            asm ( "movq %0, %%rcx" : /* no outputs */ : "rm" (*p) ) ;
-#else
-   #pragma GCC error "Only 64-bit macOS or Windows Cygwin with Clang supported."
+#if defined(MAP_HUGETLB)
+   if ( huge && csaPages == CSA_PAGES_HUGETLB ) {
+      area = (byte *)mmap( NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0 ) ;
+   }
 #endif
-            break ;      
+   if ( area == (byte *)MAP_FAILED ) {
+      unsigned long slack = huge ? HUGE_PAGE : 0 ;
+
+      area = (byte *)mmap( NULL, bytes + slack, PROT_READ | PROT_WRITE, 
+                           MAP_PRIVATE | MAP_ANON, -1, 0 ) ;
+      if ( area == (byte *)MAP_FAILED ) {
+         return NULL ;
+      }
+      // Trim the area to a hugepage boundary, so the kernel can back it with
+      // whole hugepages.
+      if ( slack > 0 ) {
+         byte *aligned = (byte *)( ( (uintptr_t)area + slack - 1 ) 
+                                   & ~(uintptr_t)( slack - 1 ) ) ;
+
+         if ( aligned > area ) {
+            munmap( area, aligned - area ) ;
+         }
+         if ( aligned < area + slack ) {
+            munmap( aligned + bytes, area + slack - aligned ) ;
+         }
+         area = aligned ;
+      }
+#if defined(MADV_HUGEPAGE)
+      if ( huge ) {
+         madvise( area, bytes, MADV_HUGEPAGE ) ;
       }
+#endif
    }
+#if defined(__linux__) && defined(SYS_mbind)
+   if ( csaNode >= 0 && csaNode < (int)( 8 * sizeof( unsigned long ) ) ) {
+      unsigned long nodes = 1UL << csaNode ;
 
-   asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+      // Best effort:  without the node (or NUMA), the pages go where they may.
+      syscall( SYS_mbind, area, bytes, MPOL_BIND_MODE, &nodes, 
+               8 * sizeof( unsigned long ) + 1, 0 ) ;
+   }
+#endif
+   return (Chunk *)area ;
 }
 
 /*******************************************************************************
-* cleanup                                                                      *
+* releaseChunk                                                                 *
 *                                                                              *
-* Purpose: Retrieves another coroutine from the csa when a coroutine returns   *
-*          to end its execution.                                               *
+* Purpose: Gives the memory of a chunk of the csa back, as it was obtained.    *
+*******************************************************************************/
+HIDE void releaseChunk( Chunk *chunk )
+{
+   csaBytes -= chunk->bytes ;
+   if ( chunk->mapped ) {
+      munmap( chunk, chunk->bytes ) ;
+   } else {
+      free( chunk ) ;
+   }
+}
+
+/*******************************************************************************
+* ensureRoom                                                                   *
 *                                                                              *
-*          Handles task termination by returning to cobegin when there are no  *
-*          more active coroutines.                                             *
+* Purpose: Makes sure that the current chunk of the csa has room for 'longs'   *
+*          longs at csatop, starting a new chunk if it does not.  The first    *
+*          'keep' longs at csatop (a partly built frame) are moved to the new  *
+*          chunk, and the rest of the old chunk is put on the free lists.      *
 *******************************************************************************/
-HIDE void cleanup( void )
+HIDE void ensureRoom( long longs, long keep )
 {
-   // cleanup must restore cobegin's rbx (and rdi and rsi on Cygwin) on return.
-#if defined(CYGWIN)
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
-                                                                 "%rdi", 
-                                                                 "%rbx" ) ;
-#else
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
-#endif
-   if ( !--coroutineCount )
-   {
-      // Adjust rsp to return to point to rbx as in cobegin's epilog.
-#if defined(CYGWIN)
-      asm volatile ( "movq %0, %%rsp" : /* no outputs */ 
-                                      : "rm" (COBEGIN_EPILOG) : "%rsp" ) ;
-#else
-      _RSP = (long *)coRBP - CLEANUP_RSP_ADJUST / sizeof( long ) - 1 ;  // cobegin's 
-                                                                        //   RBX
-      asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
-#endif
+   Chunk *chunk ;
+   long  *oldTop = csatop,
+         *oldEnd = csaend ;
 
+   if ( csatop != NULL && csaend - csatop >= longs ) {
       return ;
    }
+   chunk = newChunk( longs > CSA_CHUNK_SIZE ? longs : CSA_CHUNK_SIZE, true ) ;
+   csatop = (long *)( chunk + 1 ) ;
+   csaend = csatop + chunk->longs ;
 
-   // Move popCoroutine's stack frame out of the way of the coroutine instance
-   // we're copying in.
-   _size = *(csavail - 1) ; // number of longs in coroutine entry
-   _size &= 0x00ffffffffffffff ; // omit mark
+   if ( keep > 0 ) {
+      memcpy( csatop, oldTop, keep * sizeof( long ) ) ;
+   }
+   // Carve what is left of the old chunk into the largest blocks it holds.
+   while ( oldTop != NULL && oldEnd - oldTop >= MIN_BLOCK ) {
+      long capacity = MIN_BLOCK ;
+      while ( capacity * 2 <= oldEnd - oldTop && capacity < CSA_CHUNK_SIZE / 2 ) {
+         capacity *= 2 ;
+      }
+      freeBlock( oldTop, capacity ) ;
+      oldTop += capacity ;
+   }
+}
 
-   asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */ ) ;
+/*******************************************************************************
+* freeBlock                                                                    *
+*                                                                              *
+* Purpose: Returns a block obtained from allocBlock to its free list.  A block *
+*          with a chunk of its own is released along with the chunk.           *
+*******************************************************************************/
+HIDE void freeBlock( long *block, long capacity )
+{
+   int sizeClass = 0 ;
 
-   // The stack pointer should be on a 16-byte boundary before any call.
-   _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
-   asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+   if ( capacity >= CSA_CHUNK_SIZE ) {
+      Chunk *chunk = (Chunk *)block - 1 ; // the block is the whole chunk
 
-   popCoroutine() ;
+      if ( chunk->prev != NULL ) {
+         chunk->prev->next = chunk->next ;
+      } else {
+         chunks = chunk->next ;
+      }
+      if ( chunk->next != NULL ) {
+         chunk->next->prev = chunk->prev ;
+      }
+      releaseChunk( chunk ) ;
+      return ;
+   }
+   while ( ( MIN_BLOCK << sizeClass ) < capacity ) {
+      ++sizeClass ;
+   }
+   *block = (long)freeBlocks[sizeClass] ;
+   freeBlocks[sizeClass] = block ;
 }
 
-
 /*******************************************************************************
-*                            Public Functions (API)                            *
+* newSlot                                                                      *
+*                                                                              *
+* Purpose: Returns a slot for a new coroutine instance, reusing the slot of a  *
+*          finished coroutine when there is one.  A new slot takes SLOT_LONGS  *
+*          longs of the csa.                                                   *
 *******************************************************************************/
+HIDE Slot *newSlot( void )
+{
+   Slot *slot = freeSlots ;
+
+   if ( slot != NULL ) {
+      freeSlots = slot->next ;
+   } else {
+      ensureRoom( SLOT_LONGS, 0 ) ;
+      slot = (Slot *)csatop ;
+      csatop += SLOT_LONGS ;
+      memset( slot, 0, sizeof( Slot ) ) ;
+   }
+   slot->timerIndex = -1 ;
+   slot->queue = NULL ;
+   slot->parked = slot->canceled = slot->cancelPending = false ;
+   slot->step = NULL ;
+   slot->priority = PRIORITY_NORMAL ;
+   slot->deadline = -1 ;
+#if defined(SCCOR_SEPARATE_STACKS)
+   slot->home = -1 ;
+#else
+   slot->closure = NULL ;
+#endif
+   STATS_CREATED( slot ) ;
+   return slot ;
+}
 
 /*******************************************************************************
-* cobegin                                                                      *
-*                                                                              *
-* Purpose: Initialize the multitasker and start n coroutine instances          *
-*          on the ring.                                                        *
-*                                                                              *
-* Remarks on usage : Associated with each coroutine is an argument             *
-*                    list (which may be empty).  For example,                  *
-*                                                                              *
-*                       cobegin( 2,                                            *
-*                                coroutine1, 0,                                *
-*                                coroutine2, 3, longvar1, longvar2, longvar3 );*
+* handleOf                                                                     *
 *                                                                              *
-*                    would start two coroutine instances, coroutine1 and       *
-*                    coroutine2.  The first takes no arguments and             *
-*                    the second takes three longs (64-bits each) as arguments: *
+* Purpose: Returns the handle of the coroutine instance in a slot.  Taken      *
+*          before the instance is put on the ring, while it cannot finish.     *
+*******************************************************************************/
+HIDE COROUTINE_HANDLE handleOf( Slot *slot )
+{
+   COROUTINE_HANDLE handle = { slot, slot->generation } ;
+
+   return handle ;
+}
+
+/*******************************************************************************
+* liveSlot                                                                     *
 *                                                                              *
-*                       3 = (sizeof longvar1 + sizeof longvar2                 *
-*                           + sizeof longvar3) / (8 bytes/long)                *
-*                         = 24 / 8                                             *
+* Purpose: Returns the slot of the instance a handle refers to, or NULL if the *
+*          instance has finished (or there is none).  Called with the          *
+*          scheduler locked.                                                   *
 *******************************************************************************/
-void cobegin( int n, ... )
+HIDE Slot *liveSlot( COROUTINE_HANDLE handle )
 {
-   int8_t  argCount, fillerCount = 0 ;
-   va_list arg ;
+   Slot *slot = (Slot *)handle.slot ;
 
-   setBase() ;
+   return slot != NULL && slot->generation == handle.generation ? slot : NULL ;
+}
 
-   asm volatile ( "movq %%rsp, %0" : "=rm" (COBEGIN_EPILOG): /* no inputs */ ) ;
-   // Address of saved rbx at top of cobegin's epilog:
-   COBEGIN_EPILOG += ( COBEGIN_STACK_ADJUST - CLEANUP_STACK_ADJUST ) 
-                                                               / sizeof(long) ; 
+/*******************************************************************************
+* putFirst                                                                     *
+*                                                                              *
+* Purpose: Puts a coroutine at the front of the ring, so it runs next.         *
+*******************************************************************************/
+HIDE void putFirst( Slot *slot )
+{
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded ) {
+      // Spread new work across the workers.
+      pushWorker( slot->home >= 0 ? &workers[slot->home] 
+                                  : &workers[nextWorker.fetch_add( 1, 
+                                              std::memory_order_relaxed ) 
+                                             % workerCount], 
+                  slot, true ) ;
+      return ;
+   }
+#endif
+   rqPush( &ring, slot, true ) ;
+}
 
-   #ifdef DEBUG_OUTPUT
-   printf( " base: 0x%08lx\n", (unsigned long)base ) ;
-   #endif // def DEBUG_OUTPUT
+/*******************************************************************************
+* putLast                                                                      *
+*                                                                              *
+* Purpose: Puts a coroutine at the back of the ring.  With several workers,   *
+*          that is the ring of the worker it is pinned to, or else of the      *
+*          current worker.                                                     *
+*******************************************************************************/
+HIDE void putLast( Slot *slot )
+{
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded ) {
+      pushWorker( slot->home >= 0 ? &workers[slot->home] : thisWorker(), 
+                  slot, false ) ;
+      return ;
+   }
+#endif
+   rqPush( &ring, slot, false ) ;
+}
 
-   va_start( arg, n ) ;
-   while ( n-- ) {
-      // This code is essentially an:
-      //    invoke( coroutine, argCount, arg1, arg2, arg3, ... ) ;
+/*******************************************************************************
+* rqPush                                                                       *
+*                                                                              *
+* Purpose: Puts a coroutine at the front or back of its place in a run queue:  *
+*          its priority level, or the deadline list (after any equal deadline  *
+*          when put at the back).                                              *
+*******************************************************************************/
+HIDE void rqPush( RunQueue *ring, Slot *slot, bool first )
+{
+   int level = policy == POLICY_ROUND_ROBIN ? PRIORITY_NORMAL : slot->priority ;
 
-                        // popCoroutine's rbp
-      *csavail++ = 0 ;  // rbx placeholder
-#if defined(CYGWIN)
-      *csavail++ = 0 ;  // rdi placeholder
-      *csavail++ = 0 ;  // rsi placeholder
+   STATS_QUEUED( slot ) ;
+   if ( policy == POLICY_DEADLINE && slot->deadline >= 0 ) {
+      Slot **link = &ring->deadlines ;
+
+      while ( *link != NULL && ( (*link)->deadline < slot->deadline 
+                                 || ( ! first && (*link)->deadline == slot->deadline ) ) ) {
+         link = &(*link)->next ;
+      }
+      slot->next = *link ;
+      *link = slot ;
+   } else if ( first ) {
+      slot->next = ring->head[level] ;
+      ring->head[level] = slot ;
+      if ( ring->tail[level] == NULL ) {
+         ring->tail[level] = slot ;
+      }
+   } else {
+      slot->next = NULL ;
+      if ( ring->tail[level] != NULL ) {
+         ring->tail[level]->next = slot ;
+      } else {
+         ring->head[level] = slot ;
+      }
+      ring->tail[level] = slot ;
+   }
+}
+
+/*******************************************************************************
+* rqPeek                                                                       *
+*                                                                              *
+* Purpose: Returns the coroutine rqPop would take next (not stealing), left on *
+*          the run queue, or NULL if there is none.                            *
+*******************************************************************************/
+HIDE Slot *rqPeek( const RunQueue *ring )
+{
+   if ( ring->deadlines != NULL ) {
+      return ring->deadlines ;
+   }
+   for ( int level = PRIORITY_LEVELS - 1; level >= 0; level-- ) {
+      if ( ring->head[level] != NULL ) {
+         return ring->head[level] ;
+      }
+   }
+   return NULL ;
+}
+
+/*******************************************************************************
+* prefetchSlot                                                                 *
+*                                                                              *
+* Purpose: Starts bringing into the cache what resuming a coroutine will read  *
+*          first:  its saved frame (up to PREFETCH_LINES lines of it), or with *
+*          separate stacks the top of its stack, so that the misses overlap    *
+*          the rest of the task switch.  Does nothing for a NULL slot or a     *
+*          stackless coroutine.                                                *
+*******************************************************************************/
+HIDE void prefetchSlot( const Slot *slot )
+{
+   const char *from ;
+   long lines = PREFETCH_LINES ;
+
+   if ( slot == NULL || slot->step != NULL ) {
+      return ;
+   }
+#if defined(SCCOR_SEPARATE_STACKS)
+   from = (const char *)slot->sp ;
+#else
+   from = (const char *)slot->frame ;
+   if ( ( ( slot->size & SIZE_MASK ) + 1 ) * sizeof( long ) < lines * CACHE_LINE ) {
+      lines = ( ( ( slot->size & SIZE_MASK ) + 1 ) * sizeof( long ) 
+                + CACHE_LINE - 1 ) / CACHE_LINE ;
+   }
 #endif
-      *csavail++ = (long)base ;
-      *csavail++ = (long)( va_arg( arg, COROUTINE ) ) ;
-      *csavail++ = (long)( (long)cleanup + CLEANUP_OFFSET ) ; // keeping same
-                                                              //  rbp and rsp
-      fillerCount = 0 ;
-#if defined(CYGWIN)
-      *csavail++ = SHADOW_SPACE_VALUE ;  // 32-byte shadow space
-      ++fillerCount ;             
-      *csavail++ = SHADOW_SPACE_VALUE ;  
-      ++fillerCount ;             
-      *csavail++ = SHADOW_SPACE_VALUE ;  
-      ++fillerCount ;             
-      *csavail++ = SHADOW_SPACE_VALUE ;  
-      ++fillerCount ;             
+   for ( long i = 0; i < lines; i++ ) {
+      __builtin_prefetch( from + i * CACHE_LINE ) ;
+   }
+}
+
+/*******************************************************************************
+* rqPop                                                                        *
+*                                                                              *
+* Purpose: Takes the next coroutine from a run queue:  the earliest deadline,  *
+*          else the front of the highest non-empty level.  A worker stealing   *
+*          takes the first such coroutine not pinned to the queue's worker.    *
+*          Returns NULL if there is none.                                      *
+*******************************************************************************/
+HIDE Slot *rqPop( RunQueue *ring, bool stealing )
+{
+   Slot **link = &ring->deadlines ;
+   int    level = PRIORITY_LEVELS ;
+
+   for ( ;; ) {
+      Slot *prev = NULL ;
+
+      for ( Slot *slot = *link; slot != NULL; prev = slot, slot = slot->next ) {
+#if defined(SCCOR_SEPARATE_STACKS)
+         if ( stealing && slot->home >= 0 ) {
+            continue ;
+         }
 #endif
-      argCount = va_arg( arg, int ) ;
-      if ( argCount > 0) { 
-         for ( int i = 0; i < argCount; i++ ) {
-            *csavail++ = (long)( va_arg( arg, long ) );
+         if ( prev != NULL ) {
+            prev->next = slot->next ;
+         } else {
+            *link = slot->next ;
          }
+         if ( level < PRIORITY_LEVELS && ring->tail[level] == slot ) {
+            ring->tail[level] = prev ;
+         }
+         return slot ;
+      }
+      if ( level == 0 ) {
+         return NULL ;
+      }
+      link = &ring->head[--level] ;
+   }
+}
 
-         switch ( argCount % 2 ) // filler to ensure 16-byte boundary;
-         {
-            case 0:
-               break ;          // do nothing
+/*******************************************************************************
+* requeueRunning                                                               *
+*                                                                              *
+* Purpose: Puts the coroutine being suspended at the back of the ring, unless  *
+*          it is parking (i.e., waiting off the ring).                         *
+*******************************************************************************/
+HIDE void requeueRunning( void )
+{
+   if ( parking ) {
+      parking = false ;
+   } else {
+      putLast( running ) ;
+   }
+}
 
-            case 1:
-               *csavail++ = FILLER_VALUE ;  
-               ++fillerCount ;             
-               break;
-         }
-      } else if ( argCount == 0 ) {
-         *csavail++ = FILLER_VALUE ;  
-         ++fillerCount ;             
-         *csavail++ = FILLER_VALUE ;  
-         ++fillerCount ;             
-      } 
-#if defined(CYGWIN)
-#define LONG_COUNT 4
-#else
-#define LONG_COUNT 2
+/*******************************************************************************
+* clockNs                                                                      *
+*                                                                              *
+* Purpose: Returns the time, in ns, of the clock used for deadlines:  the      *
+*          monotonic clock (the clock of TimeIntervalHistogram::tally), or in  *
+*          virtual time the virtual clock, which only moves when every         *
+*          coroutine is waiting (see resumeNext).                              *
+*******************************************************************************/
+HIDE long long clockNs( void )
+{
+   static const IntervalClock deadlineClock ;
+
+   return virtualTime ? (long long)IntervalClock::VirtualNs() 
+                      : (long long)deadlineClock.Ns() ;
+}
+
+/*******************************************************************************
+* addTimer                                                                     *
+*                                                                              *
+* Purpose: Adds a coroutine, whose deadline is in slot->wake, to the timer     *
+*          heap.                                                               *
+*******************************************************************************/
+HIDE void addTimer( Slot *slot )
+{
+   int i = timerCount++ ;
+
+   if ( timerCount > timerCapacity ) {
+      timerCapacity = timerCapacity ? timerCapacity * 2 : 64 ;
+      timers = (Slot **)realloc( timers, timerCapacity * sizeof( Slot * ) ) ;
+      if ( timers == NULL ) {
+         printf( "sccor: timer heap allocation failure\n" ) ;
+         exit( 1 ) ;
+      }
+   }
+   // Sift the new timer up from the bottom of the heap.
+   while ( i > 0 && timers[( i - 1 ) / 2]->wake > slot->wake ) {
+      timers[i] = timers[( i - 1 ) / 2] ;
+      timers[i]->timerIndex = i ;
+      i = ( i - 1 ) / 2 ;
+   }
+   timers[i] = slot ;
+   slot->timerIndex = i ;
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded && i == 0 ) {
+      // An idle worker may be waiting for a later deadline, or for none.
+      wakeIdle( false ) ;
+   }
 #endif
-      long coroutineSize = argCount + fillerCount
-         + ( sizeof( long ) * LONG_COUNT + (sizeof( COROUTINE ) * 2) ) 
-                                                             / sizeof( long ) ;
-      // Since this coroutine hasn't been executed, we mark the size in the 
-      // high-order byte with (0x80 | argCount) so popCoroutine
-      // can load the ABI registers with the parameters only on startup
-      // of the coroutine. So, if we mark the high-order byte as 0x83, 
-      // there are 3 args for the coroutine, which will be loaded into 
-      // registers rdi, rsi, and rdx by popCoroutine on the first time  
-      // the coroutine is loaded (to simulate calling the coroutine).  
-      // Subsequently, the high-order byte will be zero, so no registers 
-      // will get loaded by popCoroutine.
-      uint8_t mark = 0x80 | argCount ;
-      coroutineSize |= ( (long)mark << 56 ) ;
-      *csavail++ = coroutineSize ;
-      ++coroutineCount ;
+}
+
+/*******************************************************************************
+* removeTimer                                                                  *
+*                                                                              *
+* Purpose: Removes a coroutine from the timer heap.                            *
+*******************************************************************************/
+HIDE void removeTimer( Slot *slot )
+{
+   int   i = slot->timerIndex ;
+   Slot *last = timers[--timerCount] ;
+
+   slot->timerIndex = -1 ;
+   if ( last == slot ) {
+      return ;
    }
-   va_end( arg );
+   // Put the last timer in the hole, and sift it up or down as needed.
+   while ( i > 0 && timers[( i - 1 ) / 2]->wake > last->wake ) {
+      timers[i] = timers[( i - 1 ) / 2] ;
+      timers[i]->timerIndex = i ;
+      i = ( i - 1 ) / 2 ;
+   }
+   for ( ;; ) {
+      int child = 2 * i + 1 ;
 
-   #ifdef DEBUG_OUTPUT
-   #endif // def DEBUG_OUTPUT
+      if ( child >= timerCount ) {
+         break ;
+      }
+      if ( child + 1 < timerCount && timers[child + 1]->wake < timers[child]->wake ) {
+         ++child ;
+      }
+      if ( timers[child]->wake >= last->wake ) {
+         break ;
+      }
+      timers[i] = timers[child] ;
+      timers[i]->timerIndex = i ;
+      i = child ;
+   }
+   timers[i] = last ;
+   last->timerIndex = i ;
+}
 
-   // Tell Clang to save rbx (and rdi and rsi on Cygwin)** so popCoroutine 
-   // can write the new routine's value to the stack location from which 
-   // it will be restored:
-   //     :  :  :
-   //    pop %rbx    <----- baseMinusSize points to rbx for stack frame top
-   //  **pop %rdi    
-   //  **pop %rsi
-   //    pop %rbp
-   //    ret
-   //
-   // in cobegin's epilogue.
-#if defined(CYGWIN)
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
-                                                                 "%rdi", 
-                                                                 "%rbx" ) ;
-#else
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
+/*******************************************************************************
+* releaseTimers                                                                *
+*                                                                              *
+* Purpose: Puts the waiting coroutines whose deadlines have passed at the back *
+*          of the ring, the earliest deadline first.                           *
+*******************************************************************************/
+HIDE void releaseTimers( void )
+{
+   long long now = clockNs() ;
+
+   while ( timerCount > 0 && timers[0]->wake <= now ) {
+      Slot *slot = timers[0] ;
+
+      removeTimer( slot ) ;
+      if ( slot->queue != NULL ) {
+         unlinkWaiter( slot ) ;
+      }
+      slot->parked = false ;
+      putLast( slot ) ;
+   }
+}
+
+/*******************************************************************************
+* releaseJoiners                                                               *
+*                                                                              *
+* Purpose: Ends the instance in a slot, as far as handles are concerned, and   *
+*          puts the coroutines joining it at the back of the ring.  Called     *
+*          with the scheduler locked.                                          *
+*******************************************************************************/
+HIDE void releaseJoiners( Slot *slot )
+{
+   ++slot->generation ;
+   while ( unpark( &slot->joiners ) ) {
+   }
+}
+
+/*******************************************************************************
+* park                                                                         *
+*                                                                              *
+* Purpose: Suspends the running coroutine on a wait queue (none for a plain   *
+*          wait), off the ring, until unpark() releases it or waitMs ms pass   *
+*          (never, for WAIT_FOREVER).  Returns true if the coroutine was       *
+*          released by unpark(), false on timeout or cancel().  The scheduler  *
+*          lock, taken by the caller, is released once the coroutine is        *
+*          suspended.                                                          *
+*******************************************************************************/
+bool park( WAIT_QUEUE *queue, unsigned long waitMs )
+{
+   Slot *slot = running ;
+
+   if ( slot == NULL ) {
+      printf( "sccor: blocking outside of a coroutine\n" ) ;
+      exit( 1 ) ;
+   }
+   if ( slot->step != NULL ) {
+      printf( "sccor: blocking in a stackless coroutine (co_await instead)\n" ) ;
+      exit( 1 ) ;
+   }
+   if ( slot->cancelPending ) {
+      // Canceled while not parked:  this wait ends at once.
+      slot->cancelPending = slot->signaled = false ;
+      unlockScheduler() ;
+      return false ;
+   }
+   parkSlot( slot, queue, waitMs ) ;
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded ) {
+      switchAway( slot, PENDING_UNLOCK, takeWork( false, true ) ) ;
+      return slot->signaled ;
+   }
 #endif
-   if ( coroutineCount > 0 ) { 
-      // Move popCoroutine's stack frame out of the way of the coroutine
-      // we're copying in.
-      _size = *(csavail - 1) ;      // number of longs in coroutine entry
-      _size &= 0x00ffffffffffffff ; // omit mark
+   parking = true ;
+   coresume() ;
+   return slot->signaled ;
+}
 
-      asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */) ;
+/*******************************************************************************
+* parkSlot                                                                     *
+*                                                                              *
+* Purpose: Puts a coroutine being suspended at the back of a wait queue (none  *
+*          for a plain wait), and on the timer heap unless waitMs is           *
+*          WAIT_FOREVER.                                                       *
+*******************************************************************************/
+HIDE void parkSlot( Slot *slot, WAIT_QUEUE *queue, unsigned long waitMs )
+{
+   if ( queue != NULL ) {
+      slot->next = NULL ;
+      if ( queue->tail != NULL ) {
+         ( (Slot *)queue->tail )->next = slot ;
+      } else {
+         queue->head = slot ;
+      }
+      queue->tail = slot ;
+   }
+   slot->queue = queue ;
+   slot->signaled = false ;
+   slot->parked = true ;
+   slot->shielded = false ;
+   if ( waitMs != WAIT_FOREVER ) {
+      slot->wake = clockNs() + (long long)waitMs * 1000000 ;
+      addTimer( slot ) ;
+   }
+}
 
-      // The stack pointer should be on a 16-byte boundary before any call.
-      _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
-      asm volatile ("movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp") ;
+/*******************************************************************************
+* lockScheduler                                                                *
+*                                                                              *
+* Purpose: Takes the scheduler lock, when several workers are running.        *
+*******************************************************************************/
+void lockScheduler( void )
+{
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded ) {
+      schedLock.lock() ;
+   }
+#endif
+}
 
-      popCoroutine() ;
+/*******************************************************************************
+* unlockScheduler                                                              *
+*                                                                              *
+* Purpose: Releases the scheduler lock, when several workers are running.     *
+*******************************************************************************/
+void unlockScheduler( void )
+{
+#if defined(SCCOR_SEPARATE_STACKS)
+   if ( threaded ) {
+      schedLock.unlock() ;
+   }
+#endif
+}
+
+/*******************************************************************************
+* unpark                                                                       *
+*                                                                              *
+* Purpose: Puts the coroutine at the front of a wait queue at the back of the  *
+*          ring, cancelling its timeout.  Returns false if the queue is empty. *
+*******************************************************************************/
+bool unpark( WAIT_QUEUE *queue )
+{
+   Slot *slot = (Slot *)queue->head ;
+
+   if ( slot == NULL ) {
+      return false ;
+   }
+   queue->head = slot->next ;
+   if ( queue->head == NULL ) {
+      queue->tail = NULL ;
+   }
+   if ( slot->timerIndex >= 0 ) {
+      removeTimer( slot ) ;
+   }
+   slot->queue = NULL ;
+   slot->signaled = true ;
+   slot->parked = false ;
+   putLast( slot ) ;
+   return true ;
+}
+
+/*******************************************************************************
+* unlinkWaiter                                                                 *
+*                                                                              *
+* Purpose: Takes a coroutine whose timeout has passed off its wait queue.  The *
+*          queue is searched from the front; wait queues are short, and a      *
+*          timeout is the uncommon way to leave one.                           *
+*******************************************************************************/
+HIDE void unlinkWaiter( Slot *slot )
+{
+   WAIT_QUEUE *queue = slot->queue ;
+   Slot       *prev = NULL ;
+
+   for ( Slot *each = (Slot *)queue->head; each != slot; each = each->next ) {
+      prev = each ;
+   }
+   if ( prev != NULL ) {
+      prev->next = slot->next ;
+   } else {
+      queue->head = slot->next ;
+   }
+   if ( queue->tail == slot ) {
+      queue->tail = prev ;
+   }
+   slot->queue = NULL ;
+}
+
+#if defined(SCCOR_STATS)
+/*******************************************************************************
+* wallNs                                                                       *
+*                                                                              *
+* Purpose: Returns the time, in ns, of the monotonic clock, even in virtual    *
+*          time, for timing what the coroutines really spend.                  *
+*******************************************************************************/
+HIDE long long wallNs( void )
+{
+   static const IntervalClock wallClock ;
+
+   return (long long)wallClock.Ns() ;
+}
+
+/*******************************************************************************
+* noteCreated                                                                  *
+*                                                                              *
+* Purpose: Starts the counters of a new coroutine instance, and puts it on the *
+*          list of live instances.  Called with the scheduler locked.          *
+*******************************************************************************/
+HIDE void noteCreated( Slot *slot )
+{
+   memset( &slot->stats, 0, sizeof( slot->stats ) ) ;
+   slot->stats.id = ++lastId ;
+   if ( statsHistograms ) {
+      slot->stats.runSlices = 
+         new TimeIntervalHistogram( "Run slices (us)", 0, 10, 40 ) ;
+      slot->stats.resumeLatency = 
+         new TimeIntervalHistogram( "Resume latency (us)", 0, 50, 40 ) ;
+   }
+   slot->resumedNs = slot->queuedNs = 0 ;
+   slot->statsPrev = NULL ;
+   slot->statsNext = liveSlots ;
+   if ( liveSlots != NULL ) {
+      liveSlots->statsPrev = slot ;
+   }
+   liveSlots = slot ;
+}
+
+/*******************************************************************************
+* noteResumed                                                                  *
+*                                                                              *
+* Purpose: Counts the resumption of a coroutine, for which a saved frame of    *
+*          'bytes' bytes is restored, and the time it waited on the ring.      *
+*******************************************************************************/
+HIDE void noteResumed( Slot *slot, long bytes )
+{
+   slot->resumedNs = wallNs() ;
+   ++slot->stats.resumes ;
+   slot->stats.bytesCopied += bytes ;
+   if ( (unsigned long)bytes > slot->stats.maxFrameBytes ) {
+      slot->stats.maxFrameBytes = bytes ;
+   }
+   if ( slot->stats.resumeLatency != NULL && slot->queuedNs > 0 ) {
+      slot->stats.resumeLatency->add( 
+                    (unsigned long long)( ( slot->resumedNs - slot->queuedNs ) / 1000 ) ) ;
+   }
+}
+
+/*******************************************************************************
+* noteSuspended                                                                *
+*                                                                              *
+* Purpose: Counts the end of a run slice of a coroutine, whose frame of        *
+*          'bytes' bytes is saved.                                             *
+*******************************************************************************/
+HIDE void noteSuspended( Slot *slot, long bytes )
+{
+   long long slice = wallNs() - slot->resumedNs ;
+
+   slot->stats.bytesCopied += bytes ;
+   if ( (unsigned long)bytes > slot->stats.maxFrameBytes ) {
+      slot->stats.maxFrameBytes = bytes ;
+   }
+   if ( slot->resumedNs > 0 ) {
+      slot->stats.runNs += slice ;
+      if ( slot->stats.runSlices != NULL ) {
+         slot->stats.runSlices->add( (unsigned long long)( slice / 1000 ) ) ;
+      }
+   }
+}
+
+/*******************************************************************************
+* noteRetired                                                                  *
+*                                                                              *
+* Purpose: Reports the counters of a finished coroutine instance to the        *
+*          setStatsReport() function, if any, releases its histograms, and     *
+*          takes it off the list of live instances.  Called with the scheduler *
+*          locked.                                                             *
+*******************************************************************************/
+HIDE void noteRetired( Slot *slot )
+{
+   if ( statsReport != NULL ) {
+      statsReport( &slot->stats ) ;
+   }
+   delete slot->stats.runSlices ;
+   delete slot->stats.resumeLatency ;
+   slot->stats.runSlices = slot->stats.resumeLatency = NULL ;
+   if ( slot->statsPrev != NULL ) {
+      slot->statsPrev->statsNext = slot->statsNext ;
+   } else {
+      liveSlots = slot->statsNext ;
+   }
+   if ( slot->statsNext != NULL ) {
+      slot->statsNext->statsPrev = slot->statsPrev ;
+   }
+}
+#endif // defined(SCCOR_STATS)
+
+/*******************************************************************************
+* resumeNext                                                                   *
+*                                                                              *
+* Purpose: Takes the coroutine at the front of the ring as the running one.    *
+*          Waiting coroutines whose deadlines have passed, or whose            *
+*          descriptors are ready, are put back on the ring first.  If the ring *
+*          is still empty the thread sleeps (or blocks in the I/O reactor)     *
+*          until the earliest deadline.  In virtual time, the clock is moved   *
+*          to that deadline instead, once the reactor has nothing ready.       *
+*          Stackless coroutines met on the way are run in place.  For          *
+*          popCoroutine, csavail is pointed past the saved frame's size word.  *
+*                                                                              *
+*          While draining, this returns (with running unchanged) once the      *
+*          stackless coroutines have finished or a classic one is runnable.    *
+*******************************************************************************/
+HIDE void resumeNext( void )
+{
+   Slot *next ;
+
+   for ( ;; ) {
+      next = rqPop( &ring, false ) ;
+      if ( next == NULL || timerCount > 0 || ioWaiters > 0 ) {
+         if ( next != NULL ) {
+            // Let a released coroutine of a higher level go first.
+            rqPush( &ring, next, true ) ;
+         } else if ( timerCount == 0 && ioWaiters == 0 ) {
+            printf( "sccor: every coroutine is blocked\n" ) ;
+            exit( 1 ) ;
+         }
+         if ( ioWaiters > 0 && ( next == NULL || ++ioPollTick % IO_POLL_INTERVAL == 0 ) ) {
+            pollIo( 0 ) ;
+         }
+         releaseTimers() ;
+         while ( ( next = rqPop( &ring, false ) ) == NULL ) {
+            long long timeout = timerCount > 0 ? timers[0]->wake - clockNs() : -1 ;
+
+            if ( virtualTime && timerCount > 0 ) {
+               // Nothing can happen before the earliest deadline.
+               if ( ioWaiters > 0 ) {
+                  pollIo( 0 ) ;
+               }
+               if ( rqPeek( &ring ) == NULL && timeout > 0 ) {
+                  IntervalClock::SetVirtualNs( timers[0]->wake ) ;
+               }
+            } else if ( ioWaiters > 0 ) {
+               pollIo( timeout < 0 && timerCount > 0 ? 0 : timeout ) ;
+            } else {
+               std::this_thread::sleep_for( std::chrono::nanoseconds( timeout ) ) ;
+            }
+            releaseTimers() ;
+         }
+      }
+      if ( next->step == NULL ) {
+         if ( draining ) {
+            rqPush( &ring, next, true ) ;
+            return ;
+         }
+         break ;
+      }
+      runStep( next ) ;
+      if ( draining && stepCount == 0 ) {
+         return ;
+      }
+   }
+   running = next ;
+#if defined(SCCOR_SEPARATE_STACKS)
+   prefetchSlot( rqPeek( &ring ) ) ;
+   STATS_RESUMED( running, 0 ) ;
+#else
+   csavail = running->frame + ( running->size & SIZE_MASK ) + 1 ;
+   STATS_RESUMED( running, ( running->size & SIZE_MASK ) * sizeof( long ) ) ;
+#endif
+}
+
+/*******************************************************************************
+* retireRunning                                                                *
+*                                                                              *
+* Purpose: Releases the slot and the block of a coroutine that has returned.   *
+*          With separate stacks the slot keeps its stack, which is still in    *
+*          use until the task switch away from the finished coroutine.         *
+*******************************************************************************/
+HIDE void retireRunning( void )
+{
+   Slot *finished = running ;
+
+   releaseJoiners( finished ) ;
+   if ( stepCount > 0 && coroutineCount - stepCount == 1 ) {
+      // The last classic coroutine:  run the stackless ones here, on its
+      // stack, until they finish or they have invoked another classic one.
+      draining = true ;
+      resumeNext() ;
+      draining = false ;
+      running = finished ;
+   }
+   STATS_SUSPENDED( running, 0 ) ;
+   STATS_RETIRED( running ) ;
+#if ! defined(SCCOR_SEPARATE_STACKS)
+   freeBlock( running->frame, running->capacity ) ;
+   if ( running->closure != NULL ) {
+      freeBlock( running->closure, running->closureCapacity ) ;
+   }
+#endif
+   running->next = freeSlots ;
+   freeSlots = running ;
+   running = NULL ;
+}
+
+/*******************************************************************************
+* runStep                                                                      *
+*                                                                              *
+* Purpose: Runs a stackless coroutine on the current stack up to its next      *
+*          suspension, then puts it at the back of the ring, leaves it parked  *
+*          (see parkStep), or retires it if it has finished.                   *
+*******************************************************************************/
+HIDE void runStep( Slot *slot )
+{
+   Slot *previous = running ;
+   bool  finished ;
+
+   running = slot ;
+   STATS_RESUMED( slot, 0 ) ;
+   finished = slot->step( slot->stepContext ) ;
+   STATS_SUSPENDED( slot, 0 ) ;
+   running = previous ;
+   if ( finished ) {
+      lockScheduler() ;
+      STATS_RETIRED( slot ) ;
+      releaseJoiners( slot ) ;
+      slot->next = freeSlots ;
+      freeSlots = slot ;
+      --stepCount ;
+      unlockScheduler() ;
+#if defined(SCCOR_SEPARATE_STACKS)
+      if ( !--coroutineCount && threaded ) {
+         std::lock_guard<std::mutex> guard( idleLock ) ;
+
+         allDone = true ;
+         idleWake.notify_all() ;
+      }
+#else
+      --coroutineCount ;
+#endif
+   } else if ( stepParked ) {
+      stepParked = false ;
+      unlockScheduler() ;
+   } else {
+      putLast( slot ) ;
+   }
+}
+
+/*******************************************************************************
+* resetCsa                                                                     *
+*                                                                              *
+* Purpose: Releases the csa once the last coroutine has finished, so that a    *
+*          later cobegin starts with an empty csa.  The stacks kept by the     *
+*          free slots are unmapped.                                            *
+*******************************************************************************/
+HIDE void resetCsa( void )
+{
+#if defined(SCCOR_SEPARATE_STACKS)
+   for ( Slot *slot = freeSlots; slot != NULL; slot = slot->next ) {
+      munmap( slot->stack - pageSize, slot->stackSize + pageSize ) ;
+   }
+#endif
+   for ( int i = 0; i < BLOCK_CLASSES; i++ ) {
+      freeBlocks[i] = NULL ;
+   }
+   freeSlots = running = spawned = NULL ;
+   memset( &ring, 0, sizeof( ring ) ) ;
+   parking = stepParked = false ;
+   stepCount = 0 ;
+#if defined(SCCOR_STATS)
+   liveSlots = NULL ;
+#endif
+#if defined(SCCOR_SEPARATE_STACKS)
+   threaded = allDone = ioPolling = false ;
+   nextWorker = 0 ;
+#endif
+   free( timers ) ;
+   timers = NULL ;
+   timerCount = timerCapacity = 0 ;
+   while ( chunks != NULL ) {
+      Chunk *chunk = chunks ;
+
+      chunks = chunk->next ;
+      releaseChunk( chunk ) ;
+   }
+   csaBytes = 0 ;
+   csatop = csaend = NULL ;
+#if ! defined(SCCOR_SEPARATE_STACKS)
+   csavail = NULL ;
+#endif
+}
+
+#if ! defined(SCCOR_SEPARATE_STACKS)
+
+/*******************************************************************************
+* setBase                                                                      *
+*                                                                              *
+* Purpose: Determines the base of the coresume stack frame (i.e., rbp of each  *
+*          coroutine during its execution. The 'base' value is determined from *
+*          within this setBase function after it has been called by cobegin.   *
+*          The top of a coroutine's stack frame is popCoroutine's saved        *
+*          register area.                                                      *
+*******************************************************************************/
+HIDE void setBase( void )
+{
+   asm ( "movq %%rbp, %0" : "=rm" (base) : /* no inputs */ ) ;
+
+#if defined(__APPLE__) && defined(__MACH__)
+   coRBP = *base ;
+#endif
+}     
+/*******************************************************************************
+* openFrame                                                                    *
+*                                                                              *
+* Purpose: Starts the creation of a coroutine instance.  A slot is assigned to *
+*          the instance and csavail is pointed at the free space of the csa,   *
+*          where cobegin or invoke lays out the instance's initial frame.      *
+*          There is room for the longs ahead of the arguments.                 *
+*******************************************************************************/
+HIDE void openFrame( void )
+{
+   long capacity = MIN_BLOCK ;
+
+   spawned = newSlot() ;
+   while ( capacity < FRAME_HEADER ) {
+      capacity <<= 1 ;
+   }
+   ensureRoom( capacity, 0 ) ;
+   csavail = csatop ;
+}
+
+/*******************************************************************************
+* reserveFrame                                                                 *
+*                                                                              *
+* Purpose: Makes room for the whole initial frame, once the number of          *
+*          arguments is known, so that commitFrame can keep the frame in place *
+*          as a block.  The part already laid out moves with csavail if a new  *
+*          chunk is needed.                                                    *
+*******************************************************************************/
+HIDE void reserveFrame( int argCount )
+{
+   long capacity = MIN_BLOCK,
+        keep = csavail - csatop ;
+
+   while ( capacity < FRAME_HEADER + argCount + 1 ) {
+      capacity <<= 1 ;
+   }
+   ensureRoom( capacity, keep ) ;
+   csavail = csatop + keep ;
+}
+
+/*******************************************************************************
+* commitFrame                                                                  *
+*                                                                              *
+* Purpose: Completes the creation of a coroutine instance whose initial frame  *
+*          and size word end at csavail.  The frame is kept in place when it   *
+*          becomes a new block, or moved into a free block of its size class.  *
+*          The instance is put at the front of the ring, so it runs next.      *
+*******************************************************************************/
+HIDE void commitFrame( void )
+{
+   spawned->size = *( csavail - 1 ) ;
+   spawned->frame = allocBlock( ( spawned->size & SIZE_MASK ) + 1, 
+                                &spawned->capacity ) ;
+   if ( spawned->frame != csavail - ( spawned->size & SIZE_MASK ) - 1 ) {
+      memcpy( spawned->frame, csavail - ( spawned->size & SIZE_MASK ) - 1,
+              ( ( spawned->size & SIZE_MASK ) + 1 ) * sizeof( long ) ) ;
+   }
+   STATS_ENTRY( spawned, (COROUTINE)spawned->frame[ENTRY_INDEX] ) ;
+
+   putFirst( spawned ) ;
+}
+
+/*******************************************************************************
+* suspendRunning                                                               *
+*                                                                              *
+* Purpose: Saves the stack frame of the running coroutine, which extends for   *
+*          _size longs up to 2 longs "below" base, in the coroutine's block    *
+*          and puts the coroutine at the back of the ring (unless it is        *
+*          parking).  The block is replaced by a larger one if the frame has   *
+*          outgrown it.                                                        *
+*******************************************************************************/
+HIDE void suspendRunning( void )
+{
+   if ( running->capacity < _size + 1 ) {
+      freeBlock( running->frame, running->capacity ) ;
+      running->frame = allocBlock( _size + 1, &running->capacity ) ;
+   }
+   prefetchSlot( rqPeek( &ring ) ) ;
+   memcpy( running->frame, base - _size - 2, _size * sizeof( long ) ) ;
+   running->frame[_size] = running->size = _size ;
+   STATS_SUSPENDED( running, _size * sizeof( long ) ) ;
+
+   requeueRunning() ;
+   running = NULL ;
+}
+
+/*******************************************************************************
+* popCoroutine                                                                 *
+*                                                                              *
+* Purpose: (Re)starts a coroutine from the coroutine storage area.             *
+*                                                                              *
+* Prerequisite: The rsp has already been moved so that popCoroutine's stack    *
+*               frame will be out of the way of next coroutine's stack frame.  *
+*               csavail points past the size word of the coroutine's frame     *
+*               (see resumeNext).                                              *
+*                                                                              *
+*******************************************************************************/
+HIDE void popCoroutine( void )                                               
+{
+   // Tell Clang to save rbx (and rdi and rsi in Cygwin), as required by the
+   // x86_64 ABI, so we'll have a  repeatable (if redundant) behavior in this 
+   // routine's prologue (since it doesn't seem possible to get Clang to treat 
+   // a C routine as a _declspec( naked ) routine). Clang will pop the rbx 
+   // (and rdi and rsi in Cygwin) register(s) here and again in the caller.
+#if defined(CYGWIN)
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
+                                                                 "%rdi", 
+                                                                 "%rbx" ) ;
+#else
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
+#endif
+   _size = *--csavail ;       // number of 64-bit entries in coroutine instance
+
+   // The high-order byte of _size is marked for coroutine instances which 
+   // have not yet been loaded. This allows us to load the appropriate 
+   // x86_64 (macOS) or X64 (Cygwin) ABI registers for a simulated call to 
+   // the instance.  Subsequently, the high-order byte of _size will be 
+   // 0x00 and no registers need be loaded.
+   int8_t mark = 0 ;
+   long *p = csavail - 1 ;          // temp pointer to first parameter
+   if ( _size < 0 ) {
+      // This is a virgin coroutine instance, so we'll simulate a call 
+      // by loading the appropriate registers. 
+      mark = ( (int8_t)(_size >> 56) ) & 0x7F ;
+      _size &= 0x00ffffffffffffff ; // omit mark for below
+   }
+   baseMinusSize = base - _size - 2 ; // note pointer arithmetic
+   csavail -= _size ;               // note pointer arithmetic
+
+   // Fetch coroutine from csavail to (base - _size - 2) for _size longs.
+   _RSP = baseMinusSize - MAGIC_OFFSET / sizeof( long ) ;
+   memcpy( baseMinusSize, csavail, _size * sizeof( long ) ) ;
+   if ( mark > 0) {
+      if ( mark % 2 ) {
+         --p ; // skip filler
+      }      
+      long *first_p = p ;           // pointer to first parameter
+      int8_t excessCount = mark - IN_REGISTERS_COUNT ;
+      if ( mark > IN_REGISTERS_COUNT ) {
+         // We'll leave excess parameters (more than the IN_REGISTERS_COUNT, 
+         // which go in registers) on the stack.
+         mark = IN_REGISTERS_COUNT ;
+         p -= excessCount ;         // point to IN_REGISTERS_COUNTth parameter
+      } 
+      if ( excessCount > 0 ) {
+         // Move non-register parameters to their place on the stack.
+#if defined(__APPLE__) && defined(__MACH__)
+         memmove( baseMinusSize + 4, first_p - excessCount + 1, 
+                  excessCount * sizeof( long ) ) ;
+#elif defined(CYGWIN)
+         // The excess parameters go on top of the shadow space (32-byte
+         // area reserved for the callee's use).
+         memmove( baseMinusSize + 6 + 4, first_p - excessCount + 1, 
+                  excessCount * sizeof( long ) ) ;
+#else
+   #pragma GCC error "Only 64-bit macOS or Windows Cygwin with Clang supported."
+#endif
+      }
+      switch ( mark ) {
+#if defined(__APPLE__) && defined(__MACH__)
+         case 6:
+            asm ( "movq %0, %%r9" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 5:
+            asm ( "movq %0, %%r8" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 4:
+            asm ( "movq %0, %%rcx" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 3:
+            asm ( "movq %0, %%rdx" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 2:
+            asm ( "movq %0, %%rsi" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 1:       
+            asm ( "movq %0, %%rdi" : /* no outputs */ : "rm" (*p) ) ;
+#elif defined(CYGWIN)
+         case 4:
+            asm ( "movq %0, %%r9" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 3:
+            asm ( "movq %0, %%r8" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 2:
+            asm ( "movq %0, %%rdx" : /* no outputs */ : "rm" (*p) ) ;
+            --p ;                   // contine to next case
+
+         case 1:       
+            asm ( "movq %0, %%rcx" : /* no outputs */ : "rm" (*p) ) ;
+#else
+   #pragma GCC error "Only 64-bit macOS or Windows Cygwin with Clang supported."
+#endif
+            break ;      
+      }
+   }
+
+   asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+}
+
+/*******************************************************************************
+* cleanup                                                                      *
+*                                                                              *
+* Purpose: Retrieves another coroutine from the csa when a coroutine returns   *
+*          to end its execution.                                               *
+*                                                                              *
+*          Handles task termination by returning to cobegin when there are no  *
+*          more active coroutines.                                             *
+*******************************************************************************/
+HIDE void cleanup( void )
+{
+   // cleanup must restore cobegin's rbx (and rdi and rsi on Cygwin) on return.
+#if defined(CYGWIN)
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
+                                                                 "%rdi", 
+                                                                 "%rbx" ) ;
+#else
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
+#endif
+   retireRunning() ;
+   if ( !--coroutineCount )
+   {
+      resetCsa() ;
+
+      // Adjust rsp to return to point to rbx as in cobegin's epilog.
+#if defined(CYGWIN)
+      asm volatile ( "movq %0, %%rsp" : /* no outputs */ 
+                                      : "rm" (COBEGIN_EPILOG) : "%rsp" ) ;
+#else
+      _RSP = (long *)coRBP - CLEANUP_RSP_ADJUST / sizeof( long ) - 1 ;  // cobegin's 
+                                                                        //   RBX
+      asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+#endif
+
+      return ;
+   }
+
+   // Move popCoroutine's stack frame out of the way of the coroutine instance
+   // we're copying in.
+   resumeNext() ;
+   _size = *(csavail - 1) ; // number of longs in coroutine entry
+   _size &= 0x00ffffffffffffff ; // omit mark
+
+   asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */ ) ;
+
+   // The stack pointer should be on a 16-byte boundary before any call.
+   _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
+   asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+
+   popCoroutine() ;
+}
+
+/*******************************************************************************
+*                            Public Functions (API)                            *
+*******************************************************************************/
+/*******************************************************************************
+* cobegin                                                                      *
+*                                                                              *
+* Purpose: Initialize the multitasker and start n coroutine instances          *
+*          on the ring.                                                        *
+*                                                                              *
+* Remarks on usage : Associated with each coroutine is an argument             *
+*                    list (which may be empty).  For example,                  *
+*                                                                              *
+*                       cobegin( 2,                                            *
+*                                coroutine1, 0,                                *
+*                                coroutine2, 3, longvar1, longvar2, longvar3 );*
+*                                                                              *
+*                    would start two coroutine instances, coroutine1 and       *
+*                    coroutine2.  The first takes no arguments and             *
+*                    the second takes three longs (64-bits each) as arguments: *
+*                                                                              *
+*                       3 = (sizeof longvar1 + sizeof longvar2                 *
+*                           + sizeof longvar3) / (8 bytes/long)                *
+*                         = 24 / 8                                             *
+*******************************************************************************/
+void cobegin( int n, ... )
+{
+   int8_t  argCount, fillerCount = 0 ;
+   va_list arg ;
+
+   setBase() ;
+
+   asm volatile ( "movq %%rsp, %0" : "=rm" (COBEGIN_EPILOG): /* no inputs */ ) ;
+   // Address of saved rbx at top of cobegin's epilog:
+   COBEGIN_EPILOG += ( COBEGIN_STACK_ADJUST - CLEANUP_STACK_ADJUST ) 
+                                                               / sizeof(long) ; 
+
+   #ifdef DEBUG_OUTPUT
+   printf( " base: 0x%08lx\n", (unsigned long)base ) ;
+   #endif // def DEBUG_OUTPUT
+
+   va_start( arg, n ) ;
+   while ( n-- ) {
+      // This code is essentially an:
+      //    invoke( coroutine, argCount, arg1, arg2, arg3, ... ) ;
+      openFrame() ;
+
+                        // popCoroutine's rbp
+      *csavail++ = 0 ;  // rbx placeholder
+#if defined(CYGWIN)
+      *csavail++ = 0 ;  // rdi placeholder
+      *csavail++ = 0 ;  // rsi placeholder
+#endif
+      *csavail++ = (long)base ;
+      *csavail++ = (long)( va_arg( arg, COROUTINE ) ) ;
+      *csavail++ = (long)( (long)cleanup + CLEANUP_OFFSET ) ; // keeping same
+                                                              //  rbp and rsp
+      fillerCount = 0 ;
+#if defined(CYGWIN)
+      *csavail++ = SHADOW_SPACE_VALUE ;  // 32-byte shadow space
+      ++fillerCount ;             
+      *csavail++ = SHADOW_SPACE_VALUE ;  
+      ++fillerCount ;             
+      *csavail++ = SHADOW_SPACE_VALUE ;  
+      ++fillerCount ;             
+      *csavail++ = SHADOW_SPACE_VALUE ;  
+      ++fillerCount ;             
+#endif
+      argCount = va_arg( arg, int ) ;
+      reserveFrame( argCount ) ;
+      if ( argCount > 0) { 
+         for ( int i = 0; i < argCount; i++ ) {
+            *csavail++ = (long)( va_arg( arg, long ) );
+         }
+
+         switch ( argCount % 2 ) // filler to ensure 16-byte boundary;
+         {
+            case 0:
+               break ;          // do nothing
+
+            case 1:
+               *csavail++ = FILLER_VALUE ;  
+               ++fillerCount ;             
+               break;
+         }
+      } else if ( argCount == 0 ) {
+         *csavail++ = FILLER_VALUE ;  
+         ++fillerCount ;             
+         *csavail++ = FILLER_VALUE ;  
+         ++fillerCount ;             
+      } 
+#if defined(CYGWIN)
+#define LONG_COUNT 4
+#else
+#define LONG_COUNT 2
+#endif
+      long coroutineSize = argCount + fillerCount
+         + ( sizeof( long ) * LONG_COUNT + (sizeof( COROUTINE ) * 2) ) 
+                                                             / sizeof( long ) ;
+      // Since this coroutine hasn't been executed, we mark the size in the 
+      // high-order byte with (0x80 | argCount) so popCoroutine
+      // can load the ABI registers with the parameters only on startup
+      // of the coroutine. So, if we mark the high-order byte as 0x83, 
+      // there are 3 args for the coroutine, which will be loaded into 
+      // registers rdi, rsi, and rdx by popCoroutine on the first time  
+      // the coroutine is loaded (to simulate calling the coroutine).  
+      // Subsequently, the high-order byte will be zero, so no registers 
+      // will get loaded by popCoroutine.
+      uint8_t mark = 0x80 | argCount ;
+      coroutineSize |= ( (long)mark << 56 ) ;
+      *csavail++ = coroutineSize ;
+      commitFrame() ;
+      ++coroutineCount ;
+   }
+   va_end( arg );
+
+   #ifdef DEBUG_OUTPUT
+   #endif // def DEBUG_OUTPUT
+
+   // Tell Clang to save rbx (and rdi and rsi on Cygwin)** so popCoroutine 
+   // can write the new routine's value to the stack location from which 
+   // it will be restored:
+   //     :  :  :
+   //    pop %rbx    <----- baseMinusSize points to rbx for stack frame top
+   //  **pop %rdi    
+   //  **pop %rsi
+   //    pop %rbp
+   //    ret
+   //
+   // in cobegin's epilogue.
+#if defined(CYGWIN)
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
+                                                                 "%rdi", 
+                                                                 "%rbx" ) ;
+#else
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
+#endif
+   if ( coroutineCount > 0 ) { 
+      // Move popCoroutine's stack frame out of the way of the coroutine
+      // we're copying in.
+      resumeNext() ;
+      _size = *(csavail - 1) ;      // number of longs in coroutine entry
+      _size &= 0x00ffffffffffffff ; // omit mark
+
+      asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */) ;
+
+      // The stack pointer should be on a 16-byte boundary before any call.
+      _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
+      asm volatile ("movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp") ;
+
+      popCoroutine() ;
+   }
+}                                                                
+/*******************************************************************************
+* coresume                                                                     *
+*                                                                              *
+* Purpose: performs an unconditional task switch.                              *
+*******************************************************************************/
+void coresume( void )
+{
+   long *_BPX ;
+
+   // No-ops if no task in csa, unless the running coroutine is parking.
+   if (coroutineCount > 1 || parking) {
+      // Compute the size of the current coroutine's stack frame plus its
+      // return address and stored values for its rbx (and rdi and rsi for
+      // Cygwin).
+      asm ("movq %%rbp, %0" : "=rm" (_BPX) : /* no inputs */) ;
+#if defined(CYGWIN)
+      _BPX -= /*3*/ -1 ;                   // include our rbx, rsi, and rdi saved 
+                                    //   by coresume
+                                    //   (note pointer arithmetic)
+#else
+      _BPX -= 1 ;                   // include our rbx, rsi, and rdi saved 
+                                    //   by coresume
+                                    //   (note pointer arithmetic)
+#endif
+      _size = (base - 2 - _BPX) ;   // coroutine extends from 1 or 3 longs 
+                                    // "above" coresume's rbp to 2 longs 
+                                    // "above" base.
+
+      // Store the old task in its slot's block of the csa along with the
+      // coroutine size, and put it at the back of the ring.  The size of the
+      // coroutine is not itself included in the coroutine "size" that is 
+      // stored in the csa.  Only this frame and the one popped below are
+      // copied, however many coroutines are on the ring.
+      suspendRunning() ;
+
+      // Move popCoroutine's stack frame out of the way of the coroutine
+      // we're copying in. We move the stack here before calling popCoroutine
+      // so that rbp (and associated temps) is out of harm's way.
+      resumeNext() ;
+      _size = *( csavail - 1 ) ;    // number of longs in coroutine entry
+      _size &= 0x00ffffffffffffff ; // omit mark
+
+      asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */ ) ;
+
+      // The stack pointer should be on a 16-byte boundary before any call.
+      _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
+      asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+
+      popCoroutine() ;
+   }
+
+   // Tell Clang to save rbx (and rdi and rsi on Cygwin)** so popCoroutine 
+   // can write the new routine's value to the stack location from which 
+   // Clang will restore its saved register:
+   //     :  :  :
+   //  **pop %rsi
+   //  **pop %rdi
+   //    pop %rbx
+   //    pop %rbp
+   //    ret
+   //
+   // in coresume's epilogue.
+#if defined(CYGWIN)
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
+                                                                 "%rdi", 
+                                                                 "%rbx" ) ;
+#else
+   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
+#endif
+}
+
+/*******************************************************************************
+* invoke                                                                       *
+*                                                                              *
+* Purpose: place a new coroutine instance on the multi-tasker ring.            *
+*                                                                              *
+*          Creates an initial stack for the coroutine consisting of:           *
+*             - initial value for rbx (and rdi and rsi in Cygwin) and          *
+*             - initial rbp value (base)                                       *
+*             - address of the coroutine                                       *
+*             - the passed in arguments (any number of longs)                  *
+*                                                                              *
+* Note: the new coroutine will be on the ring, but no task switch is performed.*
+*       The new coroutine will not be executed until the next coresume.        *
+*       Returns the handle of the new instance.                                *
+*******************************************************************************/
+COROUTINE_HANDLE invoke( COROUTINE coroutine, int argCount, ... )
+{
+   int fillerCount = 0 ;
+   va_list arg ;
+   va_start( arg, argCount ) ;
+
+   openFrame() ;
+   reserveFrame( argCount ) ;
+   *csavail++ = 0 ;     // rbx placeholder
+#if defined(CYGWIN)
+   *csavail++ = 0 ;  // rdi placeholder
+   *csavail++ = 0 ;  // rsi placeholder
+#endif
+   *csavail++ = (long)base ;
+   *csavail++ = (long)coroutine ;
+   *csavail++ = (long)( (long)cleanup + CLEANUP_OFFSET ) ; // keeping same
+                                                           //   rbp and rsp
+   fillerCount = 0 ;
+#if defined(CYGWIN)
+   *csavail++ = SHADOW_SPACE_VALUE ;  // 32-byte shadow space
+   ++fillerCount ;             
+   *csavail++ = SHADOW_SPACE_VALUE ;  
+   ++fillerCount ;             
+   *csavail++ = SHADOW_SPACE_VALUE ;  
+   ++fillerCount ;             
+   *csavail++ = SHADOW_SPACE_VALUE ;  
+   ++fillerCount ;             
+#endif
+   if ( argCount > 0 ) { 
+      for ( int i = 0; i < argCount; i++ ) {
+         *csavail++ = (long)( va_arg( arg, long ) ) ;
+      }
+
+      switch (argCount % 2)        // filler to ensure 16-byte boundary;
+      {
+         case 0:
+            break ;                 // do nothing
+
+         case 1:
+            *csavail++ = FILLER_VALUE ;  
+            ++fillerCount ;             
+            break;
+      }
+   } else if ( argCount == 0 ) {
+      *csavail++ = FILLER_VALUE ;  
+      ++fillerCount ;             
+      *csavail++ = FILLER_VALUE ;  
+      ++fillerCount ;             
+   }
+
+#if defined(CYGWIN)
+#define LONG_COUNT 4
+#else
+#define LONG_COUNT 2
+#endif
+   long coroutineSize = argCount + fillerCount
+      + ( sizeof( long ) * LONG_COUNT + (sizeof( COROUTINE ) * 2) ) / sizeof( long ) ;
+   // Since this coroutine hasn't been executed, we mark the size in the 
+   // high-order byte with (0x80 | argCount) so popCoroutine
+   // can load the ABI registers with the parameters only on startup
+   // of the coroutine. So, if we mark the high-order byte as 0x83, 
+   // there are 3 args for the coroutine, which will be loaded into 
+   // registers rdi, rsi, and rdx by popCoroutine on the first time  
+   // the coroutine is loaded (to simulate calling the coroutine).  
+   // Subsequently, the high-order byte will be zero, so no registers 
+   // will get loaded by popCoroutine.
+   uint8_t mark = 0x80 | argCount ;
+   coroutineSize |= ((long)mark << 56) ;
+   *csavail++ = coroutineSize ;
+   commitFrame() ;
+   ++coroutineCount ;
+
+   va_end( arg ) ;
+
+   #ifdef DEBUG_OUTPUT
+   #endif // def DEBUG_OUTPUT
+   return handleOf( spawned ) ;
+}
+
+/*******************************************************************************
+* setStackSize                                                                 *
+*                                                                              *
+* Purpose: sets the size of the stacks of coroutines created afterwards.       *
+*          Coroutines share the multi-tasker stack in this backend, so the     *
+*          size is ignored.                                                    *
+*******************************************************************************/
+void setStackSize( unsigned long bytes )
+{
+}
+
+/*******************************************************************************
+* invokeN                                                                      *
+*                                                                              *
+* Purpose: place count new instances of a coroutine on the ring, instance i    *
+*          taking the argCount longs at args + i * argCount.  The instances    *
+*          are put at the front of the ring in order, so instance 0 runs       *
+*          first.  Their handles are stored in handles[i], unless it is NULL.  *
+*                                                                              *
+*          The initial frame, as invoke lays it out, is built once.  Room for  *
+*          as many instances as a chunk holds is made at a time, and each      *
+*          instance is a copy of the frame with its own arguments.             *
+*******************************************************************************/
+void invokeN( COROUTINE coroutine, int count, int argCount, const long *args,
+              COROUTINE_HANDLE *handles )
+{
+   long  frame[FRAME_HEADER + 1] ;
+   long  header = 0, longs, capacity, fillers, perChunk ;
+
+   frame[header++] = 0 ;     // rbx placeholder
+#if defined(CYGWIN)
+   frame[header++] = 0 ;     // rdi placeholder
+   frame[header++] = 0 ;     // rsi placeholder
+#endif
+   frame[header++] = (long)base ;
+   frame[header++] = (long)coroutine ;
+   frame[header++] = (long)( (long)cleanup + CLEANUP_OFFSET ) ;
+#if defined(CYGWIN)
+   for ( int i = 0; i < 4; i++ ) {
+      frame[header++] = SHADOW_SPACE_VALUE ;  // 32-byte shadow space
+   }
+   fillers = 4 ;
+#else
+   fillers = 0 ;
+#endif
+   // Filler to keep the frame a whole number of 16-byte units, as in invoke.
+   fillers += argCount == 0 ? 2 : argCount % 2 ;
+   longs = header + argCount + ( argCount == 0 ? 2 : argCount % 2 ) + 1 ;
+   capacity = MIN_BLOCK ;
+   while ( capacity < longs ) {
+      capacity <<= 1 ;
+   }
+   perChunk = CSA_CHUNK_SIZE / ( capacity + SLOT_LONGS ) ;
+   if ( perChunk == 0 ) {
+      // Frames of their own chunks:  no room to share.
+      perChunk = 1 ;
+   }
+
+   for ( int i = count; i > 0; ) {
+      long batch = i < perChunk ? i : perChunk ;
+
+      if ( capacity < CSA_CHUNK_SIZE ) {
+         ensureRoom( batch * ( capacity + SLOT_LONGS ), 0 ) ;
+      }
+      for ( ; batch > 0; batch--, i-- ) {
+         const long *from = args + (long)( i - 1 ) * argCount ;
+         long       *to ;
+
+         spawned = newSlot() ;
+         spawned->frame = allocBlock( longs, &spawned->capacity ) ;
+         to = spawned->frame ;
+         memcpy( to, frame, header * sizeof( long ) ) ;
+         to += header ;
+         if ( argCount > 0 ) {
+            memcpy( to, from, argCount * sizeof( long ) ) ;
+            to += argCount ;
+         }
+         for ( long j = argCount == 0 ? 2 : argCount % 2; j > 0; j-- ) {
+            *to++ = FILLER_VALUE ;
+         }
+         // The size word, marked as for invoke.
+         spawned->size = ( argCount + fillers 
+                           + ( sizeof( long ) * LONG_COUNT 
+                               + sizeof( COROUTINE ) * 2 ) / sizeof( long ) )
+                         | ( (long)( 0x80 | argCount ) << 56 ) ;
+         *to = spawned->size ;
+         STATS_ENTRY( spawned, coroutine ) ;
+         if ( handles != NULL ) {
+            handles[i - 1] = handleOf( spawned ) ;
+         }
+         putFirst( spawned ) ;
+         ++coroutineCount ;
+      }
+   }
+}
+
+/*******************************************************************************
+* invokeClosure                                                                *
+*                                                                              *
+* Purpose: place a new coroutine instance, start( storage ), on the ring,      *
+*          where storage is bytes (16-byte aligned) in a block of the csa,     *
+*          released when the coroutine returns.  construct( storage, context ) *
+*          fills in storage first.                                             *
+*******************************************************************************/
+COROUTINE_HANDLE invokeClosure( void (*start)( void * ), unsigned long bytes, 
+                    void (*construct)( void *, void * ), void *context )
+{
+   long  capacity ;
+   long *block = allocBlock( ( bytes + 15 ) / sizeof( long ), &capacity ) ;
+   long *storage = (long *)( ( (uintptr_t)block + 15 ) & ~(uintptr_t)15 ) ;
+
+   COROUTINE_HANDLE handle ;
+
+   construct( storage, context ) ;
+   handle = invoke( (COROUTINE)start, 1, (long)storage ) ;
+   spawned->closure = block ;
+   spawned->closureCapacity = capacity ;
+   return handle ;
+}
+
+/*******************************************************************************
+* setWorkerCount                                                               *
+*                                                                              *
+* Purpose: does nothing:  the copying backend has one worker, as each frame    *
+*          is restored at the address it had on its thread's stack.            *
+*******************************************************************************/
+void setWorkerCount( int count, bool pinned )
+{
+   if ( count > 1 ) {
+      printf( "sccor: several workers require the separate-stack backend\n" ) ;
+      exit( 1 ) ;
+   }
+}
+
+/*******************************************************************************
+* getWorkerIndex                                                               *
+*                                                                              *
+* Purpose: returns the index of the worker running the current coroutine.      *
+*******************************************************************************/
+int getWorkerIndex( void )
+{
+   return 0 ;
+}
+
+/*******************************************************************************
+* pinCoroutine                                                                 *
+*                                                                              *
+* Purpose: does nothing:  there is only one worker.                            *
+*******************************************************************************/
+void pinCoroutine( int worker )
+{
+}
+
+#else // defined(SCCOR_SEPARATE_STACKS)
+
+/*******************************************************************************
+*                 Separate-Stack Private Function Definitions                  *
+*******************************************************************************/
+
+/*******************************************************************************
+* switchStacks                                                                 *
+*                                                                              *
+* Purpose: Performs a task switch between two coroutine stacks.  The callee-   *
+*          saved registers of the ABI are pushed on the current stack, whose   *
+*          stack pointer is then stored at *saveSp.  The registers are popped  *
+*          from the stack at loadSp, returning to whatever last switched away  *
+*          from that stack (or to startCoroutine for a new coroutine).         *
+*******************************************************************************/
+HIDE __attribute__(( naked, noinline )) 
+void switchStacks( long **saveSp, long *loadSp )
+{
+#if defined(CYGWIN)
+   asm volatile ( "pushq  %rbp\n\t"
+                  "pushq  %rbx\n\t"
+                  "pushq  %rdi\n\t"
+                  "pushq  %rsi\n\t"
+                  "pushq  %r12\n\t"
+                  "pushq  %r13\n\t"
+                  "pushq  %r14\n\t"
+                  "pushq  %r15\n\t"
+                  "subq   $160, %rsp\n\t"
+                  "movdqu %xmm6,    0(%rsp)\n\t"
+                  "movdqu %xmm7,   16(%rsp)\n\t"
+                  "movdqu %xmm8,   32(%rsp)\n\t"
+                  "movdqu %xmm9,   48(%rsp)\n\t"
+                  "movdqu %xmm10,  64(%rsp)\n\t"
+                  "movdqu %xmm11,  80(%rsp)\n\t"
+                  "movdqu %xmm12,  96(%rsp)\n\t"
+                  "movdqu %xmm13, 112(%rsp)\n\t"
+                  "movdqu %xmm14, 128(%rsp)\n\t"
+                  "movdqu %xmm15, 144(%rsp)\n\t"
+                  "movq   %rsp, (%rcx)\n\t"
+                  "movq   %rdx, %rsp\n\t"
+                  "movdqu    0(%rsp), %xmm6\n\t"
+                  "movdqu   16(%rsp), %xmm7\n\t"
+                  "movdqu   32(%rsp), %xmm8\n\t"
+                  "movdqu   48(%rsp), %xmm9\n\t"
+                  "movdqu   64(%rsp), %xmm10\n\t"
+                  "movdqu   80(%rsp), %xmm11\n\t"
+                  "movdqu   96(%rsp), %xmm12\n\t"
+                  "movdqu  112(%rsp), %xmm13\n\t"
+                  "movdqu  128(%rsp), %xmm14\n\t"
+                  "movdqu  144(%rsp), %xmm15\n\t"
+                  "addq   $160, %rsp\n\t"
+                  "popq   %r15\n\t"
+                  "popq   %r14\n\t"
+                  "popq   %r13\n\t"
+                  "popq   %r12\n\t"
+                  "popq   %rsi\n\t"
+                  "popq   %rdi\n\t"
+                  "popq   %rbx\n\t"
+                  "popq   %rbp\n\t"
+                  "ret\n\t" ) ;
+#else
+   asm volatile ( "pushq  %rbp\n\t"
+                  "pushq  %rbx\n\t"
+                  "pushq  %r12\n\t"
+                  "pushq  %r13\n\t"
+                  "pushq  %r14\n\t"
+                  "pushq  %r15\n\t"
+                  "movq   %rsp, (%rdi)\n\t"
+                  "movq   %rsi, %rsp\n\t"
+                  "popq   %r15\n\t"
+                  "popq   %r14\n\t"
+                  "popq   %r13\n\t"
+                  "popq   %r12\n\t"
+                  "popq   %rbx\n\t"
+                  "popq   %rbp\n\t"
+                  "ret\n\t" ) ;
+#endif
+}
+
+/*******************************************************************************
+* startCoroutine                                                               *
+*                                                                              *
+* Purpose: Simulates the call of a new coroutine.  switchStacks returns here   *
+*          with the coroutine's register parameters on top of the stack,       *
+*          followed by the coroutine's address (see layoutStack).  First,      *
+*          finishSwitch (whose address layoutStack placed in r13) completes    *
+*          the task switch; the stack is 16-byte aligned here.                 *
+*******************************************************************************/
+HIDE __attribute__(( naked, noinline )) void startCoroutine( void )
+{
+#if defined(CYGWIN)
+   asm volatile ( "subq   $32, %rsp\n\t"        // shadow space
+                  "callq  *%r13\n\t"
+                  "addq   $32, %rsp\n\t"
+                  "popq   %rcx\n\t"
+                  "popq   %rdx\n\t"
+                  "popq   %r8\n\t"
+                  "popq   %r9\n\t"
+                  "ret\n\t" ) ;
+#else
+   asm volatile ( "callq  *%r13\n\t"
+                  "popq   %rdi\n\t"
+                  "popq   %rsi\n\t"
+                  "popq   %rdx\n\t"
+                  "popq   %rcx\n\t"
+                  "popq   %r8\n\t"
+                  "popq   %r9\n\t"
+                  "ret\n\t" ) ;
+#endif
+}
+
+/*******************************************************************************
+* exitCoroutine                                                                *
+*                                                                              *
+* Purpose: Receives control when a coroutine returns, and calls                *
+*          finishCoroutine, whose address layoutStack placed in r12 (a callee- *
+*          saved register, so the coroutine has preserved it).                 *
+*******************************************************************************/
+HIDE __attribute__(( naked, noinline )) void exitCoroutine( void )
+{
+#if defined(CYGWIN)
+   asm volatile ( "andq   $-16, %rsp\n\t"
+                  "subq   $32, %rsp\n\t"        // shadow space
+                  "callq  *%r12\n\t"
+                  "ud2\n\t" ) ;
+#else
+   asm volatile ( "andq   $-16, %rsp\n\t"
+                  "callq  *%r12\n\t"
+                  "ud2\n\t" ) ;
+#endif
+}
+
+/*******************************************************************************
+* finishCoroutine                                                              *
+*                                                                              *
+* Purpose: Retrieves another coroutine from the ring when a coroutine returns  *
+*          to end its execution.                                               *
+*                                                                              *
+*          Handles task termination by returning to cobegin when there are no  *
+*          more active coroutines.                                             *
+*******************************************************************************/
+HIDE void finishCoroutine( void )
+{
+   Slot *finished = running ;
+
+   if ( threaded ) {
+      // The slot is retired once its stack is no longer in use.
+      switchAway( finished, PENDING_RETIRE, takeWork( true ) ) ;
+   }
+   retireRunning() ;
+   if ( !--coroutineCount ) {
+      switchStacks( &finished->sp, mainSp ) ;
+   }
+   resumeNext() ;
+   switchStacks( &finished->sp, running->sp ) ;
+}
+
+/*******************************************************************************
+* newStack                                                                     *
+*                                                                              *
+* Purpose: Gives a slot a stack of stackSize bytes, keeping the stack the slot *
+*          already has if that is the right size.  The page below each stack   *
+*          is a guard page, so a stack overflow faults instead of silently     *
+*          overwriting memory.                                                 *
+*******************************************************************************/
+HIDE void newStack( Slot *slot )
+{
+   byte *area ;
+
+   if ( slot->stack != NULL ) {
+      if ( slot->stackSize == stackSize ) {
+         return ;
+      }
+      munmap( slot->stack - pageSize, slot->stackSize + pageSize ) ;
+   }
+   area = (byte *)mmap( NULL, stackSize + pageSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANON, -1, 0 ) ;
+   if ( area == (byte *)MAP_FAILED || mprotect( area, pageSize, PROT_NONE ) ) {
+      printf( "sccor: cannot map a coroutine stack of %ld bytes\n", stackSize ) ;
+      exit( 1 ) ;
+   }
+   slot->stack = area + pageSize ;
+   slot->stackSize = stackSize ;
+}
+
+/*******************************************************************************
+* layoutStack                                                                  *
+*                                                                              *
+* Purpose: Creates the initial stack of a new coroutine instance, from top    *
+*          (16-byte aligned, and normally the top of the slot's stack) down:   *
+*             - the arguments that do not go in registers (any number of       *
+*               longs), above the shadow space on Cygwin                       *
+*             - the address of exitCoroutine (the coroutine's return address)  *
+*             - the address of the coroutine                                   *
+*             - the arguments that go in registers, popped by startCoroutine   *
+*             - the address of startCoroutine                                  *
+*             - initial values for the registers popped by switchStacks        *
+*          The arguments are taken from array, unless it is NULL, or else from *
+*          arg.                                                                *
+*******************************************************************************/
+HIDE void layoutStack( Slot *slot, COROUTINE coroutine, int argCount, 
+                       va_list *arg, const long *array, long *top )
+{
+   long regs[IN_REGISTERS_COUNT] = { 0 } ;
+   int  stackCount = argCount > IN_REGISTERS_COUNT 
+                     ? argCount - IN_REGISTERS_COUNT : 0 ;
+
+   // The return address must be 8 bytes off a 16-byte boundary on entry to
+   // the coroutine.
+   long *args = top - stackCount - stackCount % 2 ;
+   long *sp = args - SHADOW_SPACE_COUNT ;
+
+   for ( int i = 0; i < argCount; i++ ) {
+      long value = array != NULL ? array[i] : va_arg( *arg, long ) ;
+
+      if ( i < IN_REGISTERS_COUNT ) {
+         regs[i] = value ;
+      } else {
+         args[i - IN_REGISTERS_COUNT] = value ;
+      }
+   }
+   *--sp = (long)exitCoroutine ;
+   *--sp = (long)coroutine ;
+   for ( int i = IN_REGISTERS_COUNT; i-- > 0; ) {
+      *--sp = regs[i] ;
+   }
+   *--sp = (long)startCoroutine ;
+   sp -= SAVED_LONGS ;
+   memset( sp, 0, SAVED_LONGS * sizeof( long ) ) ;
+   sp[SAVED_R12_INDEX] = (long)finishCoroutine ;
+   sp[SAVED_R13_INDEX] = (long)finishSwitch ;
+   slot->sp = sp ;
+   STATS_ENTRY( slot, coroutine ) ;
+}
+
+/*******************************************************************************
+* spawn                                                                        *
+*                                                                              *
+* Purpose: Places a new coroutine instance, with argCount longs as arguments   *
+*          taken from arg, at the front of the ring.  Returns its handle.      *
+*******************************************************************************/
+HIDE COROUTINE_HANDLE spawn( COROUTINE coroutine, int argCount, va_list *arg )
+{
+   Slot            *slot = newCoroutine() ;
+   COROUTINE_HANDLE handle = handleOf( slot ) ;
+
+   layoutStack( slot, coroutine, argCount, arg, NULL, 
+                (long *)( slot->stack + slot->stackSize ) ) ;
+   startSlot( slot ) ;
+   return handle ;
+}
+
+/*******************************************************************************
+* newCoroutine                                                                 *
+*                                                                              *
+* Purpose: Returns a slot, with its stack, for a new coroutine instance.       *
+*******************************************************************************/
+HIDE Slot *newCoroutine( void )
+{
+   Slot *slot ;
+
+   lockScheduler() ;
+   slot = newSlot() ;
+   if ( pageSize == 0 ) {
+      pageSize = sysconf( _SC_PAGESIZE ) ;
+   }
+   newStack( slot ) ;
+   unlockScheduler() ;
+   return slot ;
+}
+
+/*******************************************************************************
+* startSlot                                                                    *
+*                                                                              *
+* Purpose: Counts a laid out coroutine instance and puts it on the ring.       *
+*******************************************************************************/
+HIDE void startSlot( Slot *slot )
+{
+   ++coroutineCount ;
+   putFirst( slot ) ;
+}
+
+/*******************************************************************************
+* layoutClosure                                                                *
+*                                                                              *
+* Purpose: Lays out a new coroutine's stack from top down, with argCount longs *
+*          as arguments following argCount.                                    *
+*******************************************************************************/
+HIDE void layoutClosure( Slot *slot, long *top, COROUTINE coroutine, 
+                         int argCount, ... )
+{
+   va_list arg ;
+
+   va_start( arg, argCount ) ;
+   layoutStack( slot, coroutine, argCount, &arg, NULL, top ) ;
+   va_end( arg ) ;
+}
+
+/*******************************************************************************
+* thisWorker                                                                   *
+*                                                                              *
+* Purpose: Returns the worker of the current thread.  A coroutine may resume   *
+*          on another thread than the one it was suspended on, so this is not  *
+*          inlined: the address of a thread_local must not be kept across a    *
+*          task switch.                                                        *
+*******************************************************************************/
+HIDE __attribute__(( noinline )) Worker *thisWorker( void )
+{
+   return self ;
+}
+
+/*******************************************************************************
+* wakeIdle                                                                     *
+*                                                                              *
+* Purpose: Wakes an idle worker (all of them if the work added is pinned to a  *
+*          worker), after work has been added to a ring.                       *
+*******************************************************************************/
+HIDE void wakeIdle( bool all )
+{
+   std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+   if ( idleCount > 0 ) {
+      std::lock_guard<std::mutex> guard( idleLock ) ;
+
+      ++wakeSeq ;
+      if ( all ) {
+         idleWake.notify_all() ;
+      } else {
+         idleWake.notify_one() ;
+      }
+   }
+}
+
+/*******************************************************************************
+* pushWorker                                                                   *
+*                                                                              *
+* Purpose: Puts a coroutine at the front or back of a worker's ring.           *
+*******************************************************************************/
+HIDE void pushWorker( Worker *worker, Slot *slot, bool first )
+{
+   worker->lock.lock() ;
+   rqPush( &worker->ring, slot, first ) ;
+   worker->lock.unlock() ;
+   wakeIdle( slot->home >= 0 ) ;
+}
+
+/*******************************************************************************
+* popWorker                                                                    *
+*                                                                              *
+* Purpose: Takes the next coroutine from a worker's ring.  A worker stealing   *
+*          from another takes the first coroutine not pinned there, and gives  *
+*          up if the ring is locked.                                           *
+*******************************************************************************/
+HIDE Slot *popWorker( Worker *worker, bool stealing )
+{
+   Slot *slot ;
+
+   if ( stealing ) {
+      if ( ! worker->lock.try_lock() ) {
+         return NULL ;
+      }
+   } else {
+      worker->lock.lock() ;
+   }
+   slot = rqPop( &worker->ring, stealing ) ;
+   worker->lock.unlock() ;
+   return slot ;
+}
+
+/*******************************************************************************
+* serviceWaits                                                                 *
+*                                                                              *
+* Purpose: Puts the coroutines whose deadlines have passed on the current      *
+*          worker's ring, and (unless another worker is doing so) waits up to  *
+*          pollNs ns in the I/O reactor.  Returns the earliest deadline left,  *
+*          or -1 if there is none.                                             *
+*******************************************************************************/
+HIDE long long serviceWaits( long long pollNs )
+{
+   long long deadline ;
+   bool      polling ;
+
+   schedLock.lock() ;
+   releaseTimers() ;
+   deadline = timerCount > 0 ? timers[0]->wake : -1 ;
+   polling = ioWaiters > 0 && ! ioPolling ;
+   ioPolling = ioPolling || polling ;
+   schedLock.unlock() ;
+   if ( polling ) {
+      if ( deadline >= 0 && deadline - clockNs() < pollNs ) {
+         pollNs = deadline > clockNs() ? deadline - clockNs() : 0 ;
+      }
+      pollIo( pollNs ) ;
+      schedLock.lock() ;
+      ioPolling = false ;
+      schedLock.unlock() ;
+   }
+   return deadline ;
+}
+
+/*******************************************************************************
+* takeWork                                                                     *
+*                                                                              *
+* Purpose: Returns the next coroutine for the current worker: the front of its *
+*          own ring or, failing that, one stolen from another worker.  Now and *
+*          then, if service is set, the timers and the I/O reactor are checked *
+*          first.  Stackless coroutines taken are run in place, unless the     *
+*          caller has the scheduler locked:  then the first one is put back,   *
+*          for the worker's own loop.  Returns NULL if no classic coroutine is *
+*          runnable.                                                           *
+*******************************************************************************/
+HIDE Slot *takeWork( bool service, bool locked )
+{
+   Worker *worker = thisWorker() ;
+   Slot   *slot ;
+
+   if ( service && ++worker->ticks % IO_POLL_INTERVAL == 0 ) {
+      serviceWaits( 0 ) ;
+   }
+   for ( ;; ) {
+      slot = popWorker( worker, false ) ;
+      for ( int i = 1; slot == NULL && i < workerCount; i++ ) {
+         slot = popWorker( &workers[( worker->index + i ) % workerCount], true ) ;
+      }
+      if ( slot == NULL || slot->step == NULL ) {
+         return slot ;
+      }
+      if ( locked ) {
+         pushWorker( worker, slot, true ) ;
+         return NULL ;
+      }
+      runStep( slot ) ;
+   }
+}
+
+/*******************************************************************************
+* findWork                                                                     *
+*                                                                              *
+* Purpose: Returns the next coroutine for the current worker, waiting for one  *
+*          to become runnable.  Returns NULL once the last coroutine of the    *
+*          cobegin has finished.                                               *
+*******************************************************************************/
+HIDE Slot *findWork( void )
+{
+   Slot *slot ;
+
+   for ( ;; ) {
+      long long deadline ;
+      unsigned  seq ;
+
+      if ( ( slot = takeWork( false ) ) != NULL ) {
+         return slot ;
+      }
+      deadline = serviceWaits( IDLE_POLL_NS ) ;
+      if ( ( slot = takeWork( false ) ) != NULL ) {
+         return slot ;
+      }
+
+      // Announce the wait before checking the rings a last time, so work
+      // added meanwhile either is seen here or bumps wakeSeq.
+      std::unique_lock<std::mutex> idle( idleLock ) ;
+      if ( allDone ) {
+         return NULL ;
+      }
+      seq = wakeSeq ;
+      idle.unlock() ;
+      ++idleCount ;
+      if ( ( slot = takeWork( false ) ) != NULL ) {
+         --idleCount ;
+         return slot ;
+      }
+      idle.lock() ;
+      if ( wakeSeq == seq && ! allDone && idleCount == workerCount ) {
+         bool blocked ;
+
+         // The deadline was read before the last look at the rings, so read
+         // it again, under the scheduler lock (taken ahead of idleLock, as
+         // wakeIdle's callers do).  A timer added after this bumps wakeSeq.
+         idle.unlock() ;
+         schedLock.lock() ;
+         deadline = timerCount > 0 ? timers[0]->wake : -1 ;
+         blocked = deadline < 0 && ioWaiters == 0 ;
+         schedLock.unlock() ;
+         idle.lock() ;
+         if ( blocked && wakeSeq == seq && ! allDone && idleCount == workerCount ) {
+            printf( "sccor: every coroutine is blocked\n" ) ;
+            exit( 1 ) ;
+         }
+      }
+      if ( wakeSeq == seq && ! allDone ) {
+         if ( ioWaiters > 0 ) {
+            // Another worker is in the reactor; take over in a while.
+            idleWake.wait_for( idle, std::chrono::nanoseconds( IDLE_POLL_NS ) ) ;
+         } else if ( deadline >= 0 ) {
+            idleWake.wait_for( idle, std::chrono::nanoseconds( 
+                                        deadline - clockNs() ) ) ;
+         } else {
+            idleWake.wait( idle ) ;
+         }
+      }
+      --idleCount ;
+   }
+}
+
+/*******************************************************************************
+* switchAway                                                                   *
+*                                                                              *
+* Purpose: Switches from the running coroutine to the next one (or to the      *
+*          worker's own loop, if next is NULL), leaving the coroutine switched *
+*          away from to be requeued, retired, or just released (after parking) *
+*          once its stack is no longer in use.                                 *
+*******************************************************************************/
+HIDE void switchAway( Slot *suspended, int action, Slot *next )
+{
+   Worker *worker = thisWorker() ;
+
+   STATS_SUSPENDED( suspended, 0 ) ;
+   worker->pending = action ;
+   worker->pendingSlot = suspended ;
+   running = next ;
+   if ( next != NULL ) {
+      STATS_RESUMED( next, 0 ) ;
+   }
+   switchStacks( &suspended->sp, next != NULL ? next->sp : worker->mainSp ) ;
+   finishSwitch() ;
+}
+
+/*******************************************************************************
+* finishSwitch                                                                 *
+*                                                                              *
+* Purpose: Completes a task switch between workers' coroutines by carrying out *
+*          the action left by switchAway.                                      *
+*******************************************************************************/
+HIDE void finishSwitch( void )
+{
+   Worker *worker ;
+   Slot   *slot ;
+
+   if ( ! threaded ) {
+      return ;
+   }
+   worker = thisWorker() ;
+   slot = worker->pendingSlot ;
+   switch ( worker->pending ) {
+   case PENDING_REQUEUE :
+      worker->pending = PENDING_NONE ;
+      putLast( slot ) ;
+      break ;
+   case PENDING_UNLOCK :
+      worker->pending = PENDING_NONE ;
+      schedLock.unlock() ;
+      break ;
+   case PENDING_RETIRE :
+      worker->pending = PENDING_NONE ;
+      schedLock.lock() ;
+      STATS_RETIRED( slot ) ;
+      releaseJoiners( slot ) ;
+      slot->next = freeSlots ;
+      freeSlots = slot ;
+      schedLock.unlock() ;
+      if ( !--coroutineCount ) {
+         std::lock_guard<std::mutex> guard( idleLock ) ;
+
+         allDone = true ;
+         idleWake.notify_all() ;
+      }
+      break ;
+   }
+}
+
+/*******************************************************************************
+* workerLoop                                                                   *
+*                                                                              *
+* Purpose: Runs coroutines on the current worker until the last one finishes.  *
+*******************************************************************************/
+HIDE void workerLoop( void )
+{
+   Slot *next ;
+
+   while ( ( next = findWork() ) != NULL ) {
+      running = next ;
+      STATS_RESUMED( next, 0 ) ;
+      switchStacks( &thisWorker()->mainSp, next->sp ) ;
+      finishSwitch() ;
+   }
+}
+
+/*******************************************************************************
+* workerMain                                                                   *
+*                                                                              *
+* Purpose: Body of the thread of each worker but the first, which is the       *
+*          thread that called cobegin.                                         *
+*******************************************************************************/
+HIDE void workerMain( int index )
+{
+   self = &workers[index] ;
+#if defined(__linux__)
+   if ( pinThreads ) {
+      cpu_set_t cpus ;
+
+      CPU_ZERO( &cpus ) ;
+      CPU_SET( index % sysconf( _SC_NPROCESSORS_ONLN ), &cpus ) ;
+      pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) ;
+   }
+#endif
+   workerLoop() ;
+}
+
+/*******************************************************************************
+* runWorkers                                                                   *
+*                                                                              *
+* Purpose: Runs the coroutines of a cobegin on workerCount workers, returning  *
+*          once the last coroutine has finished.                               *
+*******************************************************************************/
+HIDE void runWorkers( void )
+{
+   for ( int i = 1; i < workerCount; i++ ) {
+      workers[i].thread = std::thread( workerMain, i ) ;
+   }
+   workerMain( 0 ) ;
+   for ( int i = 1; i < workerCount; i++ ) {
+      workers[i].thread.join() ;
+   }
+   delete [] workers ;
+   workers = NULL ;
+   self = NULL ;
+}
+
+/*******************************************************************************
+*                    Separate-Stack Public Functions (API)                     *
+*******************************************************************************/
+
+/*******************************************************************************
+* cobegin                                                                      *
+*                                                                              *
+* Purpose: Initialize the multitasker and start n coroutine instances          *
+*          on the ring.                                                        *
+*                                                                              *
+* Remarks on usage : As for the copying backend (see above).                   *
+*******************************************************************************/
+void cobegin( int n, ... )
+{
+   va_list arg ;
+
+   if ( workerCount > 1 && ! virtualTime ) {
+      workers = new Worker[workerCount] ;
+      for ( int i = 0; i < workerCount; i++ ) {
+         memset( &workers[i].ring, 0, sizeof( RunQueue ) ) ;
+         workers[i].index = i ;
+         workers[i].pending = PENDING_NONE ;
+         workers[i].ticks = 0 ;
+      }
+      threaded = true ;
+   }
+   va_start( arg, n ) ;
+   while ( n-- ) {
+      COROUTINE coroutine = va_arg( arg, COROUTINE ) ;
+      int       argCount = va_arg( arg, int ) ;
+
+      spawn( coroutine, argCount, &arg ) ;
+   }
+   va_end( arg ) ;
+
+   if ( threaded ) {
+      runWorkers() ;
+      resetCsa() ;
+   } else if ( coroutineCount > 0 ) {
+      // Run the coroutines until the last one switches back to here.
+      resumeNext() ;
+      switchStacks( &mainSp, running->sp ) ;
+      resetCsa() ;
+   }
+}
+
+/*******************************************************************************
+* coresume                                                                     *
+*                                                                              *
+* Purpose: performs an unconditional task switch.                              *
+*******************************************************************************/
+void coresume( void )
+{
+   if ( threaded ) {
+      Slot *suspended = running ;
+      Slot *next = takeWork( true ) ;
+
+      // Keep running if nothing else is runnable, unless the coroutine must
+      // move to the worker it has been pinned to.
+      if ( next != NULL || ( suspended->home >= 0 
+                             && suspended->home != thisWorker()->index ) ) {
+         switchAway( suspended, PENDING_REQUEUE, next ) ;
+      }
+      return ;
+   }
+   // No-ops if no task on the ring, unless the running coroutine is parking.
+   if ( coroutineCount > 1 || parking ) {
+      Slot *suspended = running ;
+
+      STATS_SUSPENDED( suspended, 0 ) ;
+      requeueRunning() ;
+      resumeNext() ;
+      if ( running != suspended ) {
+         switchStacks( &suspended->sp, running->sp ) ;
+      }
+   }
+}
+
+/*******************************************************************************
+* invoke                                                                       *
+*                                                                              *
+* Purpose: place a new coroutine instance on the multi-tasker ring.            *
+*                                                                              *
+* Note: the new coroutine will be on the ring, but no task switch is performed.*
+*       The new coroutine will not be executed until the next coresume.        *
+*       Returns the handle of the new instance.                                *
+*******************************************************************************/
+COROUTINE_HANDLE invoke( COROUTINE coroutine, int argCount, ... )
+{
+   COROUTINE_HANDLE handle ;
+   va_list arg ;
+
+   va_start( arg, argCount ) ;
+   handle = spawn( coroutine, argCount, &arg ) ;
+   va_end( arg ) ;
+   return handle ;
+}
+
+/*******************************************************************************
+* invokeN                                                                      *
+*                                                                              *
+* Purpose: place count new instances of a coroutine on the ring, instance i    *
+*          taking the argCount longs at args + i * argCount.  The instances    *
+*          are put at the front of the ring in order, so instance 0 runs       *
+*          first.  Their handles are stored in handles[i], unless it is NULL.  *
+*                                                                              *
+*          The slots that have no stack of the right size get theirs from a    *
+*          single mapping, with a guard page below each stack.                 *
+*******************************************************************************/
+void invokeN( COROUTINE coroutine, int count, int argCount, const long *args,
+              COROUTINE_HANDLE *handles )
+{
+   Slot **slots = (Slot **)malloc( count * sizeof( Slot * ) ) ;
+   long   bytes = 0 ;
+   byte  *area ;
+
+   if ( count <= 0 ) {
+      free( slots ) ;
+      return ;
+   }
+   lockScheduler() ;
+   if ( pageSize == 0 ) {
+      pageSize = sysconf( _SC_PAGESIZE ) ;
+   }
+   for ( int i = 0; i < count; i++ ) {
+      slots[i] = newSlot() ;
+      if ( slots[i]->stack != NULL && slots[i]->stackSize != stackSize ) {
+         munmap( slots[i]->stack - pageSize, slots[i]->stackSize + pageSize ) ;
+         slots[i]->stack = NULL ;
+      }
+      if ( slots[i]->stack == NULL ) {
+         bytes += stackSize + pageSize ;
+      }
+   }
+   if ( bytes > 0 ) {
+      area = (byte *)mmap( NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANON, -1, 0 ) ;
+      if ( area == (byte *)MAP_FAILED ) {
+         printf( "sccor: cannot map %d coroutine stacks of %ld bytes\n", 
+                 count, stackSize ) ;
+         exit( 1 ) ;
+      }
+      for ( int i = 0; i < count; i++ ) {
+         if ( slots[i]->stack == NULL ) {
+            if ( mprotect( area, pageSize, PROT_NONE ) ) {
+               printf( "sccor: cannot map a coroutine stack of %ld bytes\n", 
+                       stackSize ) ;
+               exit( 1 ) ;
+            }
+            slots[i]->stack = area + pageSize ;
+            slots[i]->stackSize = stackSize ;
+            area += stackSize + pageSize ;
+         }
+      }
+   }
+   unlockScheduler() ;
+
+   for ( int i = count; i-- > 0; ) {
+      layoutStack( slots[i], coroutine, argCount, NULL, 
+                   args != NULL ? args + (long)i * argCount : NULL,
+                   (long *)( slots[i]->stack + slots[i]->stackSize ) ) ;
+      if ( handles != NULL ) {
+         handles[i] = handleOf( slots[i] ) ;
+      }
+      startSlot( slots[i] ) ;
+   }
+   free( slots ) ;
+}
+
+/*******************************************************************************
+* invokeClosure                                                                *
+*                                                                              *
+* Purpose: place a new coroutine instance, start( storage ), on the ring,      *
+*          where storage is bytes (16-byte aligned) kept at the top of the     *
+*          coroutine's stack.  construct( storage, context ) fills in storage  *
+*          before any worker can run the coroutine.                            *
+*******************************************************************************/
+COROUTINE_HANDLE invokeClosure( void (*start)( void * ), unsigned long bytes, 
+                    void (*construct)( void *, void * ), void *context )
+{
+   Slot *slot = newCoroutine() ;
+   long *top = (long *)( slot->stack + slot->stackSize ) 
+               - ( bytes + 15 ) / 16 * 2 ;
+   COROUTINE_HANDLE handle = handleOf( slot ) ;
+
+   if ( bytes > (unsigned long)slot->stackSize / 2 ) {
+      printf( "sccor: closure of %lu bytes too large for the stack\n", bytes ) ;
+      exit( 1 ) ;
+   }
+   construct( top, context ) ;
+   layoutClosure( slot, top, (COROUTINE)start, 1, (long)top ) ;
+   startSlot( slot ) ;
+   return handle ;
+}
+
+/*******************************************************************************
+* setStackSize                                                                 *
+*                                                                              *
+* Purpose: sets the size of the stacks of coroutines created afterwards.       *
+*          The size is rounded up to a whole number of pages.                  *
+*******************************************************************************/
+void setStackSize( unsigned long bytes )
+{
+   if ( pageSize == 0 ) {
+      pageSize = sysconf( _SC_PAGESIZE ) ;
+   }
+   stackSize = ( ( bytes + pageSize - 1 ) / pageSize ) * pageSize ;
+}
+
+/*******************************************************************************
+* setWorkerCount                                                               *
+*                                                                              *
+* Purpose: sets the number of worker threads that later cobegins run their     *
+*          coroutines on.  With pinned set (on Linux), worker i is bound to    *
+*          processor i.                                                        *
+*******************************************************************************/
+void setWorkerCount( int count, bool pinned )
+{
+   workerCount = count > 1 ? count : 1 ;
+   pinThreads = pinned ;
+}
+
+/*******************************************************************************
+* getWorkerIndex                                                               *
+*                                                                              *
+* Purpose: returns the index of the worker running the current coroutine.      *
+*******************************************************************************/
+int getWorkerIndex( void )
+{
+   return threaded ? thisWorker()->index : 0 ;
+}
+
+/*******************************************************************************
+* pinCoroutine                                                                 *
+*                                                                              *
+* Purpose: keeps the running coroutine on one worker (any worker, if -1),      *
+*          moving it there now.  Other workers do not steal it.                *
+*******************************************************************************/
+void pinCoroutine( int worker )
+{
+   if ( running != NULL ) {
+      running->home = worker >= 0 && threaded ? worker % workerCount : -1 ;
+      coresume() ;
+   }
+}
+
+#endif // defined(SCCOR_SEPARATE_STACKS)
+
+/*******************************************************************************
+*                        Common Public Functions (API)                         *
+*******************************************************************************/
+
+/*******************************************************************************
+* getCoroutineCount                                                            *
+*                                                                              *
+* Purpose: returns the number of active coroutines.                            *
+*******************************************************************************/
+int getCoroutineCount( void )
+{
+   return coroutineCount ;
+}
+
+/*******************************************************************************
+* getCsaSize                                                                   *
+*                                                                              *
+* Purpose: returns the number of bytes the csa currently takes.                *
+*******************************************************************************/
+unsigned long getCsaSize( void )
+{
+   return csaBytes ;
+}
+
+/*******************************************************************************
+* setCsaLimit                                                                  *
+*                                                                              *
+* Purpose: sets the limit on the number of bytes the csa may take.             *
+*******************************************************************************/
+void setCsaLimit( unsigned long bytes )
+{
+   csaLimit = bytes ;
+}
+
+/*******************************************************************************
+* getClockNs                                                                   *
+*                                                                              *
+* Purpose: returns the time, in ns, of the clock of wait() and the timeouts:   *
+*          the virtual clock in virtual time, else the monotonic clock.        *
+*******************************************************************************/
+unsigned long long getClockNs( void )
+{
+   return (unsigned long long)clockNs() ;
+}
+
+/*******************************************************************************
+* setVirtualTime                                                               *
+*                                                                              *
+* Purpose: selects virtual time (or, if false, real time) for later cobegins.  *
+*          The virtual clock (IntervalClock's virtualClock) starts at 0, and   *
+*          stands still while any coroutine can run.  When every coroutine is  *
+*          in a timed wait, it jumps to the earliest deadline, with no         *
+*          sleeping.  A coroutine waiting for I/O is released only if it is    *
+*          ready by then.  The coroutines run on a single worker, whatever     *
+*          setWorkerCount asked for, so a run can be repeated exactly.         *
+*          Call outside cobegin.                                               *
+*******************************************************************************/
+void setVirtualTime( bool enabled )
+{
+   virtualTime = enabled ;
+   IntervalClock::SetVirtualNs( 0 ) ;
+}
+
+/*******************************************************************************
+* setCsaPages                                                                  *
+*                                                                              *
+* Purpose: selects the backing of the chunks the csa grows by from now on:     *
+*             CSA_PAGES_NORMAL  - the heap (the default)                       *
+*             CSA_PAGES_HUGE    - transparent hugepages, where supported       *
+*             CSA_PAGES_HUGETLB - the hugetlb pool, falling back to            *
+*                                 CSA_PAGES_HUGE when it is empty              *
+*          and on Linux binds them to NUMA node 'numaNode' (-1 for any).       *
+*          With hugepages each chunk fills whole 2 MiB pages, which count      *
+*          toward the limit set by setCsaLimit.                                *
+*******************************************************************************/
+void setCsaPages( int pages, int numaNode )
+{
+   lockScheduler() ;
+   csaPages = pages ;
+   csaNode = numaNode ;
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* setPolicy                                                                    *
+*                                                                              *
+* Purpose: selects how the next coroutine to run is chosen:                    *
+*             POLICY_ROUND_ROBIN - in turn (the default)                       *
+*             POLICY_PRIORITY    - the highest priority level first, in turn   *
+*                                  within a level                              *
+*             POLICY_DEADLINE    - the earliest deadline first, then as for    *
+*                                  POLICY_PRIORITY                             *
+*          Coroutines already queued keep their places until requeued.         *
+*******************************************************************************/
+void setPolicy( int newPolicy )
+{
+   lockScheduler() ;
+   policy = newPolicy ;
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* setPriority                                                                  *
+*                                                                              *
+* Purpose: sets the priority level of the running coroutine (new coroutines    *
+*          start at PRIORITY_NORMAL).                                          *
+*******************************************************************************/
+void setPriority( int priority )
+{
+   if ( running != NULL ) {
+      running->priority = priority < PRIORITY_LOW ? PRIORITY_LOW 
+                          : priority > PRIORITY_CRITICAL ? PRIORITY_CRITICAL 
+                          : priority ;
+   }
+}
+
+/*******************************************************************************
+* setDeadline                                                                  *
+*                                                                              *
+* Purpose: declares that the running coroutine should run again within         *
+*          deadlineMs ms (no deadline, if 0), for POLICY_DEADLINE.             *
+*******************************************************************************/
+void setDeadline( unsigned long deadlineMs )
+{
+   if ( running != NULL ) {
+      running->deadline = deadlineMs ? clockNs() + (long long)deadlineMs * 1000000 
+                                     : -1 ;
    }
-}                                                                
+}
 
 /*******************************************************************************
-* coresume                                                                     *
+* invokeStep                                                                   *
 *                                                                              *
-* Purpose: performs an unconditional task switch.                              *
+* Purpose: place a new stackless coroutine instance on the ring.  Each time it *
+*          is resumed, step( context ) is called, on the stack of whichever    *
+*          coroutine (or worker) is switching, to run it up to its next        *
+*          suspension; step returns true once the coroutine has finished.      *
+*          A step must not call coresume() or the blocking calls; it suspends  *
+*          through parkStep() (see sccortask.h).  Returns the handle of the    *
+*          new instance.                                                       *
 *******************************************************************************/
-void coresume( void )
+COROUTINE_HANDLE invokeStep( bool (*step)( void * ), void *context )
 {
-   long *_BPX ;
-
-   // No-ops if no task in csa.
-   if (coroutineCount > 1) {
-      // Compute the size of the current coroutine's stack frame plus its
-      // return address and stored values for its rbx (and rdi and rsi for
-      // Cygwin).
-      asm ("movq %%rbp, %0" : "=rm" (_BPX) : /* no inputs */) ;
-#if defined(CYGWIN)
-      _BPX -= /*3*/ -1 ;                   // include our rbx, rsi, and rdi saved 
-                                    //   by coresume
-                                    //   (note pointer arithmetic)
-#else
-      _BPX -= 1 ;                   // include our rbx, rsi, and rdi saved 
-                                    //   by coresume
-                                    //   (note pointer arithmetic)
-#endif
-      _size = (base - 2 - _BPX) ;   // coroutine extends from 1 or 3 longs 
-                                    // "above" coresume's rbp to 2 longs 
-                                    // "above" base.
-
-      // Open a slot for old task.  The extra long is for the coroutine size.
-      memmove( csa + _size + 1, csa, (csavail - csa) * sizeof( long ) ) ;
-      csavail += _size + 1 ;
-
-      // Store the coroutine in the csa along with the coroutine size.
-      // The size of the coroutine is not itself included in the coroutine
-      // "size" that is stored in the csa.  Note that the csa is addressed
-      // via pointer arithmetic.
-      memmove( csa, (void *)_BPX, _size * sizeof( long ) ) ;
-      csa[_size] = _size ;
-
-      // Move popCoroutine's stack frame out of the way of the coroutine
-      // we're copying in. We move the stack here before calling popCoroutine
-      // so that rbp (and associated temps) is out of harm's way.
-      _size = *( csavail - 1 ) ;    // number of longs in coroutine entry
-      _size &= 0x00ffffffffffffff ; // omit mark
-
-      asm ( "movq %%rsp, %0" : "=rm" (_RSP) : /* no inputs */ ) ;
+   Slot            *slot ;
+   COROUTINE_HANDLE handle ;
+
+   lockScheduler() ;
+   slot = newSlot() ;
+   slot->step = step ;
+   slot->stepContext = context ;
+   STATS_ENTRY( slot, (COROUTINE)step ) ;
+   handle = handleOf( slot ) ;
+   ++stepCount ;
+   unlockScheduler() ;
+   ++coroutineCount ;
+   putFirst( slot ) ;
+   return handle ;
+}
 
-      // The stack pointer should be on a 16-byte boundary before any call.
-      _RSP -= _size + EXTRA_STACK /*+ 1*/ ;
-      asm volatile ( "movq %0, %%rsp" : /* no outputs */ : "rm" (_RSP) : "%rsp" ) ;
+/*******************************************************************************
+* parkStep                                                                     *
+*                                                                              *
+* Purpose: called by the running stackless coroutine as it suspends:           *
+*             STEP_YIELD     - until its next turn on the ring                 *
+*             STEP_WAIT      - for timeoutMs ms                                *
+*             STEP_EVENT     - until the EVENT object is set                   *
+*             STEP_SEMAPHORE - until one is taken from the SEMAPHORE object    *
+*             STEP_CONDITION - until the CONDITION object is signaled          *
+*             STEP_JOIN      - until the COROUTINE_HANDLE object's instance    *
+*                              finishes                                        *
+*             STEP_CHANNEL   - as STEP_SEMAPHORE, for the waits of a Channel,  *
+*                              which cancel() does not end                     *
+*          waiting at most timeoutMs ms for the last five.  Returns false if   *
+*          the coroutine need not suspend at all.  Once it is resumed (or at   *
+*          once, if it need not suspend), stepSignaled() tells whether the     *
+*          wait succeeded, as the result of the blocking call would.           *
+*******************************************************************************/
+bool parkStep( int reason, void *object, unsigned long timeoutMs )
+{
+   Slot       *slot = running,
+              *target ;
+   WAIT_QUEUE *queue = NULL ;
 
-      popCoroutine() ;
+   if ( slot == NULL || slot->step == NULL ) {
+      printf( "sccor: parkStep outside of a stackless coroutine\n" ) ;
+      exit( 1 ) ;
+   }
+   lockScheduler() ;
+   slot->signaled = true ;
+   if ( slot->cancelPending && reason != STEP_YIELD && reason != STEP_CHANNEL ) {
+      // Canceled while not parked:  this wait ends at once.
+      slot->cancelPending = slot->signaled = false ;
+      unlockScheduler() ;
+      return false ;
+   }
+   switch ( reason ) {
+   case STEP_YIELD :
+      unlockScheduler() ;
+      return true ;
+   case STEP_EVENT :
+      slot->signaled = ( (EVENT *)object )->signaled ;
+      queue = &( (EVENT *)object )->waiters ;
+      break ;
+   case STEP_JOIN :
+      target = liveSlot( *(COROUTINE_HANDLE *)object ) ;
+      if ( target == NULL ) {
+         unlockScheduler() ;
+         return false ;
+      }
+      slot->signaled = false ;
+      queue = &target->joiners ;
+      break ;
+   case STEP_SEMAPHORE :
+   case STEP_CHANNEL :
+      if ( ( (SEMAPHORE *)object )->count > 0 ) {
+         --( (SEMAPHORE *)object )->count ;
+         unlockScheduler() ;
+         return false ;
+      }
+      slot->signaled = false ;
+      queue = &( (SEMAPHORE *)object )->waiters ;
+      break ;
+   case STEP_CONDITION :
+      queue = &( (CONDITION *)object )->waiters ;
+      break ;
    }
+   if ( ( reason == STEP_EVENT && slot->signaled ) 
+        || ( timeoutMs == 0 && reason != STEP_CONDITION ) ) {
+      unlockScheduler() ;
+      return false ;
+   }
+   parkSlot( slot, queue, timeoutMs ) ;
+   slot->shielded = reason == STEP_CHANNEL ;
 
-   // Tell Clang to save rbx (and rdi and rsi on Cygwin)** so popCoroutine 
-   // can write the new routine's value to the stack location from which 
-   // Clang will restore its saved register:
-   //     :  :  :
-   //  **pop %rsi
-   //  **pop %rdi
-   //    pop %rbx
-   //    pop %rbp
-   //    ret
-   //
-   // in coresume's epilogue.
-#if defined(CYGWIN)
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rsi", 
-                                                                 "%rdi", 
-                                                                 "%rbx" ) ;
-#else
-   asm volatile ( "nop\n\t" : /* no input */ : /* no output */ : "%rbx" ) ;
-#endif
+   // The scheduler lock is released once the step has returned.
+   stepParked = true ;
+   return true ;
 }
 
-
 /*******************************************************************************
-* getCoroutineCount                                                            *
+* stepSignaled                                                                 *
 *                                                                              *
-* Purpose: returns the number of active coroutines.                            *
+* Purpose: returns true if the last parkStep() of the running stackless        *
+*          coroutine ended by a signal (or needed no wait), false on timeout   *
+*          or cancel().                                                        *
 *******************************************************************************/
-int getCoroutineCount( void )
+bool stepSignaled( void )
 {
-   return coroutineCount ;
+   return running != NULL && running->signaled ;
 }
 
 /*******************************************************************************
-* invoke                                                                       *
-*                                                                              *
-* Purpose: place a new coroutine instance on the multi-tasker ring.            *
+* join                                                                         *
 *                                                                              *
-*          Creates an initial stack for the coroutine consisting of:           *
-*             - initial value for rbx (and rdi and rsi in Cygwin) and          *
-*             - initial rbp value (base)                                       *
-*             - address of the coroutine                                       *
-*             - the passed in arguments (any number of longs)                  *
+* Purpose: waits, off the ring, until the coroutine instance of a handle has   *
+*          finished (i.e., returned) or timeoutMs ms pass.  Returns false on   *
+*          timeout or cancel(), and true at once if the instance has already   *
+*          finished.                                                           *
+*******************************************************************************/
+bool join( COROUTINE_HANDLE handle, unsigned long timeoutMs )
+{
+   Slot *slot ;
+
+   lockScheduler() ;
+   slot = liveSlot( handle ) ;
+   if ( slot == NULL || timeoutMs == 0 ) {
+      unlockScheduler() ;
+      return slot == NULL ;
+   }
+   if ( slot == running ) {
+      printf( "sccor: a coroutine joining itself\n" ) ;
+      exit( 1 ) ;
+   }
+   return park( &slot->joiners, timeoutMs ) ;
+}
+
+/*******************************************************************************
+* cancel                                                                       *
 *                                                                              *
-* Note: the new coroutine will be on the ring, but no task switch is performed.*
-*       The new coroutine will not be executed until the next coresume.        *
+* Purpose: asks the coroutine instance of a handle to finish.  If it is        *
+*          waiting off the ring (in wait(), a wait on an event, semaphore, or  *
+*          condition variable, a join, or I/O), the wait ends now, as on       *
+*          timeout; otherwise its next such wait ends at once.  Later waits    *
+*          are not affected:  the coroutine checks cancelRequested() and       *
+*          returns.  The waits inside a Channel are not ended (they are taken  *
+*          up again).  Returns false if the instance has already finished.     *
 *******************************************************************************/
-void invoke( COROUTINE coroutine, int argCount, ... )
+bool cancel( COROUTINE_HANDLE handle )
 {
-   int fillerCount = 0 ;
-   va_list arg ;
-   va_start( arg, argCount ) ;
+   Slot *slot ;
 
-   *csavail++ = 0 ;     // rbx placeholder
-#if defined(CYGWIN)
-   *csavail++ = 0 ;  // rdi placeholder
-   *csavail++ = 0 ;  // rsi placeholder
-#endif
-   *csavail++ = (long)base ;
-   *csavail++ = (long)coroutine ;
-   *csavail++ = (long)( (long)cleanup + CLEANUP_OFFSET ) ; // keeping same
-                                                           //   rbp and rsp
-   fillerCount = 0 ;
-#if defined(CYGWIN)
-   *csavail++ = SHADOW_SPACE_VALUE ;  // 32-byte shadow space
-   ++fillerCount ;             
-   *csavail++ = SHADOW_SPACE_VALUE ;  
-   ++fillerCount ;             
-   *csavail++ = SHADOW_SPACE_VALUE ;  
-   ++fillerCount ;             
-   *csavail++ = SHADOW_SPACE_VALUE ;  
-   ++fillerCount ;             
-#endif
-   if ( argCount > 0 ) { 
-      for ( int i = 0; i < argCount; i++ ) {
-         *csavail++ = (long)( va_arg( arg, long ) ) ;
+   lockScheduler() ;
+   slot = liveSlot( handle ) ;
+   if ( slot == NULL ) {
+      unlockScheduler() ;
+      return false ;
+   }
+   slot->canceled = true ;
+   if ( slot->parked && ! slot->shielded ) {
+      if ( slot->timerIndex >= 0 ) {
+         removeTimer( slot ) ;
+      }
+      if ( slot->queue != NULL ) {
+         unlinkWaiter( slot ) ;
       }
+      slot->parked = slot->signaled = false ;
+      putLast( slot ) ;
+   } else {
+      slot->cancelPending = true ;
+   }
+   unlockScheduler() ;
+   return true ;
+}
 
-      switch (argCount % 2)        // filler to ensure 16-byte boundary;
-      {
-         case 0:
-            break ;                 // do nothing
+/*******************************************************************************
+* cancelRequested                                                              *
+*                                                                              *
+* Purpose: returns true if cancel() has been called for the running coroutine. *
+*******************************************************************************/
+bool cancelRequested( void )
+{
+   return running != NULL && running->canceled ;
+}
 
-         case 1:
-            *csavail++ = FILLER_VALUE ;  
-            ++fillerCount ;             
-            break;
+/*******************************************************************************
+* getCoroutineStats                                                            *
+*                                                                              *
+* Purpose: copies the counters of up to max live coroutine instances, most     *
+*          recently created first, into stats, and returns the number of live  *
+*          instances.  Returns 0 unless the library is built with SCCOR_STATS. *
+*          The counters of coroutines running on other workers may be a task   *
+*          switch behind.                                                      *
+*******************************************************************************/
+int getCoroutineStats( COROUTINE_STATS *stats, int max )
+{
+   int count = 0 ;
+
+#if defined(SCCOR_STATS)
+   lockScheduler() ;
+   for ( Slot *slot = liveSlots; slot != NULL; slot = slot->statsNext ) {
+      if ( count < max ) {
+         stats[count] = slot->stats ;
       }
-   } else if ( argCount == 0 ) {
-      *csavail++ = FILLER_VALUE ;  
-      ++fillerCount ;             
-      *csavail++ = FILLER_VALUE ;  
-      ++fillerCount ;             
+      ++count ;
    }
+   unlockScheduler() ;
+#endif
+   return count ;
+}
 
-#if defined(CYGWIN)
-#define LONG_COUNT 4
-#else
-#define LONG_COUNT 2
+/*******************************************************************************
+* getRunningStats                                                              *
+*                                                                              *
+* Purpose: copies the counters of the running coroutine into stats.  Returns   *
+*          false if there is none, or without SCCOR_STATS.                     *
+*******************************************************************************/
+bool getRunningStats( COROUTINE_STATS *stats )
+{
+#if defined(SCCOR_STATS)
+   if ( running != NULL ) {
+      *stats = running->stats ;
+      return true ;
+   }
 #endif
-   long coroutineSize = argCount + fillerCount
-      + ( sizeof( long ) * LONG_COUNT + (sizeof( COROUTINE ) * 2) ) / sizeof( long ) ;
-   // Since this coroutine hasn't been executed, we mark the size in the 
-   // high-order byte with (0x80 | argCount) so popCoroutine
-   // can load the ABI registers with the parameters only on startup
-   // of the coroutine. So, if we mark the high-order byte as 0x83, 
-   // there are 3 args for the coroutine, which will be loaded into 
-   // registers rdi, rsi, and rdx by popCoroutine on the first time  
-   // the coroutine is loaded (to simulate calling the coroutine).  
-   // Subsequently, the high-order byte will be zero, so no registers 
-   // will get loaded by popCoroutine.
-   uint8_t mark = 0x80 | argCount ;
-   coroutineSize |= ((long)mark << 56) ;
-   *csavail++ = coroutineSize ;
-   ++coroutineCount ;
+   return false ;
+}
 
-   va_end( arg ) ;
+/*******************************************************************************
+* setStatsHistograms                                                           *
+*                                                                              *
+* Purpose: gives coroutine instances created afterwards histograms of their    *
+*          run slices and resume latencies (in us), or no histograms.  Ignored *
+*          without SCCOR_STATS.                                                *
+*******************************************************************************/
+void setStatsHistograms( bool enabled )
+{
+#if defined(SCCOR_STATS)
+   statsHistograms = enabled ;
+#endif
+}
 
-   #ifdef DEBUG_OUTPUT
-   #endif // def DEBUG_OUTPUT
+/*******************************************************************************
+* setStatsReport                                                               *
+*                                                                              *
+* Purpose: sets a function to be given the counters of each coroutine instance *
+*          as it finishes (NULL for none), while its histograms still exist.   *
+*          The function is called with the scheduler locked, so it must not    *
+*          block or call sccor.  Ignored without SCCOR_STATS.                  *
+*******************************************************************************/
+void setStatsReport( void (*report)( const COROUTINE_STATS *stats ) )
+{
+#if defined(SCCOR_STATS)
+   statsReport = report ;
+#endif
 }
 
 /*******************************************************************************
@@ -640,33 +3551,189 @@ void sleepMs( unsigned long sleepms )
    std::this_thread::sleep_for( std::chrono::milliseconds( sleepms ) ) ;
 }
 
-
 /*******************************************************************************
 * wait                                                                         *
 *                                                                              *
 * Purpose: waits for at least a specified amount of milliseconds while         *
-* continuing other coroutines.                                                 *
+* continuing other coroutines.  The coroutine is not resumed until its         *
+* deadline has passed.                                                         *
 *******************************************************************************/
 void wait( unsigned long waitMs )
 {
-   // Delay for at least waitMs milliseconds.
-   auto go = std::chrono::system_clock::now() + std::chrono::milliseconds( waitMs ) ;
-   when( std::chrono::system_clock::now() >= go ) ; 
+   if ( waitMs == 0 ) {
+      return ;
+   }
+   if ( running == NULL ) {
+      // Not in a coroutine.
+      if ( virtualTime ) {
+         IntervalClock::SetVirtualNs( IntervalClock::VirtualNs() 
+                                      + (unsigned long long)waitMs * 1000000 ) ;
+      } else {
+         sleepMs( waitMs ) ;
+      }
+      return ;
+   }
+
+   // Delay for at least waitMs milliseconds, off the ring.
+   lockScheduler() ;
+   park( NULL, waitMs ) ;
 }
 
 /*******************************************************************************
 * waitEx                                                                       *
 *                                                                              *
 * Purpose: waits for an extended period while continuing other coroutines.     *
-*          The waiting period is interrupted if the boolean becomes false.     *
+*          The waiting period is interrupted if the boolean becomes false, or  *
+*          the coroutine is canceled.                                          *
 *******************************************************************************/
 void waitEx( unsigned long waitMs, bool *continuing, bool *canceling )
 {
-   auto go = std::chrono::high_resolution_clock::now() 
-             + std::chrono::milliseconds( waitMs ) ;
+   // The booleans can change at any time, so they are polled once per ms,
+   // with the coroutine on the timer heap in between:  the thread sleeps if
+   // nothing else can run, and virtual time (which stands still while any
+   // coroutine can run) moves on.
+   long long go = clockNs() + (long long)waitMs * 1000000 ;
+
+   while ( ! ( ( clockNs() >= go ) 
+               || *continuing == false  
+               || ( canceling != NULL && *canceling == true ) 
+               || cancelRequested() ) ) {
+      wait( 1 ) ;
+   }
+}
+
+/*******************************************************************************
+* waitEx                                                                       *
+*                                                                              *
+* Purpose: waits for an extended period while continuing other coroutines.     *
+*          The waiting period is interrupted when the event is set.  The       *
+*          coroutine is not resumed until then.  Returns true if interrupted.  *
+*******************************************************************************/
+bool waitEx( unsigned long waitMs, EVENT *interrupting )
+{
+   return waitEvent( interrupting, waitMs ) ;
+}
+
+/*******************************************************************************
+* setEvent                                                                     *
+*                                                                              *
+* Purpose: sets an event, releasing all the coroutines waiting on it.  The     *
+*          event stays set until resetEvent().                                 *
+*******************************************************************************/
+void setEvent( EVENT *event )
+{
+   lockScheduler() ;
+   event->signaled = true ;
+   while ( unpark( &event->waiters ) ) {
+   }
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* resetEvent                                                                   *
+*                                                                              *
+* Purpose: clears an event, so that later waits on it block.                   *
+*******************************************************************************/
+void resetEvent( EVENT *event )
+{
+   lockScheduler() ;
+   event->signaled = false ;
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* waitEvent                                                                    *
+*                                                                              *
+* Purpose: waits, off the ring, for an event to be set or for timeoutMs ms.    *
+*          Returns true if the event is set.                                   *
+*******************************************************************************/
+bool waitEvent( EVENT *event, unsigned long timeoutMs )
+{
+   lockScheduler() ;
+   if ( event->signaled || timeoutMs == 0 ) {
+      bool signaled = event->signaled ;
+
+      unlockScheduler() ;
+      return signaled ;
+   }
+   return park( &event->waiters, timeoutMs ) ;
+}
+
+/*******************************************************************************
+* signalSemaphore                                                              *
+*                                                                              *
+* Purpose: releases a semaphore.  The count is handed straight to the          *
+*          longest-waiting coroutine, if there is one.                         *
+*******************************************************************************/
+void signalSemaphore( SEMAPHORE *semaphore )
+{
+   lockScheduler() ;
+   if ( ! unpark( &semaphore->waiters ) ) {
+      ++semaphore->count ;
+   }
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* waitSemaphore                                                                *
+*                                                                              *
+* Purpose: takes one from a semaphore's count, waiting off the ring (for up to *
+*          timeoutMs ms) while the count is zero.  Returns false on timeout.   *
+*******************************************************************************/
+bool waitSemaphore( SEMAPHORE *semaphore, unsigned long timeoutMs )
+{
+   lockScheduler() ;
+   if ( semaphore->count > 0 || timeoutMs == 0 ) {
+      bool taken = semaphore->count > 0 ;
+
+      if ( taken ) {
+         --semaphore->count ;
+      }
+      unlockScheduler() ;
+      return taken ;
+   }
+   return park( &semaphore->waiters, timeoutMs ) ;
+}
+
+/*******************************************************************************
+* broadcastCondition                                                           *
+*                                                                              *
+* Purpose: releases all the coroutines waiting on a condition variable.        *
+*******************************************************************************/
+void broadcastCondition( CONDITION *condition )
+{
+   lockScheduler() ;
+   while ( unpark( &condition->waiters ) ) {
+   }
+   unlockScheduler() ;
+}
+
+/*******************************************************************************
+* signalCondition                                                              *
+*                                                                              *
+* Purpose: releases the longest-waiting coroutine on a condition variable.     *
+*******************************************************************************/
+void signalCondition( CONDITION *condition )
+{
+   lockScheduler() ;
+   unpark( &condition->waiters ) ;
+   unlockScheduler() ;
+}
 
-   when( ( std::chrono::high_resolution_clock::now() >= go ) 
-         || *continuing == false  
-         || ( canceling != NULL && *canceling == true ) ) ; 
+/*******************************************************************************
+* waitCondition                                                                *
+*                                                                              *
+* Purpose: waits, off the ring, until the condition variable is signaled or    *
+*          timeoutMs ms pass.  Returns false on timeout.  As coroutines run    *
+*          one at a time on each worker no mutex is needed (with several       *
+*          workers, guard the condition with a SEMAPHORE or lock), but the     *
+*          waiter should recheck its condition when resumed:                   *
+*                                                                              *
+*             while ( ! ready ) { waitCondition( &changed ) ; }                *
+*******************************************************************************/
+bool waitCondition( CONDITION *condition, unsigned long timeoutMs )
+{
+   lockScheduler() ;
+   return park( &condition->waiters, timeoutMs ) ;
 }
 
@@ -0,0 +1,58 @@
+/*******************************************************************************
+**
+**       FILE:  mtint.h
+**
+**   SYNOPSIS:  Scheduler internals shared by the modules of the sccor library.
+**              Not part of the API.
+**
+**     AUTHOR:  Cary WR Campbell
+**
+** Copyright 2007 - 2021 Codecraft, Inc.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy 
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+** copies of the Software, and to permit persons to whom the Software is 
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in 
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+** FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+** DEALINGS IN THE SOFTWARE.
+*******************************************************************************/
+
+#ifndef MTINT_H
+#define MTINT_H
+
+#include <atomic>
+#include "sccorlib.h"
+
+// mt.cpp:  guard the scheduler's shared state when several workers run.
+void lockScheduler( void ) ;
+void unlockScheduler( void ) ;
+
+// mt.cpp:  parks the running coroutine on a wait queue, off the ring, until
+// unpark() or the timeout; returns true if released by unpark().  Called with
+// the scheduler locked, which it unlocks.
+bool park( WAIT_QUEUE *queue, unsigned long waitMs ) ;
+
+// mt.cpp:  puts the longest waiter of a queue back on the ring; returns false
+// if the queue is empty.  Called with the scheduler locked.
+bool unpark( WAIT_QUEUE *queue ) ;
+
+// coio.cpp:  number of coroutines parked on file descriptor readiness
+// (changed with the scheduler locked, but read by idle workers without it).
+extern std::atomic<int> ioWaiters ;
+
+// coio.cpp:  waits up to timeoutNs ns (forever if negative, not at all if 0)
+// for parked descriptors to become ready, and unparks their waiters.
+void pollIo( long long timeoutNs ) ;
+
+#endif // MTINT_H
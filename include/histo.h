@@ -24,42 +24,176 @@
 #define __HISTO_H
 
 //#include <iostream>
+#include <stddef.h>
+#include <stdint.h>
 
-// How many indices where value is Over.
+// How many of the largest values are tracked, unless TrackOutliers says.
 #define OVERN_TRACE_COUNT 10
 
-class Histogram {
+// Tag selecting the log-linear constructor of Histogram.
+enum LogLinear { logLinear } ;
+
+// Formats of Histogram::WriteText.
+enum TextFormat { prometheusText, jsonText, csvText } ;
+
+class ShardedHistogram ;
+class HistogramSegmentReader ;
+struct HistogramSegment ;
+class TextWriter ;
+
+// A distribution whose counts and values are of the unsigned type T:  uint32_t
+// (Histogram, the compact one) or uint64_t (Histogram64, whose counts don't
+// wrap and whose values may be ns).
+template <typename T>
+class BasicHistogram {
   public:
    // Standard constructor, defines the range and resolution of the distribution.
-   Histogram( unsigned int min, unsigned int countsPer, int bins = 10 ) ;
+   BasicHistogram( T min, T countsPer, int bins = 10 ) ;
+
+   // Log-linear (HDR-style) constructor, for a distribution covering the whole
+   // range of values with a relative resolution of significantDigits (1 to 5)
+   // decimal digits:  values up to 2 * 10^digits have bins of their own, and
+   // beyond that each doubling of the value doubles the width of the bins.
+   // There is no Under or Over data.  The bins take sizeof( T ) * (66 - b) *
+   // 2^(b - 1) bytes, where 2^b is the least power of two of at least
+   // 2 * 10^digits (29 KB for 2 digits, 225 KB for 3, with uint32_t).
+   BasicHistogram( LogLinear, int significantDigits = 2 ) ;
 
    // (Virtual) destructor releases dynamic storage for all bins.
-   virtual ~Histogram() ;
+   virtual ~BasicHistogram() ;
 
    // Function to reset a distribution to its empty state.
    void Reset() ;
 
    // Function to add another data point to the existing distribution.
-   void Add( unsigned int data ) ;
+   void Add( T data ) ;
+
+   // Function to add count data points at once, as when replaying recorded
+   // intervals.  For a linear Histogram (uint32_t), the bins, least, greatest
+   // and sum of four points at a time are found with SSE2 (SSE4.1 if enabled)
+   // or AArch64 NEON instructions.
+   void AddN( const T *data, size_t count ) ;
+
+   // Function to add the data points of another distribution to this one, as
+   // when combining the snapshots of several processes or rings.  Bins of the
+   // same layout (range and resolution, or significant digits) are summed;
+   // otherwise each of the other's bins is added at its lowest value (and its
+   // Under and Over counts at its least and greatest values).
+   void Merge( const BasicHistogram &other ) ;
+
+   // Function to move the bins and summary into a new shared-memory segment
+   // of the given name (see histoshm.h), for other processes to read while
+   // data points are added.  Returns false if the segment can't be made, if
+   // a live process already exports under the name (a segment left by one
+   // that has ended is replaced), or if the distribution is already exported.
+   // The segment is removed by Unexport() or the destructor.
+   bool Export( const char *name, const char *title = NULL ) ;
+   void Unexport( ) ;
+
+   // Function to write a compact binary snapshot of the distribution (layout,
+   // summary, outliers, and the bins that aren't empty, as the gap from
+   // the previous one and the zigzag-encoded change of count, all varints)
+   // into buffer.  Returns the size of the snapshot, which is written only if
+   // it is at most size bytes.  Snapshots hold no pointers and need no
+   // alignment, so a file of them may be mapped and read where it lies.
+   size_t Serialize( unsigned char *buffer, size_t size ) const ;
+
+   // Function returning a new distribution with the layout and data of the
+   // snapshot at buffer, and in *used (if not NULL) the snapshot's size; or
+   // NULL if the snapshot is malformed, or its counts don't fit in T.
+   static BasicHistogram *Deserialize( const unsigned char *buffer, size_t size,
+                                       size_t *used = NULL ) ;
+
+   // Function to add a snapshot to the distribution, as Merge would add the
+   // distribution it holds, decoding the bins straight into this one's when
+   // the layouts are the same.  Returns false (and adds nothing) if the
+   // snapshot is malformed.
+   bool MergeSerialized( const unsigned char *buffer, size_t size,
+                         size_t *used = NULL ) ;
+
+   // Functions to write the distribution as text, in one pass over the bins:
+   //   prometheusText - the cumulative buckets (le their greatest values),
+   //      _sum and _count of a histogram metric; name may carry labels, as
+   //      in "latency_us{worker=\"3\"}".
+   //   jsonText - one line, {"name", "n", "min", "max", "sum", "bins"}, each
+   //      bin [least, greatest, count, cumulative count].
+   //   csvText - a header line, and a line of name, least, greatest, count
+   //      and cumulative count for each bin.
+   // The bins are those up to Over of a linear distribution (with Under if
+   // minBin isn't 0, and Over if it isn't empty), and those that aren't
+   // empty of a log-linear one.  The first writes into buffer as much as
+   // fits, unterminated, and returns the length of the whole text, as
+   // snprintf does.  The second writes to fd in chunks of 8 KB, and returns
+   // false if a write fails.
+   size_t WriteText( TextFormat format, const char *name, 
+                     char *buffer, size_t size ) const ;
+   bool WriteText( TextFormat format, const char *name, int fd ) const ;
+
+   // Function returning the bin (numbered as for BinCount) a value goes into.
+   // There is no division:  see binShift and binMultiplier.
+   unsigned int BinOf( T data ) const
+   {
+      T offset = data - minBin ;
+      T targetBin ;
+
+      if ( subBucketBits )
+      {
+         return LogBin( data ) ;
+      }
+      if ( binShift >= 0 )
+      {
+         targetBin = offset >> binShift ;
+      }
+      else if ( sizeof( T ) == sizeof( uint32_t ) 
+                || ( binMultiplier && offset <= 0xFFFFFFFFu ) )
+      {
+         uint32_t low = (uint32_t) offset ;
+         uint32_t high = (uint32_t)( ( (uint64_t) low * binMultiplier ) >> 32 ) ;
+
+         targetBin = ( high + ( ( low - high ) >> 1 ) ) >> binPostShift ;
+      }
+      else
+      {
+         targetBin = offset / countsPerBin ;
+      }
+      targetBin = targetBin < nBins ? targetBin + 1 : nBins + 1 ;
+      return data < minBin ? 0 : (unsigned int) targetBin ;
+   }
+
+   // Function returning true if another distribution has the same bins.
+   bool SameLayout( const BasicHistogram &other ) const
+   {
+      return significantDigits == other.significantDigits 
+             && minBin == other.minBin && countsPerBin == other.countsPerBin 
+             && nBins == other.nBins ;
+   }
 
    // Access function returning the number of values that have been added.
-   unsigned int NValues( ) const { return n ; }
+   T NValues( ) const { return n ; }
 
    // Access function returning the minimum value that has been added.
-   unsigned int MinValue( ) const { return minData ; }
+   T MinValue( ) const { return minData ; }
 
    // Access function returning the maximum value that has been added.
-   unsigned int MaxValue( ) const { return maxData ; }
+   T MaxValue( ) const { return maxData ; }
 
    // Access function returning the minimum bin.
-   unsigned int MinBin( ) const { return minBin ; }
+   T MinBin( ) const { return minBin ; }
 
    // Access function returning the counts per bin.
-   unsigned int CountsPerBin( ) const { return countsPerBin ; }
+   T CountsPerBin( ) const { return countsPerBin ; }
 
    // Access function returning the number of bins.
    int NBins( ) const { return nBins ; }
 
+   // Access function returning the significant digits of a log-linear
+   // distribution, or 0 for a linear one.
+   int SignificantDigits( ) const { return significantDigits ; }
+
+   // Function returning the lowest value that goes into a bin (numbered as
+   // for BinCount).  The bin holds the values up to the next bin's.
+   unsigned long long BinValue( int binNumber ) const ;
+
    // Function returning the mean (average) of all values added.  This value may
    // be subject to numerical imprecision - the accumulation sum is held in a
    // double size floating point variable.
@@ -68,32 +202,131 @@ class Histogram {
    // Access function returning the number of data points that have accumulated
    // in a specific bin.  Bin 0 is the under range bin.  Bin N + 1 is the over
    // range bin, where N is the number of bins specified during creation.
-   unsigned int BinCount( int binNumber ) const ;
+   T BinCount( int binNumber ) const ;
 
    // Access function returning the largest number of data points that have been
-   // accumulated into any single bin.
-   unsigned int MaxBinCount( ) const { return maxFreq ; }
+   // accumulated into any single bin.  Found with the percentile index (see
+   // ValueAtPercentile), rather than by every Add.
+   T MaxBinCount( ) const { IndexCounts() ; return maxFreq ; }
+
+   // Function returning the value below or at which percentile percent (0 to
+   // 100) of the data points lie:  the highest value of the bin holding that
+   // rank, within MinValue() and MaxValue() (which are returned for the Under
+   // and Over bins).  The first query after an Add builds an index of
+   // cumulative counts, in one pass over the bins, that later queries search.
+   unsigned long long ValueAtPercentile( double percentile ) const ;
+
+   // Function storing in values[i] the ValueAtPercentile( percentiles[i] ), for
+   // count percentiles, building the index at most once.
+   void ValuesAtPercentiles( const double *percentiles, 
+                             unsigned long long *values, int count ) const ;
+
+   // A data point kept as an outlier:  its index (1 for the first point
+   // added), its value, and the time it was added (ns on the monotonic
+   // IntervalClock).
+   struct Outlier
+   {
+      T index ;
+      T value ;
+      unsigned long long timeNs ;
+   } ;
+
+   // Function to set how many of the largest values are kept (0 for none), and
+   // the size of a uniform (reservoir) sample of the Over values (0, the
+   // default, for none), clearing both.  A value that is neither among the
+   // largest nor Over costs two compares.
+   void TrackOutliers( int largest, int overSample = 0 ) ;
+
+   // Function storing in out up to max of the largest values, greatest first,
+   // and returning how many it stored.
+   int Outliers( Outlier *out, int max ) const ;
+
+   // Function storing in out up to max of the sample of Over values, in no
+   // particular order, and returning how many it stored.
+   int OverSample( Outlier *out, int max ) const ;
+
+   // Access function returning the number of Over values added.
+   T OverCount( ) const { return overSeen ; }
+
+   // Access function returning the number of Over values in the sample.
+   int OverSampled( ) const { return sampleCount ; }
 
    // Function to display the distribution, one bin per line, in the form
    // "<bin #>, <counts> \n".
    // void Display( ostream & ) const;
 
-  protected:
-   // This is a (static) array of indices whose values go into nBins + 1 ("Over").
-   // Only OVERN_TRACE_COUNT entries are tracked.
-   unsigned int overN[OVERN_TRACE_COUNT] ;
+  private:
+   friend class ShardedHistogram ;
+   friend class HistogramSegmentReader ;
 
-   // This is a (static) array of values corresponding to the above indices.
-   // Only OVERN_TRACE_COUNT entries are tracked.
-   unsigned int overValueN[OVERN_TRACE_COUNT] ;
+   // Functions to bracket a change of the bins and summary, which publish
+   // the summary to the segment, if exported.
+   void BeginWrite( ) ;
+   void EndWrite( ) ;
 
-   // This is a (static) array of timestamps corresponding to the above indices.
-   // Only OVERN_TRACE_COUNT entries are tracked.
-   unsigned int overTSN[OVERN_TRACE_COUNT] ;
+   // Function to write the text of WriteText to a buffer or an fd.
+   void WriteTextTo( TextFormat format, const char *name, 
+                     TextWriter &out ) const ;
+
+   // Function to add the summary and outliers of another distribution, as
+   // Merge does once the bins are added.
+   void MergeSummary( T otherN, T otherMin, T otherMax, double otherSummation,
+                      const Outlier *otherLargest, int otherLargestCount,
+                      const Outlier *otherSample, int otherSampleCount,
+                      T otherOverSeen ) ;
+
+   // Function to bring cumulative and maxFreq up to date with binVector.
+   void IndexCounts( ) const ;
+
+   // Function to compute binShift, binMultiplier and binPostShift.
+   void SetReciprocal( ) ;
+
+   // Function to set the least and greatest values of an empty distribution,
+   // so that the first value added replaces both.
+   void EmptySummary( ) ;
+
+   // Function returning true if a value is to be kept among the largest.
+   bool IsLargest( T data ) const
+   {
+      return largestCount < largestCapacity || data > largest[0].value ;
+   }
+
+   // Functions to keep a value among the largest (if IsLargest), and to
+   // count an Over value, sampling it if need be.
+   void NoteLargest( const Outlier &outlier ) ;
+   void NoteOver( T index, T data ) ;
+
+   // Function to note a point added to bin as an outlier, if it is one.
+   void NoteOutliers( T index, T data, unsigned int bin ) ;
+
+   // Function returning the bin for a value in a log-linear distribution:
+   // the bins pair up as 2^b - 1 bins of width 1, then 2^(b - 1) bins of each
+   // of the widths 2, 4, 8 and so on, found by a count of leading zeros.
+   unsigned int LogBin( unsigned long long data ) const
+   {
+      int bucket = 64 - subBucketBits 
+                      - __builtin_clzll( data | ( ( 1ULL << subBucketBits ) - 1 ) ) ;
+
+      return ( bucket << ( subBucketBits - 1 ) ) + (unsigned int)( data >> bucket ) 
+             + 1 ;
+   }
 
-  private:
    // Number of counts per bin, defines resolution of the binning process.
-   unsigned int countsPerBin ;
+   T countsPerBin ;
+
+   // Division by countsPerBin:  a shift of binShift bits if it is a power of
+   // two (otherwise -1), or for values and countsPerBin within 32 bits the
+   // round-up reciprocal of Granlund and Montgomery, q = (t + (x - t) / 2) >>
+   // binPostShift, where t is the high half of x * binMultiplier (0 if
+   // countsPerBin exceeds 32 bits, and the quotient is divided for).
+   int binShift ;
+   uint32_t binMultiplier ;
+   int binPostShift ;
+
+   // Significant digits of a log-linear distribution (0 when linear), and the
+   // number of bits b of the bins of width 1.
+   int significantDigits ;
+   int subBucketBits ;
 
    // Number of bins in the distribution, defines the binned range.  Two extra
    // slots are allocated to count under and over range data points
@@ -101,26 +334,54 @@ class Histogram {
 
    // This variable holds the minimum bound of the first bin.  All data points
    // below are binned as under range.
-   unsigned int minBin ;
+   T minBin ;
 
    // These variables hold the min and max data points that have been added.
-   unsigned int minData, maxData ;
+   T minData, maxData ;
 
-   // This variable holds the largest bin count of the histogram.
-   unsigned int maxFreq ;
+   // This variable holds the largest bin count of the histogram, when
+   // cumulativeValid.
+   mutable T maxFreq ;
 
    // This variable holds the number of data points that have been added.
-   unsigned int n ;
+   T n ;
 
    // This variable accumulates the total sum of all data points, to calculate
    // the mean value.
    double summation ;
 
    // This is a pointer to the dynamically allocated bin array.
-   unsigned int *binVector ;
+   T *binVector ;
 
    // Pointer to a surrounding guard area for binVector.
-   unsigned int *binVectorArea ;
+   T *binVectorArea ;
+
+   // Cumulative counts of the bins, allocated by the first percentile query,
+   // and whether they and maxFreq are up to date (cleared by Add and Reset).
+   mutable T *cumulative ;
+   mutable bool cumulativeValid ;
+
+   // The largest values kept, a min-heap on value, whose root is the least
+   // (a sentinel of the greatest value when none are kept).
+   Outlier *largest ;
+   int largestCount, largestCapacity ;
+   bool largestChanged ;               // since published to the segment
+
+   // The sample of Over values, the number of Over values, and the state of
+   // the xorshift generator choosing the sample.
+   Outlier *sample ;
+   int sampleCount, sampleCapacity ;
+   T overSeen ;
+   unsigned long long sampleRandom ;
+
+   // The segment holding binVector when exported (otherwise NULL), and its
+   // name.
+   HistogramSegment *segment ;
+   char *segmentName ;
 };
 
+// The widths provided (histo.cpp instantiates them).
+typedef BasicHistogram<uint32_t> Histogram ;
+typedef BasicHistogram<uint64_t> Histogram64 ;
+
 #endif
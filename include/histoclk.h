@@ -0,0 +1,115 @@
+// histoclk.h -- interval clock file header
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#if ! defined __HISTOCLK_H
+#define __HISTOCLK_H
+
+#include <time.h>
+#if defined( __APPLE__ ) && defined( __MACH__ )
+#include <mach/mach_time.h>
+#endif
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+// Sources of interval time:  the system's monotonic clock, unaffected by NTP
+// (clock_gettime( CLOCK_MONOTONIC_RAW ), or mach_absolute_time() on macOS),
+// the processor's time-stamp counter, read without a system call, or the
+// virtual clock of a simulation, in ns, which moves only when it is set
+// (sccor's virtual time, see setVirtualTime, sets it).
+enum ClockSource { monotonicClock, tscClock, virtualClock };
+
+// A reader of one of the sources, in ticks of the source, with the factor
+// that converts ticks to nanoseconds.  tscClock is used only where the
+// counter is invariant (it runs at a constant rate, in every power state);
+// elsewhere the clock falls back to monotonicClock.
+class IntervalClock
+{
+  public:
+   // Standard constructor; calibrates the time-stamp counter against the
+   // monotonic clock (for 10 ms) the first time any clock asks for it.
+   IntervalClock( ClockSource clockSource = monotonicClock ) ;
+
+   // Access function returning the source read, after any fallback.
+   ClockSource Source( ) const { return source ; }
+
+   // Function returning the current time, in ticks.
+   unsigned long long Ticks( ) const
+   {
+      #if defined( __x86_64__ ) || defined( __i386__ )
+      if ( source == tscClock )
+      {
+         return __rdtsc() ;
+      }
+      #endif
+      if ( source == virtualClock )
+      {
+         return virtualNs ;
+      }
+      return MonotonicTicks() ;
+   }
+
+   // Function converting an interval in ticks to nanoseconds.
+   unsigned long long ToNs( unsigned long long ticks ) const
+   {
+      #if defined( __SIZEOF_INT128__ )
+      return (unsigned long long)( ( (unsigned __int128) ticks * nsPerTick ) 
+                                   >> 32 ) ;
+      #else
+      return (unsigned long long)( (long double) ticks * nsPerTick 
+                                   / 4294967296.0L ) ;
+      #endif
+   }
+
+   // Function returning the current time, in nanoseconds.
+   unsigned long long Ns( ) const { return ToNs( Ticks() ) ; }
+
+   // Functions returning and setting the time of the virtual clock, in ns.
+   static unsigned long long VirtualNs( ) { return virtualNs ; }
+   static void SetVirtualNs( unsigned long long ns ) { virtualNs = ns ; }
+
+  private:
+   static unsigned long long MonotonicTicks( )
+   {
+      #if defined( __APPLE__ ) && defined( __MACH__ )
+      return mach_absolute_time() ;
+      #else
+      struct timespec now ;
+
+      clock_gettime( CLOCK_MONOTONIC_RAW, &now ) ;
+      return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec ;
+      #endif
+   }
+
+   // The factors (ns per tick, times 2^32) of the sources; 0 if the source
+   // is not usable.
+   static unsigned long long MonotonicScale( ) ;
+   static unsigned long long TscScale( ) ;
+
+   ClockSource source ;
+   unsigned long long nsPerTick ;      // times 2^32
+
+   static unsigned long long virtualNs ;   // the time of virtualClock
+};
+
+#endif // ! defined __HISTOCLK_H
@@ -0,0 +1,82 @@
+// histoshard.h -- thread-sharded Histogram recorder file header
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#if ! defined __HISTOSHARD_H
+#define __HISTOSHARD_H
+
+#include <atomic>
+#include "histo.h"
+
+// A recorder of a distribution that any number of threads may add to at once.
+// Each thread adds to one of a fixed number of shards, each its own bins and
+// summary on cache lines of their own, with relaxed atomic operations and no
+// lock.  Snapshot() merges the shards into a normal Histogram on demand.  Over
+// values are counted but not traced.
+class ShardedHistogram {
+  public:
+   // Constructors, with the bins of the corresponding Histogram constructors.
+   // The number of shards is rounded up to a power of two; 0 means one per
+   // hardware thread.
+   ShardedHistogram( unsigned int min, unsigned int countsPer, int bins = 10,
+                     int shards = 0 ) ;
+   ShardedHistogram( LogLinear, int significantDigits = 2, int shards = 0 ) ;
+
+   // Destructor releases the shards.
+   ~ShardedHistogram() ;
+
+   // Function to add a data point, from any thread.
+   void Add( unsigned int data ) ;
+
+   // Function to replace the distribution of a Histogram of the same layout
+   // (see Histogram::SameLayout) with the data points added so far.  Points
+   // added while the snapshot is taken may or may not be included.
+   void Snapshot( Histogram &into ) const ;
+
+   // Function to reset the recorder to its empty state.  Not to be called
+   // while other threads are adding.
+   void Reset() ;
+
+   // Access function returning the number of shards.
+   int NShards( ) const { return shardMask + 1 ; }
+
+  private:
+   // The bins and summary added to by some of the threads.  The bins have
+   // cache lines of their own, allocated apart (see BinBytes).
+   struct alignas( 64 ) Shard {
+      std::atomic<unsigned long long> summation ;
+      std::atomic<unsigned int> minData, maxData ;
+      std::atomic<unsigned int> *bins ;
+   } ;
+
+   void MakeShards( int shards ) ;
+   size_t BinBytes( ) const ;
+
+   // An empty Histogram giving the layout of the bins.
+   Histogram layout ;
+
+   // The shards, and their number less one.
+   Shard *shards ;
+   unsigned int shardMask ;
+};
+
+#endif // ! defined __HISTOSHARD_H
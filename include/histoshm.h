@@ -0,0 +1,120 @@
+// histoshm.h -- shared-memory Histogram export file header
+//
+// Copyright 2021 Codecraft, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is 
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in 
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+// DEALINGS IN THE SOFTWARE.
+
+
+#if ! defined __HISTOSHM_H
+#define __HISTOSHM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "histo.h"
+
+// Identification of a segment, changed whenever its layout changes.
+#define HISTOGRAM_SEGMENT_MAGIC   "SCCHIST"
+#define HISTOGRAM_SEGMENT_VERSION 2
+
+// How many of the largest values a segment holds.
+#define HISTOGRAM_SEGMENT_OUTLIERS 16
+
+// The layout of a Histogram exported to a named shared-memory segment (see
+// Histogram::Export).  The bins of the exporting Histogram live in the
+// segment, straight after this header, so adding a data point costs only the
+// two stores of the sequence (a seqlock) and of the summary below.  The
+// sequence is odd while the exporter is writing; a reader that finds it odd,
+// or changed by the end of its copy, copies again.
+struct alignas( 64 ) HistogramSegment {
+   char magic[8] ;                     // HISTOGRAM_SEGMENT_MAGIC
+   uint32_t version ;                  // HISTOGRAM_SEGMENT_VERSION
+   uint32_t countBytes ;               // width of the bins:  4 or 8
+   uint64_t bytes ;                    // size of the segment
+   int64_t pid ;                       // the exporting process
+   std::atomic<uint64_t> sequence ;
+   uint64_t minBin, countsPerBin ;     // the layout (see Histogram)
+   uint32_t nBins ;
+   int32_t significantDigits ;
+   uint64_t n, minData, maxData ;      // the summary
+   double summation ;
+   uint64_t overSeen ;
+   uint32_t largestCount ;             // of largest, greatest first
+   uint32_t reserved ;
+   struct {
+      uint64_t index, value, timeNs ;  // see Histogram::Outlier
+   } largest[HISTOGRAM_SEGMENT_OUTLIERS] ;
+   char title[80] ;
+
+   // Functions to bracket a change by the exporter.
+   void BeginWrite( )
+   {
+      sequence.store( sequence.load( std::memory_order_relaxed ) + 1,
+                      std::memory_order_relaxed ) ;
+      std::atomic_thread_fence( std::memory_order_release ) ;
+   }
+   void EndWrite( )
+   {
+      sequence.store( sequence.load( std::memory_order_relaxed ) + 1,
+                      std::memory_order_release ) ;
+   }
+
+   // Access function returning the bins, nBins + 2 counts of countBytes.
+   void *Bins( ) { return this + 1 ; }
+   const void *Bins( ) const { return this + 1 ; }
+} ;
+
+static_assert( std::atomic<uint64_t>::is_always_lock_free,
+               "HistogramSegment needs a lock-free 64-bit sequence" ) ;
+
+// A reader of an exported Histogram, in any process, which maps its segment
+// read-only.
+class HistogramSegmentReader {
+  public:
+   HistogramSegmentReader( ) : segment( NULL ), bytes( 0 ) { }
+
+   // Destructor unmaps the segment.
+   ~HistogramSegmentReader( ) ;
+
+   // Function to map a segment by name, returning false if there is none,
+   // or it is not a segment of this version.
+   bool Open( const char *name ) ;
+
+   // Function to unmap the segment.
+   void Close( ) ;
+
+   // Access functions returning the title and the exporting process.
+   const char *Title( ) const { return segment ? segment->title : "" ; }
+   long Pid( ) const { return segment ? (long) segment->pid : 0 ; }
+
+   // Function returning a new, empty Histogram64 with the layout of the
+   // segment, to take snapshots into, or NULL if none is open.
+   Histogram64 *NewHistogram( ) const ;
+
+   // Function to replace the distribution of a Histogram64 of the segment's
+   // layout with a consistent copy of the segment.  Returns false if the
+   // layouts differ, or the exporter was writing throughout many attempts.
+   bool Snapshot( Histogram64 &into ) const ;
+
+  private:
+   const HistogramSegment *segment ;
+   size_t bytes ;
+};
+
+#endif // ! defined __HISTOSHM_H
@@ -28,6 +28,7 @@
 #include <sys/time.h>
 #include <string.h>                     // strncpy on Cygwin
 #include "histo.h"                      // base class
+#include "histoclk.h"
 
 // Global function to pause and wait for a keystroke.
 //void pause( void );
@@ -35,8 +36,10 @@
 // Display properties.
 enum { base10, base16, graph, data };
 
-// A simple class for tallying and displaying interval times.
-class TimeIntervalHistogram : Histogram
+// A simple class for tallying and displaying interval times.  Its counts and
+// values are 64 bits wide (see Histogram64), so that neither long runs nor
+// intervals in nanoseconds overflow them.
+class TimeIntervalHistogram : Histogram64
 {
    // Display canvass limits.
    const static int width  = 79;
@@ -53,35 +56,60 @@ class TimeIntervalHistogram : Histogram
    int top;                            // top row of the graph:  1
    int bottom;                         // bottom row of the graph:  46
    int displayMode;                    // graph* | data
+   int firstBin;                       // bin shown on the row after Under
+   int binsPerRow;                     // bins summed on each row:  1 unless
+                                       //   log-linear
+   int rows;                           // rows between Under and Over
    bool firstTime;                     // first time switch to trigger some
                                        //   initialization
-   struct timeval tvPrevTimeValue;
-   struct timeval tvNextTimeValue;
-   unsigned int overCount;
+   bool nanoseconds;                   // tally() adds ns rather than s
+   IntervalClock clock;                // monotonicClock* | tscClock | virtualClock
+   unsigned long long prevTicks;       // clock at the previous tally
+   unsigned long long overCount;
    char m_banner[width + 1];           // Histogram top title
 
    char window[height][width + 1];     // canvass for displaying the histogram
 
+   // Text of show() and render(), and the lines on the screen after a live
+   // render() (both allocated on first use).
+   const static int outputBytes = ( height + 4 ) * ( width + 16 );
+   char *output;
+   char (*shown)[width + 1];
+   int shownLines;
+
                      // Note: the asterisked values above are not yet supported.
 
    friend void DisplayHistGraph( TimeIntervalHistogram &dataSet );
    friend void DisplayHistBins( TimeIntervalHistogram &dataSet, int radix );
+   friend class WindowedIntervalHistogram;
+
+   // Count shown on a row of the graph:  a bin, or for a log-linear histogram
+   // binsPerRow bins, and on the Under and Over rows all the bins before and
+   // after the other rows.
+   unsigned long long RowCount( int row ) const;
+
+   // Lay out the histogram in window, returning the number of lines, and
+   // yielding (by coresume) between the sections if asked.
+   int Compose( bool yielding );
 
  public:
 
    // Standard constructor; defines the ???, range, and resolution of
    // the distribution.
    TimeIntervalHistogram( const char* banner = 0,
-                          unsigned int min = 0,
-                          unsigned int countsPer = 500,
+                          unsigned long long min = 0,
+                          unsigned long long countsPer = 500,
                           int bins = 40 )
-                        : Histogram( min, countsPer, bins ), maxBarSize( 71.0 ),
+                        : Histogram64( min, countsPer, bins ), maxBarSize( 71.0 ),
                           barChar( 219 ), halfBarChar( 221 ),
                           displayMode( data ), firstTime( true ),
+                          nanoseconds( false ),
                           col( 0 ), col_b( col + 7 ),
                           maxCol( col_b + (int)maxBarSize ),
-                          top( 3 ), bottom( height - 13 )
+                          top( 3 ), bottom( height - 13 ),
+                          output( 0 ), shown( 0 ), shownLines( 0 )
    {
+      m_banner[0] = '\0';
       if ( banner )
       {
          strncpy( m_banner, banner, width ); // protect against an overwrite
@@ -89,8 +117,32 @@ class TimeIntervalHistogram : Histogram
       }
    }
 
-   // Destructor releases ??? ???.
-   ~TimeIntervalHistogram() { }
+   // Log-linear constructor (see Histogram), for intervals from 1 s to
+   // hours with a bounded relative error.  show() spreads the bins from the
+   // least value to the greatest over the rows of the graph.
+   TimeIntervalHistogram( const char* banner,
+                          LogLinear,
+                          int significantDigits = 2 )
+                        : Histogram64( logLinear, significantDigits ),
+                          maxBarSize( 71.0 ),
+                          barChar( 219 ), halfBarChar( 221 ),
+                          displayMode( data ), firstTime( true ),
+                          nanoseconds( false ),
+                          col( 0 ), col_b( col + 7 ),
+                          maxCol( col_b + (int)maxBarSize ),
+                          top( 3 ), bottom( height - 13 ),
+                          output( 0 ), shown( 0 ), shownLines( 0 )
+   {
+      m_banner[0] = '\0';
+      if ( banner )
+      {
+         strncpy( m_banner, banner, width ); // protect against an overwrite
+         m_banner[width] = '\0';             // insure null termination
+      }
+   }
+
+   // Destructor releases the rendered text.
+   ~TimeIntervalHistogram() { delete[] output; delete[] shown; }
 
    // Add an entry to the time interval histogram, with a value equal to the
    // elapsed time since the previous tally request.  The first tally request
@@ -98,6 +150,17 @@ class TimeIntervalHistogram : Histogram
    // preparation for subsequent tally requests.
    void tally( void );
 
+   // Have tally() add intervals in nanoseconds (or, if false, microseconds,
+   // the default).  The bins are not rescaled, so call this before the first
+   // tally, with a range chosen for ns.
+   void useNanoseconds( bool enabled = true ) { nanoseconds = enabled; }
+
+   // Have tally() read the given clock (see IntervalClock) instead of the
+   // monotonic clock; virtualClock times simulations in sccor's virtual time.
+   // Restarts the timer; returns false if the clock is not available here,
+   // and the monotonic clock is used.
+   bool useClock( ClockSource source );
+
    // Clear the histogram.
    void reset( void );
 
@@ -109,9 +172,124 @@ class TimeIntervalHistogram : Histogram
    // and then wait for the user to hit a key.
    void show( bool logToo = false );
 
+   // Render the histogram as show() does, but formatted into one buffer and
+   // written to fd with a single write(), returning false if that fails.
+   // Live, the first render clears the screen and later ones redraw, in
+   // place by ANSI cursor positioning, only the lines that have changed.
+   // Yielding, it calls coresume() between its sections, so that a
+   // monitoring coroutine doesn't hold up the others for a whole frame.
+   bool render( int fd = 1, bool live = false, bool yielding = false );
+
    // Add a scalar point (i.e., not a time interval) to the histogram.
    /* This is so I can create and display a normal histogram. CWRC */
-   void add( unsigned int data );
+   void add( unsigned long long data );
+
+   // Place the bins and summary in a named shared-memory segment, which a
+   // monitoring process reads with a HistogramSegmentReader (see histoshm.h)
+   // while intervals are tallied.  Returns false if it can't be made.
+   bool exportTo( const char *name ) { return Export( name, m_banner ); }
+
+   // Percentile queries (see Histogram); show() prints p50, p90, p99, and
+   // p99.9.
+   using Histogram64::ValueAtPercentile;
+   using Histogram64::ValuesAtPercentiles;
+
+   // Text exporters (see Histogram::WriteText).
+   using Histogram64::WriteText;
+
+   // The largest values and the sample of Over values (see
+   // Histogram::TrackOutliers); show() lists the largest, and the size of the
+   // sample.
+   using Histogram64::Outlier;
+   using Histogram64::TrackOutliers;
+   using Histogram64::Outliers;
+   using Histogram64::OverSample;
+   using Histogram64::OverCount;
+   using Histogram64::OverSampled;
+};
+
+// A TimeIntervalHistogram of a sliding window:  the intervals of the last
+// slices sub-intervals of sliceMs ms each.  Each slice is a Histogram64 of
+// its own, kept in a ring; moving the window on clears only the oldest
+// slices, so there is no gap at a boundary, as there is with reset().  The
+// queries and show() merge the live slices, once after each change.  The
+// slices take slices times the bins of one histogram.
+class WindowedIntervalHistogram
+{
+   TimeIntervalHistogram merged;       // the window, for queries and show()
+   bool mergedValid;                   // merged is up to date
+   Histogram64 **slices;               // the ring, of sliceCount
+   int sliceCount;
+   int current;                        // slice being added to
+   unsigned long long sliceNs;         // length of a slice:  0 if rotate()
+                                       //   alone moves the window on
+   unsigned long long sliceEndNs;      // clock at the end of current
+
+   void MakeSlices( int slices );
+
+   // Rotate to the slice holding the time nowNs.
+   void Advance( unsigned long long nowNs );
+
+   // Bring merged up to date.
+   void Merge( void );
+
+ public:
+
+   // Constructors of a window of slices slices of sliceMs ms, e.g. 60 of
+   // 1000 for the last minute, whose bins are those of the corresponding
+   // TimeIntervalHistogram constructor.  With sliceMs 0, the window moves
+   // on only by rotate().
+   WindowedIntervalHistogram( const char* banner,
+                              int slices,
+                              unsigned long sliceMs,
+                              unsigned long long min = 0,
+                              unsigned long long countsPer = 500,
+                              int bins = 40 );
+   WindowedIntervalHistogram( const char* banner,
+                              int slices,
+                              unsigned long sliceMs,
+                              LogLinear,
+                              int significantDigits = 2 );
+
+   // Destructor releases the slices.
+   ~WindowedIntervalHistogram();
+
+   // As TimeIntervalHistogram::tally( ), into the window.
+   void tally( void );
+
+   // As TimeIntervalHistogram::restartTimer( ).
+   void restartTimer( void );
+
+   // As TimeIntervalHistogram::add( ), into the window.
+   void add( unsigned long long data );
+
+   // Move the window on by one slice, clearing the oldest.
+   void rotate( void );
+
+   // Clear every slice.
+   void reset( void );
+
+   // Show (and optionally log) the window, as TimeIntervalHistogram::show.
+   void show( bool logToo = false );
+
+   // Render the window, as TimeIntervalHistogram::render.
+   bool render( int fd = 1, bool live = false, bool yielding = false );
+
+   // As for TimeIntervalHistogram (useClock also times the slices).
+   void useNanoseconds( bool enabled = true ) { merged.useNanoseconds( enabled ); }
+   bool useClock( ClockSource source );
+
+   // Queries of the window (see Histogram).
+   unsigned long long ValueAtPercentile( double percentile );
+   void ValuesAtPercentiles( const double *percentiles,
+                             unsigned long long *values, int count );
+   double MeanValue( void );
+   unsigned long long NValues( void );
+
+   // Text exporters of the window (see Histogram::WriteText).
+   size_t WriteText( TextFormat format, const char *name,
+                     char *buffer, size_t size );
+   bool WriteText( TextFormat format, const char *name, int fd );
 };
 
 #endif // ! defined __HISTOSPT_H
@@ -0,0 +1,385 @@
+/*******************************************************************************
+**
+**       FILE:  sccchan.h
+**
+**   SYNOPSIS:  Bounded channels for handing data between coroutines.
+**
+**              Send() parks the sender, off the ring, while the channel is
+**              full, and Recv() parks the receiver while it is empty, so a
+**              pipeline stage is only resumed when it can make progress.
+**              The elements live in a ring preallocated in the channel, and
+**              are moved in and out (they may be move-only), so no message
+**              causes a heap allocation.
+**
+**              Channel<T, N> has one sending and one receiving coroutine,
+**              which may run on different workers.  MpmcChannel<T, N> takes
+**              any number of each:  its ring is the bounded queue of
+**              D. Vyukov, whose cells carry sequence numbers, so senders and
+**              receivers never take a lock to hand over an element.  In both,
+**              waiting and waking use a SEMAPHORE only when a coroutine has
+**              to park.
+**
+**              Close() ends a channel:  Send() then fails, and Recv() fails
+**              once the elements already sent have been received.
+**
+**              Stackless coroutines use a Channel with co_await sccor::send()
+**              and sccor::recv() instead (see sccortask.h).
+**
+**     AUTHOR:  Cary WR Campbell
+**
+** Copyright 2007 - 2021 Codecraft, Inc.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+** FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+*******************************************************************************/
+
+#ifndef SCCCHAN_H
+#define SCCCHAN_H
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <stdio.h>         // NULL, for sccorlib.h
+#include "sccorlib.h"
+
+namespace sccor {
+   template <typename C, typename T> class SendOp ;
+   template <typename C, typename T> class RecvOp ;
+}
+
+// A count of free cells or of elements, which parks a coroutine on its
+// semaphore only when the count is exhausted.  After Close(), one Signal()
+// passes from each woken coroutine to the next.
+class ChannelCount {
+  public:
+   ChannelCount( long initial ) : count( initial ) { }
+
+   // Function to take one from the count, parking while there is none.  The
+   // coroutine is still counted as waiting if cancel() ends its wait.
+   void Wait( )
+   {
+      if ( ! Claim() ) {
+         while ( ! waitSemaphore( &semaphore ) ) {
+         }
+      }
+   }
+
+   // Function to take one from the count, returning false if there was none:
+   // the caller is then counted as waiting, and must wait on Waiters().
+   bool Claim( ) { return count.fetch_sub( 1 ) > 0 ; }
+
+   // Access function returning the semaphore the waiting coroutines park on.
+   SEMAPHORE *Waiters( ) { return &semaphore ; }
+
+   // Function to take one from the count if there is one, without parking.
+   bool TryWait( )
+   {
+      long now = count.load() ;
+
+      while ( now > 0 ) {
+         if ( count.compare_exchange_weak( now, now - 1 ) ) {
+            return true ;
+         }
+      }
+      return false ;
+   }
+
+   // Function to add one to the count, releasing a parked coroutine, if any.
+   void Signal( )
+   {
+      if ( count.fetch_add( 1 ) < 0 ) {
+         signalSemaphore( &semaphore ) ;
+      }
+   }
+
+  private:
+   // Available cells or elements; negative when coroutines are parked.
+   std::atomic<long> count ;
+
+   // The parked coroutines.
+   SEMAPHORE semaphore = {} ;
+};
+
+// Single-sender, single-receiver bounded channel of CAPACITY elements of T.
+template <typename T, unsigned long CAPACITY>
+class Channel {
+  public:
+   Channel( ) : head( 0 ), tail( 0 ), closed( false ),
+                spaces( CAPACITY ), items( 0 ) { }
+
+   // Destructor destroys the elements never received.
+   ~Channel( )
+   {
+      for ( unsigned long i = head; i != tail; i++ ) {
+         Cell( i )->~T() ;
+      }
+   }
+
+   // Function to send an element, parking while the channel is full.  Returns
+   // false (without sending) if the channel is closed.
+   bool Send( T &&element )
+   {
+      spaces.Wait() ;
+      return Put( std::move( element ) ) ;
+   }
+   bool Send( const T &element ) { T copy( element ) ; return Send( std::move( copy ) ) ; }
+
+   // Function to send an element if there is room, without parking.
+   bool TrySend( T &&element )
+   {
+      return spaces.TryWait() && Put( std::move( element ) ) ;
+   }
+
+   // Function to receive an element, parking while the channel is empty.
+   // Returns false once the channel is closed and empty.
+   bool Recv( T &element )
+   {
+      items.Wait() ;
+      return Take( element ) ;
+   }
+
+   // Function to receive an element if there is one, without parking.
+   bool TryRecv( T &element ) { return items.TryWait() && Take( element ) ; }
+
+   // Function to close the channel, releasing its parked coroutines.
+   void Close( )
+   {
+      closed = true ;
+      spaces.Signal() ;
+      items.Signal() ;
+   }
+
+   // Access function returning the number of elements waiting to be received.
+   unsigned long Size( ) const { return tail.load() - head.load() ; }
+
+  private:
+   template <typename C, typename U> friend class sccor::SendOp ;
+   template <typename C, typename U> friend class sccor::RecvOp ;
+
+   T *Cell( unsigned long i ) { return (T *)storage + i % CAPACITY ; }
+
+   bool Put( T &&element )
+   {
+      unsigned long at = tail.load( std::memory_order_relaxed ) ;
+
+      if ( closed ) {
+         spaces.Signal() ;
+         return false ;
+      }
+      new ( Cell( at ) ) T( std::move( element ) ) ;
+      tail.store( at + 1, std::memory_order_release ) ;
+      items.Signal() ;
+      return true ;
+   }
+
+   bool Take( T &element )
+   {
+      unsigned long at = head.load( std::memory_order_relaxed ) ;
+
+      if ( at == tail.load( std::memory_order_acquire ) ) {
+         // Closed, and nothing left:  pass the wakeup on.
+         items.Signal() ;
+         return false ;
+      }
+      element = std::move( *Cell( at ) ) ;
+      Cell( at )->~T() ;
+      head.store( at + 1, std::memory_order_release ) ;
+      spaces.Signal() ;
+      return true ;
+   }
+
+   // Indices (never wrapped) of the next element to receive and to send.
+   std::atomic<unsigned long> head, tail ;
+
+   // Set by Close().
+   std::atomic<bool> closed ;
+
+   // Free cells and elements sent but not yet received.
+   ChannelCount spaces, items ;
+
+   // The ring of elements.
+   alignas( T ) unsigned char storage[CAPACITY * sizeof( T )] ;
+};
+
+// Multiple-sender, multiple-receiver bounded channel of CAPACITY elements of T
+// (CAPACITY a power of two).  Safe with several workers.
+template <typename T, unsigned long CAPACITY>
+class MpmcChannel {
+   static_assert( CAPACITY >= 2 && ( CAPACITY & ( CAPACITY - 1 ) ) == 0,
+                  "MpmcChannel capacity must be a power of two" ) ;
+  public:
+   MpmcChannel( ) : head( 0 ), tail( 0 ), closed( false ), sending( 0 ),
+                    spaces( CAPACITY ), items( 0 )
+   {
+      for ( unsigned long i = 0; i < CAPACITY; i++ ) {
+         cells[i].sequence.store( i, std::memory_order_relaxed ) ;
+      }
+   }
+
+   // Destructor destroys the elements never received, in place.
+   ~MpmcChannel( )
+   {
+      for ( unsigned long i = head; i != tail; i++ ) {
+         ( (T *)cells[i & ( CAPACITY - 1 )].element )->~T() ;
+      }
+   }
+
+   // Function to send an element, parking while the channel is full.  Returns
+   // false (without sending) if the channel is closed.
+   bool Send( T &&element )
+   {
+      spaces.Wait() ;
+      return Put( std::move( element ) ) ;
+   }
+   bool Send( const T &element ) { T copy( element ) ; return Send( std::move( copy ) ) ; }
+
+   // Function to send an element if there is room, without parking.
+   bool TrySend( T &&element )
+   {
+      return spaces.TryWait() && Put( std::move( element ) ) ;
+   }
+
+   // Function to receive an element, parking while the channel is empty.
+   // Returns false once the channel is closed and empty.
+   bool Recv( T &element )
+   {
+      items.Wait() ;
+      return Take( element ) ;
+   }
+
+   // Function to receive an element if there is one, without parking.
+   bool TryRecv( T &element ) { return items.TryWait() && Take( element ) ; }
+
+   // Function to close the channel, releasing its parked coroutines.
+   void Close( )
+   {
+      closed = true ;
+      spaces.Signal() ;
+      items.Signal() ;
+   }
+
+  private:
+   typedef struct {
+      std::atomic<unsigned long> sequence ;  // turn of the cell (see Push/Pop)
+      alignas( T ) unsigned char element[sizeof( T )] ;
+   } Cell ;
+
+   bool Put( T &&element )
+   {
+      // Counted as sending before closed is checked, so that a receiver
+      // seeing no senders after Close() knows none is still to push.
+      ++sending ;
+      if ( closed ) {
+         --sending ;
+         spaces.Signal() ;
+         return false ;
+      }
+      // A cell was reserved by spaces, but a receiver may still be moving
+      // the previous element out of it.
+      while ( ! Push( element ) ) {
+         coresume() ;
+      }
+      --sending ;
+      items.Signal() ;
+      return true ;
+   }
+
+   bool Take( T &element )
+   {
+      // An element was counted by items, but its sender may still be moving
+      // it in.  After Close(), the channel is over only once no sender is
+      // between its check of closed and its push, and no cell is reserved.
+      while ( ! Pop( element ) ) {
+         if ( closed && sending == 0 && head.load() == tail.load() ) {
+            items.Signal() ;
+            return false ;
+         }
+         coresume() ;
+      }
+      spaces.Signal() ;
+      return true ;
+   }
+
+   // The cell for position p is free when its sequence is p, and holds an
+   // element when its sequence is p + 1.
+   bool Push( T &element )
+   {
+      unsigned long at = tail.load( std::memory_order_relaxed ) ;
+
+      for ( ;; ) {
+         Cell *cell = &cells[at & ( CAPACITY - 1 )] ;
+         long  lag = (long)( cell->sequence.load( std::memory_order_acquire ) - at ) ;
+
+         if ( lag == 0 ) {
+            if ( tail.compare_exchange_weak( at, at + 1, std::memory_order_relaxed ) ) {
+               new ( cell->element ) T( std::move( element ) ) ;
+               cell->sequence.store( at + 1, std::memory_order_release ) ;
+               return true ;
+            }
+         } else if ( lag < 0 ) {
+            return false ;
+         } else {
+            at = tail.load( std::memory_order_relaxed ) ;
+         }
+      }
+   }
+
+   bool Pop( T &element )
+   {
+      unsigned long at = head.load( std::memory_order_relaxed ) ;
+
+      for ( ;; ) {
+         Cell *cell = &cells[at & ( CAPACITY - 1 )] ;
+         long  lag = (long)( cell->sequence.load( std::memory_order_acquire ) - ( at + 1 ) ) ;
+
+         if ( lag == 0 ) {
+            if ( head.compare_exchange_weak( at, at + 1, std::memory_order_relaxed ) ) {
+               T *held = (T *)cell->element ;
+
+               element = std::move( *held ) ;
+               held->~T() ;
+               cell->sequence.store( at + CAPACITY, std::memory_order_release ) ;
+               return true ;
+            }
+         } else if ( lag < 0 ) {
+            return false ;
+         } else {
+            at = head.load( std::memory_order_relaxed ) ;
+         }
+      }
+   }
+
+   // Positions (never wrapped) of the next receive and send, each on a cache
+   // line of its own.
+   alignas( 64 ) std::atomic<unsigned long> head ;
+   alignas( 64 ) std::atomic<unsigned long> tail ;
+
+   // Set by Close().
+   std::atomic<bool> closed ;
+
+   // Senders that have not yet either failed or pushed their element.
+   std::atomic<long> sending ;
+
+   // Free cells and elements sent but not yet received.
+   ChannelCount spaces, items ;
+
+   // The ring of cells.
+   Cell cells[CAPACITY] ;
+};
+
+#endif // SCCCHAN_H
@@ -32,6 +32,9 @@
 #ifndef SCCORLIB_H
 #define SCCORLIB_H
 
+#include <sys/types.h>
+#include <sys/socket.h>
+
 /*------------------------------------------------------------
                          Define Macros
 ------------------------------------------------------------*/
@@ -54,24 +57,154 @@ typedef unsigned char byte ;
 
 typedef void (*COROUTINE)( void ) ;
 
+class TimeIntervalHistogram ;           // histospt.h
+
+/*
+**  Coroutines blocked on an event, semaphore, or condition variable are
+**  kept off the ring on its wait queue until released.  Zero-initialize
+**  these objects, e.g.:  EVENT ready = {} ;  SEMAPHORE slots = { 4 } ;
+*/
+typedef struct WAIT_QUEUE {
+   void *head ;            // longest-waiting coroutine
+   void *tail ;
+} WAIT_QUEUE ;
+
+typedef struct EVENT {
+   bool       signaled ;   // set; waits return at once until reset
+   WAIT_QUEUE waiters ;
+} EVENT ;
+
+typedef struct SEMAPHORE {
+   long       count ;
+   WAIT_QUEUE waiters ;
+} SEMAPHORE ;
+
+typedef struct CONDITION {
+   WAIT_QUEUE waiters ;
+} CONDITION ;
+
+/*
+**  Counters kept for each coroutine instance when the library is built with
+**  SCCOR_STATS (see getCoroutineStats).  The histograms, if enabled by
+**  setStatsHistograms, are released when the instance finishes.
+*/
+typedef struct COROUTINE_STATS {
+   unsigned long      id ;            // 1 for the first instance, and so on
+   COROUTINE          entry ;         // the coroutine
+   unsigned long      resumes ;       // times resumed
+   unsigned long long bytesCopied ;   // frame bytes saved and restored
+   unsigned long      maxFrameBytes ; // largest frame saved or restored
+   unsigned long long runNs ;         // time run, from resumes to yields
+   TimeIntervalHistogram *runSlices ;     // us run per resume, or NULL
+   TimeIntervalHistogram *resumeLatency ; // us on the ring per resume, or NULL
+} COROUTINE_STATS ;
+
+/*
+**  A coroutine instance, as returned by invoke(), for join() and cancel().
+**  The slot is reused once the instance finishes, under a new generation,
+**  so a handle to a finished instance stays safe to use until its cobegin
+**  returns.  A zero-initialized handle refers to no instance.
+*/
+typedef struct COROUTINE_HANDLE {
+   void         *slot ;
+   unsigned long generation ;
+} COROUTINE_HANDLE ;
+
+// Scheduling policies (see setPolicy) and priority levels.
+#define POLICY_ROUND_ROBIN 0
+#define POLICY_PRIORITY    1
+#define POLICY_DEADLINE    2
+
+#define PRIORITY_LOW       0
+#define PRIORITY_NORMAL    1
+#define PRIORITY_HIGH      2
+#define PRIORITY_CRITICAL  3
+#define PRIORITY_LEVELS    4
+
+// How a stackless coroutine suspends (see parkStep and sccortask.h).
+#define STEP_YIELD         0
+#define STEP_WAIT          1
+#define STEP_EVENT         2
+#define STEP_SEMAPHORE     3
+#define STEP_CONDITION     4
+#define STEP_JOIN          5
+#define STEP_CHANNEL       6       // as STEP_SEMAPHORE, but not ended by cancel
+
+// Backing of the CSA's chunks (see setCsaPages).
+#define CSA_PAGES_NORMAL   0       // the heap
+#define CSA_PAGES_HUGE     1       // transparent hugepages
+#define CSA_PAGES_HUGETLB  2       // the hugetlb pool, else as CSA_PAGES_HUGE
+
+// Timeout for waiting with no time limit.
+#define WAIT_FOREVER ( (unsigned long)-1 )
+
 /*------------------------------------------------------------
                               API
 ------------------------------------------------------------*/
 
+void  broadcastCondition( CONDITION *condition ) ;
+bool  cancel( COROUTINE_HANDLE handle ) ;
+bool  cancelRequested( void ) ;
+int   co_accept( int fd, struct sockaddr *address, socklen_t *length ) ;
+ssize_t co_read( int fd, void *buffer, size_t count ) ;
+ssize_t co_write( int fd, const void *buffer, size_t count ) ;
 void  cobegin( int n, ... ) ;
 void  coresume( void ) ;
 int   getCoroutineCount( void ) ;
-void  invoke( COROUTINE coroutine, int argc, ... ) ;
+int   getCoroutineStats( COROUTINE_STATS *stats, int max ) ;
+unsigned long long getClockNs( void ) ;    // the clock of wait() and timeouts
+unsigned long getCsaSize( void ) ;
+bool  getRunningStats( COROUTINE_STATS *stats ) ;
+int   getWorkerIndex( void ) ;
+COROUTINE_HANDLE invoke( COROUTINE coroutine, int argc, ... ) ;
+void  invokeN( COROUTINE coroutine, int count, int argCount, 
+               const long *args,             // args[count][argCount]
+               COROUTINE_HANDLE *handles = NULL ) ; // handles[count]
+COROUTINE_HANDLE invokeClosure( void (*start)( void * ), unsigned long bytes, 
+                     void (*construct)( void *storage, void *context ), 
+                     void *context ) ;        // see sccorpp.h
+COROUTINE_HANDLE invokeStep( bool (*step)( void * ), 
+                             void *context ) ; // see sccortask.h
+bool  join( COROUTINE_HANDLE handle, unsigned long timeoutMs = WAIT_FOREVER ) ;
+bool  parkStep( int reason, void *object, unsigned long timeoutMs ) ;
+void  pinCoroutine( int worker ) ;                // -1 unpins
+void  resetEvent( EVENT *event ) ;
+void  setCsaLimit( unsigned long bytes ) ;
+void  setCsaPages( int pages, int numaNode = -1 ) ;
+void  setDeadline( unsigned long deadlineMs ) ;
+void  setEvent( EVENT *event ) ;
+void  setPolicy( int policy ) ;
+void  setPriority( int priority ) ;
+void  setStackSize( unsigned long bytes ) ; // separate-stack backend only
+void  setStatsHistograms( bool enabled ) ;
+void  setStatsReport( void (*report)( const COROUTINE_STATS *stats ) ) ;
+void  setVirtualTime( bool enabled ) ;
+void  setWorkerCount( int count, bool pinned = false ) ; // likewise
+void  signalCondition( CONDITION *condition ) ;
+void  signalSemaphore( SEMAPHORE *semaphore ) ;
 void  sleepMs( unsigned long sleepMs ) ;
+bool  stepSignaled( void ) ;
 void  wait( unsigned long waitMs ) ;
+bool  waitCondition( CONDITION *condition, 
+                     unsigned long timeoutMs = WAIT_FOREVER ) ;
+bool  waitEvent( EVENT *event, unsigned long timeoutMs = WAIT_FOREVER ) ;
 void  waitEx( unsigned long waitMs, bool *continuing, 
               bool *canceling = NULL ) ;
+bool  waitEx( unsigned long waitMs, EVENT *interrupting ) ;
+bool  waitReadable( int fd, unsigned long timeoutMs = WAIT_FOREVER ) ;
+bool  waitSemaphore( SEMAPHORE *semaphore, 
+                     unsigned long timeoutMs = WAIT_FOREVER ) ;
+bool  waitWritable( int fd, unsigned long timeoutMs = WAIT_FOREVER ) ;
 
 /*------------------------------------------------------------
                            Debugging
 ------------------------------------------------------------*/
 
-void dump( const void * const pMemory, int size, byte *pShow = 0 ) ;
+void   dump( const void * const pMemory, int size, byte *pShow = 0 ) ;
+size_t dumpToBuffer( const void * const pMemory, int size, char *buffer,
+                     size_t bufferSize, byte *pShow = 0, bool collapse = false ) ;
+bool   dumpToFd( int fd, const void * const pMemory, int size, 
+                 byte *pShow = 0, bool collapse = false ) ;
 
 #endif // SCCORLIB_H
 
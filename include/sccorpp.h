@@ -0,0 +1,123 @@
+/*******************************************************************************
+**
+**       FILE:  sccorpp.h
+**
+**   SYNOPSIS:  Type-safe C++ front end for starting coroutines.
+**
+**              sccor::invoke( f, args... ) starts a coroutine calling any
+**              callable (a function, or a lambda with captures) with any
+**              arguments (doubles, structs, move-only types), instead of
+**              the longs that ::invoke() passes through va_arg.  The callable
+**              and its arguments are moved, once, into storage of the new
+**              coroutine (the top of its stack, with separate stacks), and
+**              the coroutine starts in a trampoline chosen at compile time
+**              for their types.
+**
+**              sccor::cobegin( f... ) starts a coroutine for each callable
+**              and runs them all, like ::cobegin().
+**
+**              They are in namespace sccor so that they don't hijack calls
+**              of ::invoke( COROUTINE, int, ... ) and ::cobegin( int, ... ).
+**
+**     AUTHOR:  Cary WR Campbell
+**
+** Copyright 2007 - 2021 Codecraft, Inc.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+** FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+*******************************************************************************/
+
+#ifndef SCCORPP_H
+#define SCCORPP_H
+
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <stdio.h>         // NULL, for sccorlib.h
+#include "sccorlib.h"
+
+namespace sccor {
+
+// The callable and arguments of one coroutine, kept in its storage.
+template <typename F, typename... Args>
+class Closure {
+  public:
+   template <typename G, typename... A>
+   Closure( G &&g, A &&... a ) : f( std::forward<G>( g ) ), 
+                                  args( std::forward<A>( a )... ) { }
+
+   // Trampoline:  the coroutine invokeClosure() starts.
+   static void Start( void *storage )
+   {
+      Closure *closure = (Closure *)storage ;
+
+      std::apply( std::move( closure->f ), std::move( closure->args ) ) ;
+      closure->~Closure() ;
+   }
+
+   // Moves (or copies, for lvalues) the callable and arguments referred to by
+   // the tuple at context into storage.
+   template <typename Refs>
+   static void Construct( void *storage, void *context )
+   {
+      std::apply( [storage]( auto &&... from ) {
+                     new ( storage ) Closure( std::forward<decltype( from )>( from )... ) ;
+                  }, std::move( *(Refs *)context ) ) ;
+   }
+
+  private:
+   F f ;
+   std::tuple<Args...> args ;
+};
+
+// Function to place a new coroutine instance calling f( args... ) on the ring,
+// returning its handle.  As with ::invoke(), it won't run until the next task
+// switch.
+template <typename F, typename... Args>
+COROUTINE_HANDLE invoke( F &&f, Args &&... args )
+{
+   typedef Closure<std::decay_t<F>, std::decay_t<Args>...> C ;
+   typedef std::tuple<F &&, Args &&...> Refs ;
+   static_assert( alignof( C ) <= 16, "coroutine closure alignment too large" ) ;
+
+   Refs refs( std::forward<F>( f ), std::forward<Args>( args )... ) ;
+
+   return invokeClosure( C::Start, sizeof( C ), C::template Construct<Refs>, &refs ) ;
+}
+
+// Function to start a coroutine for each callable and run them all, returning
+// when every coroutine has finished.
+template <typename... F>
+void cobegin( F &&... f )
+{
+   typedef std::tuple<F &&...> Refs ;
+   Refs refs( std::forward<F>( f )... ) ;
+
+   // A first coroutine starts the others, so that they are invoked while
+   // the multitasker runs.
+   ::cobegin( 1, (COROUTINE)( void (*)( Refs * ) )[]( Refs *all ) {
+                 std::apply( []( auto &&... each ) {
+                                ( sccor::invoke( std::forward<decltype( each )>( each ) ), ... ) ;
+                             }, std::move( *all ) ) ;
+              }, 1, (long)&refs ) ;
+}
+
+} // namespace sccor
+
+#endif // SCCORPP_H
@@ -0,0 +1,296 @@
+/*******************************************************************************
+**
+**       FILE:  sccortask.h
+**
+**   SYNOPSIS:  Stackless (C++20) coroutines on the sccor ring.
+**
+**              A function returning sccor::task is a C++20 coroutine, whose
+**              frame the compiler keeps on the heap (from a pool, see
+**              FramePool).  sccor::spawn( t ) puts it on the same ring as
+**              the classic coroutines of cobegin() and invoke(), and when
+**              its turn comes it runs on the stack of the coroutine switching
+**              away, until its next co_await:
+**
+**                 co_await sccor::yield() ;           // like coresume()
+**                 co_await sccor::wait( 10 ) ;        // like wait( 10 )
+**                 co_await sccor::wait( &ready ) ;    // like waitEvent()
+**                 co_await sccor::acquire( &slots ) ; // like waitSemaphore()
+**                 co_await sccor::wait( &changed ) ;  // like waitCondition()
+**                 co_await sccor::send( channel, x ) ;
+**                 co_await sccor::recv( channel, x ) ;
+**                 co_await sccor::join( handle ) ;    // like join( handle )
+**
+**              A task switch then resumes a handle:  no frame is copied and
+**              no stack is switched.  The waits with timeouts yield false on
+**              timeout or cancel(), and send() and recv() yield false once the
+**              Channel is closed, as the blocking calls do.  sccor::spawn()
+**              returns the COROUTINE_HANDLE of the task.  A task must not call
+**              coresume() or the blocking calls themselves; it may deal with
+**              classic coroutines through the same events, semaphores,
+**              condition variables and channels.  A task's calls run on the
+**              stack of another coroutine, so they should be kept shallow.
+**
+**              Requires C++20 (-std=c++20).
+**
+**     AUTHOR:  Cary WR Campbell
+**
+** Copyright 2007 - 2021 Codecraft, Inc.
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+** OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+** FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+** DEALINGS IN THE SOFTWARE.
+*******************************************************************************/
+
+#ifndef SCCORTASK_H
+#define SCCORTASK_H
+
+#include <exception>
+#include <new>
+#include <utility>
+#include <stddef.h>
+#include <stdio.h>         // NULL, for sccorlib.h
+#if __has_include( <coroutine> )
+#include <coroutine>
+#define SCCOR_CO std
+#else
+#include <experimental/coroutine>
+#define SCCOR_CO std::experimental
+#endif
+#include "sccorlib.h"
+#include "sccchan.h"
+
+namespace sccor {
+
+// Frames of tasks, once freed, are kept for reuse on a free list per size
+// class (64 bytes to 4 KiB, in powers of two) of the thread freeing them.
+// Larger frames come from the heap.
+class FramePool {
+  public:
+   // Function to return a frame of at least 'bytes' bytes.
+   static void *Allocate( size_t bytes )
+   {
+      int  sizeClass = Class( bytes ) ;
+      Free *frame ;
+
+      if ( sizeClass >= CLASSES ) {
+         return ::operator new( bytes ) ;
+      }
+      frame = lists[sizeClass] ;
+      if ( frame == NULL ) {
+         return ::operator new( MIN_BYTES << sizeClass ) ;
+      }
+      lists[sizeClass] = frame->next ;
+      return frame ;
+   }
+
+   // Function to release a frame given by Allocate( bytes ).
+   static void Release( void *frame, size_t bytes )
+   {
+      int sizeClass = Class( bytes ) ;
+
+      if ( sizeClass >= CLASSES ) {
+         ::operator delete( frame ) ;
+         return ;
+      }
+      ( (Free *)frame )->next = lists[sizeClass] ;
+      lists[sizeClass] = (Free *)frame ;
+   }
+
+  private:
+   static const int    CLASSES = 7 ;
+   static const size_t MIN_BYTES = 64 ;
+
+   typedef struct Free {
+      struct Free *next ;
+   } Free ;
+
+   static int Class( size_t bytes )
+   {
+      int sizeClass = 0 ;
+
+      while ( ( MIN_BYTES << sizeClass ) < bytes && sizeClass < CLASSES ) {
+         ++sizeClass ;
+      }
+      return sizeClass ;
+   }
+
+   static inline thread_local Free *lists[CLASSES] = {} ;
+};
+
+// A stackless coroutine, not yet started.  It starts once spawned.
+class task {
+  public:
+   struct promise_type {
+      task get_return_object( )
+      {
+         return task( SCCOR_CO::coroutine_handle<promise_type>::from_promise( *this ) ) ;
+      }
+      SCCOR_CO::suspend_always initial_suspend( ) noexcept { return {} ; }
+      SCCOR_CO::suspend_always final_suspend( ) noexcept { return {} ; }
+      void return_void( ) { }
+      void unhandled_exception( ) { std::terminate() ; }
+
+      static void *operator new( size_t bytes ) { return FramePool::Allocate( bytes ) ; }
+      static void operator delete( void *frame, size_t bytes ) 
+      {
+         FramePool::Release( frame, bytes ) ;
+      }
+   };
+
+   task( task &&other ) noexcept : frame( std::exchange( other.frame, nullptr ) ) { }
+   task( const task & ) = delete ;
+
+   // Destructor destroys a task that was never spawned.
+   ~task( )
+   {
+      if ( frame ) {
+         frame.destroy() ;
+      }
+   }
+
+  private:
+   friend COROUTINE_HANDLE spawn( task &&t ) ;
+
+   explicit task( SCCOR_CO::coroutine_handle<promise_type> h ) : frame( h ) { }
+
+   // The step invokeStep() runs:  resumes the task up to its next co_await.
+   static bool Step( void *address )
+   {
+      auto handle = SCCOR_CO::coroutine_handle<promise_type>::from_address( address ) ;
+
+      handle.resume() ;
+      if ( handle.done() ) {
+         handle.destroy() ;
+         return true ;
+      }
+      return false ;
+   }
+
+   SCCOR_CO::coroutine_handle<promise_type> frame ;
+};
+
+// Function to place a task on the ring, returning its handle.  As with
+// ::invoke(), it won't run until the next task switch.
+inline COROUTINE_HANDLE spawn( task &&t )
+{
+   return invokeStep( task::Step, std::exchange( t.frame, nullptr ).address() ) ;
+}
+
+// An awaitable suspending the running task through parkStep().
+class Suspension {
+  public:
+   Suspension( int reason, void *object, unsigned long timeoutMs ) 
+      : reason( reason ), object( object ), timeoutMs( timeoutMs ) { }
+
+   bool await_ready( ) const noexcept { return false ; }
+   bool await_suspend( SCCOR_CO::coroutine_handle<> ) 
+   {
+      return parkStep( reason, object, timeoutMs ) ;
+   }
+   bool await_resume( ) const { return stepSignaled() ; }
+
+  private:
+   int           reason ;
+   void         *object ;
+   unsigned long timeoutMs ;
+};
+
+inline Suspension yield( ) { return Suspension( STEP_YIELD, NULL, 0 ) ; }
+
+inline Suspension wait( unsigned long waitMs ) 
+{
+   return Suspension( STEP_WAIT, NULL, waitMs ) ;
+}
+
+inline Suspension wait( EVENT *event, unsigned long timeoutMs = WAIT_FOREVER )
+{
+   return Suspension( STEP_EVENT, event, timeoutMs ) ;
+}
+
+inline Suspension wait( CONDITION *condition, 
+                        unsigned long timeoutMs = WAIT_FOREVER )
+{
+   return Suspension( STEP_CONDITION, condition, timeoutMs ) ;
+}
+
+inline Suspension acquire( SEMAPHORE *semaphore, 
+                           unsigned long timeoutMs = WAIT_FOREVER )
+{
+   return Suspension( STEP_SEMAPHORE, semaphore, timeoutMs ) ;
+}
+
+// The handle must outlive the co_await.
+inline Suspension join( const COROUTINE_HANDLE &handle, 
+                        unsigned long timeoutMs = WAIT_FOREVER )
+{
+   return Suspension( STEP_JOIN, (void *)&handle, timeoutMs ) ;
+}
+
+// Awaitables sending to and receiving from a Channel, suspending only while
+// it is full or empty.
+template <typename C, typename T>
+class SendOp {
+  public:
+   SendOp( C &channel, T &&element ) 
+      : channel( channel ), element( std::move( element ) ) { }
+
+   bool await_ready( ) { return channel.spaces.Claim() ; }
+   bool await_suspend( SCCOR_CO::coroutine_handle<> )
+   {
+      return parkStep( STEP_CHANNEL, channel.spaces.Waiters(), WAIT_FOREVER ) ;
+   }
+   bool await_resume( ) { return channel.Put( std::move( element ) ) ; }
+
+  private:
+   C &channel ;
+   T  element ;
+};
+
+template <typename C, typename T>
+class RecvOp {
+  public:
+   RecvOp( C &channel, T &element ) : channel( channel ), element( element ) { }
+
+   bool await_ready( ) { return channel.items.Claim() ; }
+   bool await_suspend( SCCOR_CO::coroutine_handle<> )
+   {
+      return parkStep( STEP_CHANNEL, channel.items.Waiters(), WAIT_FOREVER ) ;
+   }
+   bool await_resume( ) { return channel.Take( element ) ; }
+
+  private:
+   C &channel ;
+   T &element ;
+};
+
+template <typename T, unsigned long N>
+SendOp<Channel<T, N>, T> send( Channel<T, N> &channel, T element )
+{
+   return SendOp<Channel<T, N>, T>( channel, std::move( element ) ) ;
+}
+
+template <typename T, unsigned long N>
+RecvOp<Channel<T, N>, T> recv( Channel<T, N> &channel, T &element )
+{
+   return RecvOp<Channel<T, N>, T>( channel, element ) ;
+}
+
+} // namespace sccor
+
+#undef SCCOR_CO
+
+#endif // SCCORTASK_H